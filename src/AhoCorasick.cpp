@@ -0,0 +1,144 @@
+#include "AhoCorasick.h"
+#include <QQueue>
+#include <algorithm>
+
+AhoCorasick::AhoCorasick()
+    : m_classCount(1)
+{
+}
+
+void AhoCorasick::clear()
+{
+    m_byteClass.clear();
+    m_classCount = 1;
+    m_transitions.clear();
+    m_outputStart.clear();
+    m_outputs.clear();
+    m_patternLengths.clear();
+}
+
+bool AhoCorasick::isEmpty() const
+{
+    return m_transitions.isEmpty();
+}
+
+int AhoCorasick::patternCount() const
+{
+    return m_patternLengths.size();
+}
+
+int AhoCorasick::patternLength(int pattern) const
+{
+    return m_patternLengths.value(pattern);
+}
+
+void AhoCorasick::build(const QList<QByteArray> &patterns, bool caseInsensitive)
+{
+    clear();
+
+    auto fold = [caseInsensitive](quint8 byte) -> quint8 {
+        if (caseInsensitive && byte >= 'A' && byte <= 'Z') {
+            return byte + ('a' - 'A');
+        }
+        return byte;
+    };
+
+    // Byte classes: every byte used by a pattern gets its own class, the
+    // rest share class 0. This keeps the dense table small.
+    m_byteClass.fill(0, 256);
+    for (const QByteArray &pattern : patterns) {
+        for (char ch : pattern) {
+            const quint8 byte = fold(static_cast<quint8>(ch));
+            if (m_byteClass[byte] == 0 && m_classCount < 256) {
+                m_byteClass[byte] = static_cast<quint8>(m_classCount++);
+            }
+        }
+    }
+    if (caseInsensitive) {
+        for (int byte = 'A'; byte <= 'Z'; ++byte) {
+            m_byteClass[byte] = m_byteClass[byte + ('a' - 'A')];
+        }
+    }
+
+    // Trie
+    m_transitions.fill(-1, m_classCount);
+    QVector<QVector<qint32>> ownOutputs(1);
+
+    for (int id = 0; id < patterns.size(); ++id) {
+        const QByteArray &pattern = patterns.at(id);
+        m_patternLengths.append(pattern.size());
+        if (pattern.isEmpty()) {
+            continue;
+        }
+
+        qint32 state = 0;
+        for (char ch : pattern) {
+            const int cls = m_byteClass[static_cast<quint8>(ch)];
+            qint32 next = m_transitions[state * m_classCount + cls];
+            if (next < 0) {
+                next = ownOutputs.size();
+                ownOutputs.append(QVector<qint32>());
+                m_transitions.resize(m_transitions.size() + m_classCount);
+                std::fill(m_transitions.end() - m_classCount, m_transitions.end(), -1);
+                m_transitions[state * m_classCount + cls] = next;
+            }
+            state = next;
+        }
+        ownOutputs[state].append(id);
+    }
+
+    if (ownOutputs.size() == 1) {
+        clear(); // Nothing but empty patterns
+        return;
+    }
+
+    // Breadth-first pass turns the trie into a DFA: missing edges follow
+    // the failure link, and outputs inherit those of the failure state.
+    const int stateCount = ownOutputs.size();
+    QVector<qint32> failure(stateCount, 0);
+    QVector<qint32> order;
+    order.reserve(stateCount);
+    order.append(0);
+
+    QQueue<qint32> queue;
+    for (int cls = 0; cls < m_classCount; ++cls) {
+        qint32 &next = m_transitions[cls];
+        if (next < 0) {
+            next = 0;
+        } else {
+            failure[next] = 0;
+            queue.enqueue(next);
+        }
+    }
+
+    while (!queue.isEmpty()) {
+        const qint32 state = queue.dequeue();
+        order.append(state);
+        for (int cls = 0; cls < m_classCount; ++cls) {
+            const qint32 fallback = m_transitions[failure[state] * m_classCount + cls];
+            qint32 &next = m_transitions[state * m_classCount + cls];
+            if (next < 0) {
+                next = fallback;
+            } else {
+                failure[next] = fallback;
+                queue.enqueue(next);
+            }
+        }
+    }
+
+    // Flatten outputs; BFS order guarantees failure states come first
+    QVector<QVector<qint32>> allOutputs(stateCount);
+    for (qint32 state : order) {
+        allOutputs[state] = ownOutputs[state];
+        if (state != 0) {
+            allOutputs[state] += allOutputs[failure[state]];
+        }
+    }
+
+    m_outputStart.resize(stateCount + 1);
+    for (int state = 0; state < stateCount; ++state) {
+        m_outputStart[state] = m_outputs.size();
+        m_outputs += allOutputs[state];
+    }
+    m_outputStart[stateCount] = m_outputs.size();
+}
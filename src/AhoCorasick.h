@@ -0,0 +1,59 @@
+#pragma once
+
+#include <QByteArray>
+#include <QList>
+#include <QVector>
+
+// Multi-pattern byte matcher. All patterns are compiled into one DFA over a
+// reduced byte alphabet (bytes that never occur in a pattern share a class),
+// so a haystack is scanned once no matter how many patterns there are.
+class AhoCorasick
+{
+public:
+    AhoCorasick();
+
+    // Empty patterns are ignored. Case folding covers ASCII letters only.
+    void build(const QList<QByteArray> &patterns, bool caseInsensitive);
+    void clear();
+
+    bool isEmpty() const;
+    int patternCount() const;
+    int patternLength(int pattern) const;
+
+    // Calls visitor(pattern, endOffset) for every occurrence, in haystack
+    // order. Scanning stops early when the visitor returns false.
+    template<typename Visitor>
+    void scan(const char *data, qsizetype size, Visitor visitor) const;
+
+private:
+    QVector<quint8> m_byteClass;
+    int m_classCount;
+
+    QVector<qint32> m_transitions;   // state * m_classCount + byte class
+    QVector<qint32> m_outputStart;   // per state, index into m_outputs (size states + 1)
+    QVector<qint32> m_outputs;       // pattern ids, including those reached via failure links
+    QVector<int> m_patternLengths;
+};
+
+template<typename Visitor>
+void AhoCorasick::scan(const char *data, qsizetype size, Visitor visitor) const
+{
+    if (m_transitions.isEmpty()) {
+        return;
+    }
+
+    const quint8 *classes = m_byteClass.constData();
+    const qint32 *transitions = m_transitions.constData();
+    const qint32 *outputStart = m_outputStart.constData();
+    const qint32 *outputs = m_outputs.constData();
+
+    qint32 state = 0;
+    for (qsizetype i = 0; i < size; ++i) {
+        state = transitions[state * m_classCount + classes[static_cast<quint8>(data[i])]];
+        for (qint32 out = outputStart[state]; out < outputStart[state + 1]; ++out) {
+            if (!visitor(outputs[out], i + 1)) {
+                return;
+            }
+        }
+    }
+}
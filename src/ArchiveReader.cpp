@@ -0,0 +1,1000 @@
+#include "ArchiveReader.h"
+#include <QBuffer>
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QtEndian>
+#include <cstring>
+#include <limits>
+#include <zlib.h>
+
+#if __has_include(<bzlib.h>)
+#include <bzlib.h>
+#define ARCHIVE_READER_BZIP2
+#endif
+
+namespace {
+
+const QLatin1String SEPARATOR("!/");
+const int BUFFER_SIZE = 64 * 1024;
+const int TAR_BLOCK = 512;
+const qint64 MAX_TAR_METADATA = 1024 * 1024;    // Long names and pax headers
+
+enum Format {
+    Unknown,
+    Zip,
+    Tar,
+    GzipTar,
+    Bzip2Tar
+};
+
+Format formatOf(const QString &name)
+{
+    const QString lower = name.toLower();
+    if (lower.endsWith(".zip") || lower.endsWith(".jar")) {
+        return Zip;
+    }
+    if (lower.endsWith(".tar")) {
+        return Tar;
+    }
+    if (lower.endsWith(".tar.gz") || lower.endsWith(".tgz")) {
+        return GzipTar;
+    }
+    if (lower.endsWith(".tar.bz2") || lower.endsWith(".tbz2") || lower.endsWith(".tbz")) {
+        return Bzip2Tar;
+    }
+    return Unknown;
+}
+
+quint16 le16(const char *data)
+{
+    return qFromLittleEndian<quint16>(data);
+}
+
+quint32 le32(const char *data)
+{
+    return qFromLittleEndian<quint32>(data);
+}
+
+quint64 le64(const char *data)
+{
+    return qFromLittleEndian<quint64>(data);
+}
+
+// Member names are relative; anything escaping the archive is dropped
+QString cleanName(const QString &name)
+{
+    QString cleaned = QDir::cleanPath(name);
+    while (cleaned.startsWith('/')) {
+        cleaned.remove(0, 1);
+    }
+    if (cleaned == "." || cleaned == ".." || cleaned.startsWith("../")) {
+        return QString();
+    }
+    return cleaned;
+}
+
+struct Budget {
+    qint64 remaining;
+    bool exceeded;
+};
+
+// Sequential source of archive bytes. Only streams that were given the
+// budget charge it, so nested streams don't count the same bytes twice.
+class Stream
+{
+public:
+    explicit Stream(Budget *budget)
+        : m_budget(budget)
+    {}
+    virtual ~Stream() = default;
+
+    // Fewer bytes than asked for only at the end of the data; -1 on errors
+    // and once the budget is spent
+    qint64 read(char *data, qint64 size)
+    {
+        if (m_budget && m_budget->exceeded) {
+            return -1;
+        }
+        qint64 total = 0;
+        while (total < size) {
+            const qint64 count = readData(data + total, size - total);
+            if (count < 0) {
+                return -1;
+            }
+            if (count == 0) {
+                break;
+            }
+            total += count;
+        }
+        if (m_budget) {
+            m_budget->remaining -= total;
+            if (m_budget->remaining < 0) {
+                m_budget->exceeded = true;
+                return -1;
+            }
+        }
+        return total;
+    }
+
+    virtual bool skip(qint64 size)
+    {
+        if (size < 0) {
+            return false;
+        }
+        char buffer[16 * 1024];
+        while (size > 0) {
+            const qint64 chunk = qMin(size, qint64(sizeof(buffer)));
+            if (read(buffer, chunk) != chunk) {
+                return false;
+            }
+            size -= chunk;
+        }
+        return true;
+    }
+
+protected:
+    virtual qint64 readData(char *data, qint64 size) = 0;   // 0 at the end
+
+private:
+    Budget *m_budget;
+};
+
+// At most length bytes (all with length < 0) from the device's position.
+// Seekable devices skip without reading.
+class DeviceStream : public Stream
+{
+public:
+    DeviceStream(QIODevice *device, qint64 length, Budget *budget = nullptr)
+        : Stream(budget)
+        , m_device(device)
+        , m_remaining(length)
+    {}
+
+    bool skip(qint64 size) override
+    {
+        // Never backwards, and never past the end
+        if (size < 0) {
+            return false;
+        }
+        if (m_device->isSequential() || (m_remaining >= 0 && size > m_remaining)) {
+            return Stream::skip(size);
+        }
+        const qint64 target = m_device->pos() + size;
+        if (target > m_device->size() || !m_device->seek(target)) {
+            return false;
+        }
+        if (m_remaining >= 0) {
+            m_remaining -= size;
+        }
+        return true;
+    }
+
+protected:
+    qint64 readData(char *data, qint64 size) override
+    {
+        if (m_remaining >= 0) {
+            size = qMin(size, m_remaining);
+        }
+        if (size == 0) {
+            return 0;
+        }
+        const qint64 count = m_device->read(data, size);
+        if (count > 0 && m_remaining >= 0) {
+            m_remaining -= count;
+        }
+        return count;
+    }
+
+private:
+    QIODevice *m_device;
+    qint64 m_remaining;
+};
+
+// Deflate data: raw (zip members) or gzip, whose concatenated members
+// continue the stream
+class InflateStream : public Stream
+{
+public:
+    InflateStream(Stream &source, bool gzip, Budget *budget = nullptr)
+        : Stream(budget)
+        , m_source(source)
+        , m_input(BUFFER_SIZE, Qt::Uninitialized)
+        , m_gzip(gzip)
+        , m_finished(false)
+    {
+        std::memset(&m_stream, 0, sizeof(m_stream));
+        m_valid = inflateInit2(&m_stream, gzip ? MAX_WBITS + 16 : -MAX_WBITS) == Z_OK;
+    }
+
+    ~InflateStream() override
+    {
+        if (m_valid) {
+            inflateEnd(&m_stream);
+        }
+    }
+
+protected:
+    qint64 readData(char *data, qint64 size) override
+    {
+        if (!m_valid) {
+            return -1;
+        }
+        const uInt wanted = uInt(qMin(size, qint64(BUFFER_SIZE)));
+        m_stream.next_out = reinterpret_cast<Bytef *>(data);
+        m_stream.avail_out = wanted;
+        while (m_stream.avail_out == wanted && !m_finished) {
+            if (m_stream.avail_in == 0 && !fill()) {
+                return -1;  // Truncated
+            }
+            const int result = inflate(&m_stream, Z_NO_FLUSH);
+            if (result == Z_STREAM_END) {
+                if (m_gzip && (m_stream.avail_in > 0 || fill())) {
+                    inflateReset(&m_stream);
+                } else {
+                    m_finished = true;
+                }
+            } else if (result != Z_OK) {
+                return -1;
+            }
+        }
+        return qint64(wanted - m_stream.avail_out);
+    }
+
+private:
+    bool fill()
+    {
+        const qint64 count = m_source.read(m_input.data(), m_input.size());
+        if (count <= 0) {
+            return false;
+        }
+        m_stream.next_in = reinterpret_cast<Bytef *>(m_input.data());
+        m_stream.avail_in = uInt(count);
+        return true;
+    }
+
+    Stream &m_source;
+    QByteArray m_input;
+    z_stream m_stream;
+    bool m_gzip;
+    bool m_valid;
+    bool m_finished;
+};
+
+#ifdef ARCHIVE_READER_BZIP2
+
+// bzip2 data; parallel compressors write several streams back to back
+class Bzip2Stream : public Stream
+{
+public:
+    Bzip2Stream(Stream &source, Budget *budget = nullptr)
+        : Stream(budget)
+        , m_source(source)
+        , m_input(BUFFER_SIZE, Qt::Uninitialized)
+        , m_finished(false)
+    {
+        std::memset(&m_stream, 0, sizeof(m_stream));
+        m_valid = BZ2_bzDecompressInit(&m_stream, 0, 0) == BZ_OK;
+    }
+
+    ~Bzip2Stream() override
+    {
+        if (m_valid) {
+            BZ2_bzDecompressEnd(&m_stream);
+        }
+    }
+
+protected:
+    qint64 readData(char *data, qint64 size) override
+    {
+        if (!m_valid) {
+            return -1;
+        }
+        const unsigned wanted = unsigned(qMin(size, qint64(BUFFER_SIZE)));
+        m_stream.next_out = data;
+        m_stream.avail_out = wanted;
+        while (m_stream.avail_out == wanted && !m_finished) {
+            if (m_stream.avail_in == 0 && !fill()) {
+                return -1;
+            }
+            const int result = BZ2_bzDecompress(&m_stream);
+            if (result == BZ_STREAM_END) {
+                if (m_stream.avail_in > 0 || fill()) {
+                    restart();
+                } else {
+                    m_finished = true;
+                }
+            } else if (result != BZ_OK) {
+                return -1;
+            }
+        }
+        return qint64(wanted - m_stream.avail_out);
+    }
+
+private:
+    bool fill()
+    {
+        const qint64 count = m_source.read(m_input.data(), m_input.size());
+        if (count <= 0) {
+            return false;
+        }
+        m_stream.next_in = m_input.data();
+        m_stream.avail_in = unsigned(count);
+        return true;
+    }
+
+    // A new stream starts with the unread input of the last one
+    void restart()
+    {
+        char *nextIn = m_stream.next_in;
+        const unsigned availIn = m_stream.avail_in;
+        char *nextOut = m_stream.next_out;
+        const unsigned availOut = m_stream.avail_out;
+        BZ2_bzDecompressEnd(&m_stream);
+        std::memset(&m_stream, 0, sizeof(m_stream));
+        m_valid = BZ2_bzDecompressInit(&m_stream, 0, 0) == BZ_OK;
+        m_stream.next_in = nextIn;
+        m_stream.avail_in = availIn;
+        m_stream.next_out = nextOut;
+        m_stream.avail_out = availOut;
+    }
+
+    Stream &m_source;
+    QByteArray m_input;
+    bz_stream m_stream;
+    bool m_valid;
+    bool m_finished;
+};
+
+#endif
+
+QByteArray readAt(QIODevice *device, qint64 offset, qint64 size)
+{
+    if (offset < 0 || size < 0 || offset + size > device->size() || !device->seek(offset)) {
+        return QByteArray();
+    }
+    return device->read(size);
+}
+
+QDateTime dosTime(quint16 date, quint16 time)
+{
+    // Local time, as zip tools write it
+    const QDate day(1980 + (date >> 9), (date >> 5) & 0xF, date & 0x1F);
+    const QTime clock(time >> 11, (time >> 5) & 0x3F, (time & 0x1F) * 2);
+    return QDateTime(day, clock);
+}
+
+// Octal, or base-256 when the high bit of the first byte is set (GNU).
+// -1 for negative base-256 numbers and for ones too large for a qint64.
+qint64 tarNumber(const char *field, int length)
+{
+    qint64 value = 0;
+    if (field[0] & 0x80) {
+        if (field[0] & 0x40) {
+            return -1;
+        }
+        value = field[0] & 0x3F;
+        for (int i = 1; i < length; ++i) {
+            if (value > (std::numeric_limits<qint64>::max() >> 8)) {
+                return -1;
+            }
+            value = (value << 8) | quint8(field[i]);
+        }
+        return value;
+    }
+    int i = 0;
+    while (i < length && (field[i] == ' ' || field[i] == '\0')) {
+        ++i;
+    }
+    for (; i < length && field[i] >= '0' && field[i] <= '7'; ++i) {
+        value = (value << 3) | (field[i] - '0');
+    }
+    return value;
+}
+
+QString tarString(const char *field, int length)
+{
+    return QString::fromUtf8(field, int(qstrnlen(field, uint(length))));
+}
+
+bool isZeroBlock(const char *block)
+{
+    for (int i = 0; i < TAR_BLOCK; ++i) {
+        if (block[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The checksum field counts as spaces. Old tars summed signed bytes.
+bool checksumMatches(const char *header)
+{
+    const qint64 stored = tarNumber(header + 148, 8);
+    qint64 unsignedSum = 0;
+    qint64 signedSum = 0;
+    for (int i = 0; i < TAR_BLOCK; ++i) {
+        const bool field = i >= 148 && i < 156;
+        unsignedSum += field ? ' ' : quint8(header[i]);
+        signedSum += field ? ' ' : qint8(header[i]);
+    }
+    return stored == unsignedSum || stored == signedSum;
+}
+
+// Records of "<length> <key>=<value>\n". False if the size is no
+// non-negative number.
+bool parsePax(const QByteArray &data, QString &path, qint64 &size)
+{
+    qsizetype position = 0;
+    while (position < data.size()) {
+        const qsizetype space = data.indexOf(' ', position);
+        if (space < 0) {
+            return true;
+        }
+        bool ok = false;
+        const qsizetype length = data.mid(position, space - position).toLongLong(&ok);
+        if (!ok || length <= space - position || position + length > data.size()) {
+            return true;
+        }
+        const QByteArray record = data.mid(space + 1, position + length - space - 2);
+        const qsizetype equals = record.indexOf('=');
+        if (equals > 0) {
+            const QByteArray key = record.left(equals);
+            if (key == "path") {
+                path = QString::fromUtf8(record.mid(equals + 1));
+            } else if (key == "size") {
+                size = record.mid(equals + 1).toLongLong(&ok);
+                if (!ok || size < 0) {
+                    return false;
+                }
+            }
+        }
+        position += length;
+    }
+    return true;
+}
+
+// Hands size bytes of stream to sink; a sink that stops early is no error
+bool copy(Stream &stream, qint64 size, const ArchiveReader::ChunkSink &sink, qint64 *consumed)
+{
+    QByteArray buffer(qMin(size, qint64(BUFFER_SIZE)), Qt::Uninitialized);
+    qint64 done = 0;
+    while (done < size) {
+        const qint64 chunk = qMin(size - done, qint64(buffer.size()));
+        if (stream.read(buffer.data(), chunk) != chunk) {
+            return false;
+        }
+        done += chunk;
+        *consumed = done;
+        if (!sink(buffer.constData(), chunk)) {
+            break;
+        }
+    }
+    return true;
+}
+
+// Reads the current member into a sink, unless it is larger than maxSize
+typedef std::function<bool(qint64 maxSize, const ArchiveReader::ChunkSink &sink)> RawReader;
+
+class Walker
+{
+public:
+    // With a target, only the archives on the way to it are opened; with a
+    // sink as well, the target's data goes there
+    Walker(const ArchiveReader::Visitor &visitor, const ArchiveReader::Limits &limits, const QString &target,
+           const ArchiveReader::ChunkSink *sink = nullptr)
+        : m_visitor(visitor)
+        , m_limits(limits)
+        , m_target(target)
+        , m_sink(sink)
+        , m_budget{limits.maxTotalBytes, false}
+        , m_truncated(false)
+        , m_stopped(false)
+        , m_found(false)
+        , m_readers(nullptr)
+    {}
+
+    // Instead of visiting zip members, keeps a reader for each; they stay
+    // usable as long as the walker and the device do
+    void collect(QList<QPair<QString, RawReader>> *readers)
+    {
+        m_readers = readers;
+    }
+
+    bool list(QIODevice *device, const QString &prefix, Format format, int depth)
+    {
+        switch (format) {
+        case Zip:
+            return listZip(device, prefix, depth);
+        case Tar: {
+            DeviceStream stream(device, -1, &m_budget);
+            return listTar(stream, prefix, depth);
+        }
+        case GzipTar: {
+            DeviceStream compressed(device, -1);
+            InflateStream stream(compressed, true, &m_budget);
+            return listTar(stream, prefix, depth);
+        }
+        case Bzip2Tar: {
+#ifdef ARCHIVE_READER_BZIP2
+            DeviceStream compressed(device, -1);
+            Bzip2Stream stream(compressed, &m_budget);
+            return listTar(stream, prefix, depth);
+#else
+            return false;
+#endif
+        }
+        default:
+            return false;
+        }
+    }
+
+    bool complete() const
+    {
+        return !m_truncated && !m_budget.exceeded;
+    }
+
+    bool found() const
+    {
+        return m_found;
+    }
+
+private:
+    bool listZip(QIODevice *device, const QString &prefix, int depth)
+    {
+        // The end of central directory record is followed by a comment of
+        // at most 64 KiB
+        const qint64 fileSize = device->size();
+        const qint64 tailSize = qMin(fileSize, qint64(0xFFFF + 22));
+        const QByteArray tail = readAt(device, fileSize - tailSize, tailSize);
+        int end = -1;
+        for (int i = int(tail.size()) - 22; i >= 0; --i) {
+            if (le32(tail.constData() + i) == 0x06054b50) {
+                end = i;
+                break;
+            }
+        }
+        if (end < 0) {
+            return false;
+        }
+        const char *record = tail.constData() + end;
+        quint64 entries = le16(record + 10);
+        quint64 directorySize = le32(record + 12);
+        quint64 directoryOffset = le32(record + 16);
+
+        // Zip64 archives keep the real values in a record the locator,
+        // just before, points to
+        if (entries == 0xFFFF || directorySize == 0xFFFFFFFF || directoryOffset == 0xFFFFFFFF) {
+            const QByteArray locator = readAt(device, fileSize - tailSize + end - 20, 20);
+            if (locator.size() != 20 || le32(locator.constData()) != 0x07064b50) {
+                return false;
+            }
+            const QByteArray zip64 = readAt(device, qint64(le64(locator.constData() + 8)), 56);
+            if (zip64.size() != 56 || le32(zip64.constData()) != 0x06064b50) {
+                return false;
+            }
+            entries = le64(zip64.constData() + 32);
+            directorySize = le64(zip64.constData() + 40);
+            directoryOffset = le64(zip64.constData() + 48);
+        }
+        if (directoryOffset + directorySize > quint64(fileSize) || !spend(qint64(directorySize))) {
+            return false;
+        }
+
+        const QByteArray directory = readAt(device, qint64(directoryOffset), qint64(directorySize));
+        qsizetype position = 0;
+        for (quint64 index = 0; index < entries && !m_stopped; ++index) {
+            if (index >= quint64(m_limits.maxMembers)) {
+                m_truncated = true;
+                return false;
+            }
+            const char *entry = directory.constData() + position;
+            if (position + 46 > directory.size() || le32(entry) != 0x02014b50) {
+                return false;
+            }
+            const quint16 flags = le16(entry + 8);
+            const quint16 method = le16(entry + 10);
+            quint64 compressedSize = le32(entry + 20);
+            quint64 size = le32(entry + 24);
+            const int nameLength = le16(entry + 28);
+            const int extraLength = le16(entry + 30);
+            const int commentLength = le16(entry + 32);
+            quint64 localOffset = le32(entry + 42);
+            if (position + 46 + nameLength + extraLength + commentLength > directory.size()) {
+                return false;
+            }
+
+            // Names are UTF-8 when flagged, code page 437 otherwise, which
+            // Latin-1 gets right for ASCII
+            const char *rawName = entry + 46;
+            const QString name = (flags & 0x800) ? QString::fromUtf8(rawName, nameLength)
+                                                 : QString::fromLatin1(rawName, nameLength);
+            QDateTime modified = dosTime(le16(entry + 14), le16(entry + 12));
+
+            // Zip64 sizes and offset, and the Unix mtime
+            const char *extra = rawName + nameLength;
+            for (int i = 0; i + 4 <= extraLength;) {
+                const quint16 id = le16(extra + i);
+                const int length = le16(extra + i + 2);
+                const char *field = extra + i + 4;
+                if (i + 4 + length > extraLength) {
+                    break;
+                }
+                if (id == 0x0001) {
+                    int offset = 0;
+                    if (size == 0xFFFFFFFF && offset + 8 <= length) {
+                        size = le64(field + offset);
+                        offset += 8;
+                    }
+                    if (compressedSize == 0xFFFFFFFF && offset + 8 <= length) {
+                        compressedSize = le64(field + offset);
+                        offset += 8;
+                    }
+                    if (localOffset == 0xFFFFFFFF && offset + 8 <= length) {
+                        localOffset = le64(field + offset);
+                    }
+                } else if (id == 0x5455 && length >= 5 && (field[0] & 1)) {
+                    modified = QDateTime::fromSecsSinceEpoch(qint32(le32(field + 1)));
+                }
+                i += 4 + length;
+            }
+            position += 46 + nameLength + extraLength + commentLength;
+
+            const QString cleaned = cleanName(name);
+            if (cleaned.isEmpty()) {
+                continue;
+            }
+
+            const ArchiveReader::Member member{prefix + cleaned, qint64(size), modified, name.endsWith('/')};
+            visit(member, [this, device, localOffset, method, flags, compressedSize, size](qint64 maxSize,
+                          const ArchiveReader::ChunkSink &sink) {
+                return readZipMember(device, localOffset, method, flags, compressedSize, size, maxSize, sink);
+            }, depth);
+        }
+        return true;
+    }
+
+    bool readZipMember(QIODevice *device, quint64 localOffset, quint16 method, quint16 flags,
+                       quint64 compressedSize, quint64 size, qint64 maxSize, const ArchiveReader::ChunkSink &sink)
+    {
+        // Encrypted members can't be read, and sizes or offsets past the
+        // archive come from a corrupt directory
+        const quint64 archiveSize = quint64(device->size());
+        if ((flags & 0x1) || size > quint64(maxSize) || localOffset >= archiveSize
+            || compressedSize > archiveSize - localOffset) {
+            return false;
+        }
+        const QByteArray header = readAt(device, qint64(localOffset), 30);
+        if (header.size() != 30 || le32(header.constData()) != 0x04034b50) {
+            return false;
+        }
+        const qint64 dataOffset = qint64(localOffset) + 30 + le16(header.constData() + 26)
+            + le16(header.constData() + 28);
+        if (!device->seek(dataOffset)) {
+            return false;
+        }
+
+        qint64 consumed = 0;
+        if (method == 0) {
+            DeviceStream stream(device, qint64(compressedSize), &m_budget);
+            return copy(stream, qint64(size), sink, &consumed);
+        }
+        if (method == 8) {
+            DeviceStream compressed(device, qint64(compressedSize));
+            InflateStream stream(compressed, false, &m_budget);
+            return copy(stream, qint64(size), sink, &consumed);
+        }
+        return false;
+    }
+
+    bool listTar(Stream &stream, const QString &prefix, int depth)
+    {
+        char header[TAR_BLOCK];
+        QString longName;
+        QString paxPath;
+        qint64 paxSize = -1;
+        int count = 0;
+        while (!m_stopped) {
+            // Some writers leave out the closing zero blocks
+            const qint64 headerSize = stream.read(header, TAR_BLOCK);
+            if (headerSize == 0) {
+                return true;
+            }
+            if (headerSize != TAR_BLOCK || !checksumMatches(header)) {
+                return isZeroBlock(header) && headerSize == TAR_BLOCK;
+            }
+
+            const char type = header[156];
+            qint64 size = tarNumber(header + 124, 12);
+            if (size < 0) {
+                return false;
+            }
+
+            // GNU long names and pax headers describe the next member
+            if (type == 'L' || type == 'x' || type == 'g') {
+                const qint64 padded = (size + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+                if (size > MAX_TAR_METADATA) {
+                    return false;
+                }
+                QByteArray metadata(padded, Qt::Uninitialized);
+                if (stream.read(metadata.data(), padded) != padded) {
+                    return false;
+                }
+                metadata.truncate(size);
+                if (type == 'L') {
+                    longName = QString::fromUtf8(metadata.constData(), int(qstrnlen(metadata.constData(), uint(size))));
+                } else if (type == 'x' && !parsePax(metadata, paxPath, paxSize)) {
+                    return false;
+                }
+                continue;
+            }
+
+            QString name = tarString(header, 100);
+            if (std::memcmp(header + 257, "ustar\0", 6) == 0 && header[345]) {
+                name = tarString(header + 345, 155) + '/' + name;
+            }
+            if (!longName.isEmpty()) {
+                name = longName;
+            }
+            if (!paxPath.isEmpty()) {
+                name = paxPath;
+            }
+            if (paxSize >= 0) {
+                size = paxSize;
+            }
+            longName.clear();
+            paxPath.clear();
+            paxSize = -1;
+            if (size > std::numeric_limits<qint64>::max() - TAR_BLOCK) {
+                return false;
+            }
+            const qint64 padded = (size + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+
+            // Links, devices and FIFOs are not listed
+            qint64 consumed = 0;
+            const bool file = type == '0' || type == '\0' || type == '7';
+            const bool directory = type == '5';
+            const QString cleaned = cleanName(name);
+            if ((file || directory) && !cleaned.isEmpty()) {
+                if (++count > m_limits.maxMembers) {
+                    m_truncated = true;
+                    return false;
+                }
+                const QDateTime modified = QDateTime::fromSecsSinceEpoch(tarNumber(header + 136, 12));
+                const ArchiveReader::Member member{prefix + cleaned, directory ? 0 : size, modified, directory};
+                visit(member, [&](qint64 maxSize, const ArchiveReader::ChunkSink &sink) {
+                    if (consumed > 0 || size > maxSize) {
+                        return false;
+                    }
+                    return copy(stream, size, sink, &consumed);
+                }, depth);
+            }
+            if (!stream.skip(padded - consumed)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void visit(const ArchiveReader::Member &member, const RawReader &read, int depth)
+    {
+        if (m_readers) {
+            if (!member.directory) {
+                m_readers->append(qMakePair(member.path, read));
+            }
+            return;
+        }
+        if (m_sink && member.path == m_target) {
+            m_found = !member.directory && read(std::numeric_limits<qint64>::max(), *m_sink);
+            m_stopped = true;
+            return;
+        }
+
+        // Content is read once, whether the visitor or nesting asks first
+        QByteArray content;
+        bool haveContent = false;
+        auto contentUpTo = [&](QByteArray &data, qint64 maxSize) {
+            if (!haveContent && !member.directory) {
+                haveContent = read(maxSize, [&](const char *chunk, qint64 size) {
+                    content.append(chunk, qsizetype(size));
+                    return true;
+                });
+                if (!haveContent) {
+                    content.clear();
+                }
+            }
+            if (!haveContent || content.size() > maxSize) {
+                return false;
+            }
+            data = content;
+            return true;
+        };
+
+        const qint64 maxContentSize = m_limits.maxContentSize;
+        if (!m_visitor(member, [&](QByteArray &data) { return contentUpTo(data, maxContentSize); })) {
+            m_stopped = true;
+            return;
+        }
+
+        const Format format = member.directory ? Unknown : formatOf(member.path);
+        const QString prefix = member.path + SEPARATOR;
+        if (format == Unknown || depth >= m_limits.maxDepth || member.size > m_limits.maxNestedSize
+            || (!m_target.isEmpty() && !m_target.startsWith(prefix))) {
+            return;
+        }
+        QByteArray nested;
+        if (!contentUpTo(nested, m_limits.maxNestedSize)) {
+            return;
+        }
+        QBuffer buffer(&nested);
+        buffer.open(QIODevice::ReadOnly);
+        list(&buffer, prefix, format, depth + 1);
+    }
+
+    bool spend(qint64 bytes)
+    {
+        m_budget.remaining -= bytes;
+        m_budget.exceeded = m_budget.exceeded || m_budget.remaining < 0;
+        return !m_budget.exceeded;
+    }
+
+    const ArchiveReader::Visitor &m_visitor;
+    const ArchiveReader::Limits &m_limits;
+    QString m_target;
+    const ArchiveReader::ChunkSink *m_sink;
+    Budget m_budget;
+    bool m_truncated;
+    bool m_stopped;
+    bool m_found;
+    QList<QPair<QString, RawReader>> *m_readers;
+};
+
+}
+
+bool ArchiveReader::isArchive(const QString &fileName)
+{
+    return formatOf(fileName) != Unknown;
+}
+
+bool ArchiveReader::isVirtualPath(const QString &path)
+{
+    return archivePath(path).size() < path.size();
+}
+
+QString ArchiveReader::virtualPath(const QString &archive, const QString &member)
+{
+    return archive + SEPARATOR + member;
+}
+
+QString ArchiveReader::archivePath(const QString &path)
+{
+    // The first separator that follows an archive name; a directory may
+    // end in "!" too
+    qsizetype separator = path.indexOf(SEPARATOR);
+    while (separator > 0) {
+        const QString candidate = path.left(separator);
+        if (isArchive(candidate)) {
+            return candidate;
+        }
+        separator = path.indexOf(SEPARATOR, separator + 1);
+    }
+    return path;
+}
+
+bool ArchiveReader::forEachMember(const QString &archive, const Visitor &visitor, const Limits &limits)
+{
+    QFile file(archive);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    Walker walker(visitor, limits, QString());
+    return walker.list(&file, archive + SEPARATOR, formatOf(archive), 0) && walker.complete();
+}
+
+bool ArchiveReader::readMember(const QString &path, QByteArray &data, const Limits &limits)
+{
+    const QString archive = archivePath(path);
+    if (archive == path) {
+        return false;
+    }
+    QFile file(archive);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    bool found = false;
+    const Visitor visitor = [&](const Member &member, const ContentReader &content) {
+        if (member.path != path) {
+            return true;
+        }
+        found = !member.directory && content(data);
+        return false;
+    };
+    Walker walker(visitor, limits, path);
+    walker.list(&file, archive + SEPARATOR, formatOf(archive), 0);
+    return found;
+}
+
+bool ArchiveReader::streamMember(const QString &path, const ChunkSink &sink, const Limits &limits)
+{
+    const QString archive = archivePath(path);
+    if (archive == path) {
+        return false;
+    }
+    QFile file(archive);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const Visitor visitor = [](const Member &, const ContentReader &) {
+        return true;
+    };
+    Walker walker(visitor, limits, path, &sink);
+    walker.list(&file, archive + SEPARATOR, formatOf(archive), 0);
+    return walker.found();
+}
+
+QStringList ArchiveReader::zipMembers(const QString &file, const Limits &limits)
+{
+    QStringList members;
+    QFile device(file);
+    if (!device.open(QIODevice::ReadOnly)) {
+        return members;
+    }
+
+    const QString prefix = file + SEPARATOR;
+    const Visitor visitor = [&](const Member &member, const ContentReader &) {
+        if (!member.directory) {
+            members.append(member.path.mid(prefix.size()));
+        }
+        return true;
+    };
+    Limits flat = limits;
+    flat.maxDepth = 0;
+    Walker walker(visitor, flat, QString());
+    walker.list(&device, prefix, Zip, 0);
+    return members;
+}
+
+bool ArchiveReader::streamZipMembers(const QString &file, const MemberPicker &pick, const MemberVisitor &visitor,
+                                     const Limits &limits)
+{
+    QFile device(file);
+    if (!device.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const Visitor ignore = [](const Member &, const ContentReader &) {
+        return true;
+    };
+    Limits flat = limits;
+    flat.maxDepth = 0;
+    Walker walker(ignore, flat, QString());
+    QList<QPair<QString, RawReader>> readers;
+    walker.collect(&readers);
+    const QString prefix = file + SEPARATOR;
+    if (!walker.list(&device, prefix, Zip, 0)) {
+        return false;
+    }
+
+    QStringList members;
+    QHash<QString, RawReader> byName;
+    for (const auto &reader : readers) {
+        const QString name = reader.first.mid(prefix.size());
+        members.append(name);
+        byName.insert(name, reader.second);
+    }
+    for (const QString &member : pick(members)) {
+        const RawReader read = byName.value(member);
+        if (!read) {
+            continue;
+        }
+        const MemberStream stream = [&](const ChunkSink &sink) {
+            return read(std::numeric_limits<qint64>::max(), sink);
+        };
+        if (!visitor(member, stream)) {
+            break;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <QString>
+#include <QByteArray>
+#include <QStringList>
+#include <QDateTime>
+#include <functional>
+
+// Lists zip and tar archives without extracting them. Zip archives are read
+// from their central directory; tar archives, plain or compressed with gzip
+// or bzip2, are streamed header by header, and member data is only
+// decompressed when asked for or when the stream has to get past it.
+//
+// Members are named by virtual paths: the archive's path, "!/" and the
+// member's name inside it, e.g.
+//
+//     /home/me/release.tar.gz!/src/main.cpp
+//     /home/me/bundle.zip!/docs.zip!/index.html
+//
+// Archives inside archives are opened up to Limits::maxDepth levels deep.
+// Everything read counts against a budget of decompressed bytes per
+// outermost archive, so a huge or hostile archive costs at most that much.
+class ArchiveReader
+{
+public:
+    struct Member {
+        QString path;           // Virtual path
+        qint64 size;            // Uncompressed
+        QDateTime modified;
+        bool directory;
+    };
+
+    struct Limits {
+        int maxDepth;           // Levels of nested archives opened
+        int maxMembers;         // Per archive
+        qint64 maxNestedSize;   // Largest nested archive; it is read into memory
+        qint64 maxContentSize;  // Largest member content handed out
+        qint64 maxTotalBytes;   // Bytes read per outermost archive
+
+        Limits()
+            : maxDepth(2)
+            , maxMembers(100000)
+            , maxNestedSize(64 * 1024 * 1024)
+            , maxContentSize(8 * 1024 * 1024)
+            , maxTotalBytes(256 * 1024 * 1024)
+        {}
+    };
+
+    // Reads the current member's data. False if it can't be had within the
+    // limits, or is encrypted or compressed in an unsupported way.
+    typedef std::function<bool(QByteArray &data)> ContentReader;
+
+    // Called for every member in archive order; content is only valid
+    // during the call. Returning false ends the listing.
+    typedef std::function<bool(const Member &member, const ContentReader &content)> Visitor;
+
+    // Receives member data piece by piece; returning false stops reading
+    typedef std::function<bool(const char *data, qint64 size)> ChunkSink;
+
+    // For streamZipMembers(): picks the members to read, in reading order,
+    // from all the names; then reads each of them into a sink, returning
+    // false if it can't be read to its end
+    typedef std::function<QStringList(const QStringList &members)> MemberPicker;
+    typedef std::function<bool(const ChunkSink &sink)> MemberStream;
+    typedef std::function<bool(const QString &member, const MemberStream &stream)> MemberVisitor;
+
+    // By name: .zip, .jar, .tar, .tar.gz, .tgz, .tar.bz2, .tbz2
+    static bool isArchive(const QString &fileName);
+
+    static bool isVirtualPath(const QString &path);
+    static QString virtualPath(const QString &archive, const QString &member);
+    // The file on disk a virtual path lies in; path itself for other paths
+    static QString archivePath(const QString &path);
+
+    // False if archive can't be read as one, or the limits cut the listing
+    // short. Members already visited stand either way.
+    static bool forEachMember(const QString &archive, const Visitor &visitor, const Limits &limits = Limits());
+
+    // Content of the member at a virtual path; only the archives on the
+    // way to it are opened
+    static bool readMember(const QString &path, QByteArray &data, const Limits &limits = Limits());
+
+    // The same without holding the member in memory: only the byte budget
+    // applies, not maxContentSize
+    static bool streamMember(const QString &path, const ChunkSink &sink, const Limits &limits = Limits());
+
+    // Zip files under names of their own, such as office documents, are no
+    // archives to isArchive() and archivePath(); these read them as zip
+    // files all the same. Members are named as inside the file, and
+    // archives among them aren't opened.
+    static QStringList zipMembers(const QString &file, const Limits &limits = Limits());
+
+    // Several members from one reading of the zip's directory: the picked
+    // members that exist are handed to visitor in the picked order, and
+    // returning false from it stops. The byte budget spans them all.
+    // False if file can't be read as a zip.
+    static bool streamZipMembers(const QString &file, const MemberPicker &pick, const MemberVisitor &visitor,
+                                 const Limits &limits = Limits());
+};
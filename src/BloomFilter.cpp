@@ -0,0 +1,68 @@
+#include "BloomFilter.h"
+
+BloomFilter::BloomFilter(int bits, int hashes)
+    : m_mask(0)
+    , m_hashes(qMax(1, hashes))
+{
+    quint32 size = 64;
+    while (size < quint32(bits) && size < (1u << 30)) {
+        size <<= 1;
+    }
+    m_mask = size - 1;
+    m_words.fill(0, int(size / 64));
+}
+
+void BloomFilter::add(quint64 key)
+{
+    const quint32 h1 = quint32(key);
+    const quint32 h2 = quint32(key >> 32) | 1;
+    for (int i = 0; i < m_hashes; ++i) {
+        const quint32 bit = (h1 + quint32(i) * h2) & m_mask;
+        m_words[bit >> 6] |= quint64(1) << (bit & 63);
+    }
+}
+
+bool BloomFilter::mayContain(quint64 key) const
+{
+    const quint32 h1 = quint32(key);
+    const quint32 h2 = quint32(key >> 32) | 1;
+    for (int i = 0; i < m_hashes; ++i) {
+        const quint32 bit = (h1 + quint32(i) * h2) & m_mask;
+        if (!(m_words.at(bit >> 6) & (quint64(1) << (bit & 63)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BloomFilter::mayContainAll(const QVector<quint64> &keys) const
+{
+    for (quint64 key : keys) {
+        if (!mayContain(key)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void BloomFilter::clear()
+{
+    m_words.fill(0);
+}
+
+quint64 BloomFilter::hash(QStringView text)
+{
+    // FNV-1a over the UTF-16 units, then a 64-bit finalizer so that both
+    // halves used by the probes are well mixed
+    quint64 h = 0xcbf29ce484222325ull;
+    for (QChar c : text) {
+        h ^= c.unicode();
+        h *= 0x100000001b3ull;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
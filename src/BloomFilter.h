@@ -0,0 +1,31 @@
+#pragma once
+
+#include <QVector>
+#include <QStringView>
+
+// Fixed-size Bloom filter over 64-bit keys. Callers hash their keys once
+// with hash(); the probe positions are derived from that by double hashing.
+// A filter that has seen many more keys than it has bits saturates and
+// simply answers "maybe" for everything.
+//
+// Not thread safe; the owner serializes access.
+class BloomFilter
+{
+public:
+    explicit BloomFilter(int bits = DEFAULT_BITS, int hashes = DEFAULT_HASHES);
+
+    void add(quint64 key);
+    bool mayContain(quint64 key) const;
+    bool mayContainAll(const QVector<quint64> &keys) const;
+    void clear();
+
+    static quint64 hash(QStringView text);
+
+    static const int DEFAULT_BITS = 1024;
+    static const int DEFAULT_HASHES = 3;
+
+private:
+    QVector<quint64> m_words;
+    quint32 m_mask;             // Bit count - 1; the bit count is a power of two
+    int m_hashes;
+};
@@ -0,0 +1,809 @@
+#include "ContentIndex.h"
+#include "ContentMatcher.h"
+#include "ProximityQuery.h"
+#include "SortedIntersection.h"
+#include "IdentifierTokenizer.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDataStream>
+#include <algorithm>
+
+namespace {
+
+const quint32 MAGIC = 0x43494458; // "CIDX"
+const int SNIFF_SIZE = 8192;
+
+quint32 readVarint(const uchar *&p, const uchar *end)
+{
+    quint32 value = 0;
+    int shift = 0;
+    while (p < end) {
+        const uchar byte = *p++;
+        value |= quint32(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            break;
+        }
+        shift += 7;
+    }
+    return value;
+}
+
+// Calls visit(document, positions, length) for every entry of a posting
+// list, with the positions still encoded
+template<typename Visitor>
+void forEachEntry(const QByteArray &data, quint32 count, Visitor visit)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(data.constData());
+    const uchar *end = p + data.size();
+    quint32 document = 0;
+    for (quint32 i = 0; i < count && p < end; ++i) {
+        const quint32 delta = readVarint(p, end);
+        const int length = int(qMin<qint64>(readVarint(p, end), end - p));
+        document = i == 0 ? delta : document + delta;
+        visit(document, p, length);
+        p += length;
+    }
+}
+
+}
+
+ContentIndex::ContentIndex()
+    : m_deadDocuments(0)
+    , m_maxFileSize(DEFAULT_MAX_FILE_SIZE)
+{
+}
+
+void ContentIndex::setStopWords(const QSet<QString> &stopWords)
+{
+    m_stopWords.clear();
+    for (const QString &word : stopWords) {
+        m_stopWords.insert(word.toCaseFolded());
+    }
+}
+
+void ContentIndex::setMaxFileSize(qint64 bytes)
+{
+    m_maxFileSize = bytes;
+}
+
+qint64 ContentIndex::maxFileSize() const
+{
+    return m_maxFileSize;
+}
+
+void ContentIndex::setBasePath(const QString &path)
+{
+    m_basePath = path;
+}
+
+QString ContentIndex::basePath() const
+{
+    return m_basePath;
+}
+
+QStringList ContentIndex::tokenize(QStringView text)
+{
+    QStringList words;
+    ProximityQuery::forEachWord(text, [&](qsizetype start, qsizetype length) {
+        words.append(text.sliced(start, length).toString().toCaseFolded());
+    });
+    return words;
+}
+
+bool ContentIndex::isCurrent(const QString &path, qint64 size, qint64 modified) const
+{
+    auto id = m_documentIds.constFind(path);
+    if (id == m_documentIds.constEnd()) {
+        return false;
+    }
+    const DocumentInfo &info = m_documents.at(id.value());
+    return info.size == size && info.modified == modified;
+}
+
+quint64 ContentIndex::contentHash(const QString &path) const
+{
+    auto id = m_documentIds.constFind(path);
+    return id == m_documentIds.constEnd() ? 0 : m_documents.at(id.value()).contentHash;
+}
+
+ContentIndex::Document ContentIndex::prepare(const QString &path, quint64 previousHash) const
+{
+    Document document;
+    document.path = path;
+    document.size = 0;
+    document.modified = 0;
+    document.contentHash = 0;
+    document.readable = false;
+    document.binary = false;
+    document.oversized = false;
+    document.unchanged = false;
+
+    const QFileInfo info(path);
+    if (!info.isFile()) {
+        return document;
+    }
+    document.size = info.size();
+    document.modified = info.lastModified().toMSecsSinceEpoch();
+
+    // Files above the cap stay searchable, they are just always read
+    if (m_maxFileSize > 0 && document.size > m_maxFileSize) {
+        document.readable = true;
+        document.oversized = true;
+        return document;
+    }
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return document;
+    }
+    const QByteArray data = file.readAll();
+    document.readable = true;
+    analyze(document, data, previousHash);
+    return document;
+}
+
+ContentIndex::Document ContentIndex::prepare(const QString &path, const QByteArray &data, qint64 modified,
+                                             quint64 previousHash) const
+{
+    Document document;
+    document.path = path;
+    document.size = data.size();
+    document.modified = modified;
+    document.contentHash = 0;
+    document.readable = true;
+    document.binary = false;
+    document.oversized = m_maxFileSize > 0 && document.size > m_maxFileSize;
+    document.unchanged = false;
+
+    if (!document.oversized) {
+        analyze(document, data, previousHash);
+    }
+    return document;
+}
+
+void ContentIndex::analyze(Document &document, const QByteArray &data, quint64 previousHash) const
+{
+    if (ContentMatcher::looksBinary(data.left(SNIFF_SIZE))) {
+        document.binary = true;
+        return;
+    }
+
+    // A touched but unchanged file keeps its postings
+    document.contentHash = quint64(qHashBits(data.constData(), size_t(data.size()), 0)) | 1;
+    if (document.contentHash == previousHash) {
+        document.unchanged = true;
+        return;
+    }
+
+    // Every word counts towards the positions, stop words included. The
+    // subwords of identifiers are postings without positions of their own.
+    quint32 position = 0;
+    QSet<QString> seen;
+    const QString text = ContentMatcher::decodeText(data);
+    ProximityQuery::forEachWord(text, [&](qsizetype start, qsizetype length) {
+        const QStringView word = QStringView(text).sliced(start, length);
+        const QString folded = word.toString().toCaseFolded();
+        document.positions[folded].append(position++);
+        if (seen.contains(folded)) {
+            return;
+        }
+        seen.insert(folded);
+        IdentifierTokenizer::forEachSubword(word, [&](qsizetype subStart, qsizetype subLength) {
+            const QString subword = word.sliced(subStart, subLength).toString().toCaseFolded();
+            if (subLength < length && !document.positions.contains(subword)) {
+                document.positions.insert(subword, QVector<quint32>());
+            }
+        });
+    });
+}
+
+void ContentIndex::add(const Document &document)
+{
+    if (!document.readable) {
+        retire(document.path);
+        return;
+    }
+
+    auto existing = m_documentIds.constFind(document.path);
+    if (document.unchanged && existing != m_documentIds.constEnd()) {
+        DocumentInfo &info = m_documents[existing.value()];
+        info.size = document.size;
+        info.modified = document.modified;
+        return;
+    }
+
+    retire(document.path);
+
+    // Binary files are remembered, so they aren't read again, but get no
+    // postings
+    const quint32 id = quint32(m_documents.size());
+    m_documents.append({document.path, document.size, document.modified, document.contentHash,
+                        true, document.oversized});
+    m_documentIds.insert(document.path, id);
+    if (document.oversized) {
+        m_oversized.append(id);
+    } else if (!document.binary) {
+        for (auto it = document.positions.constBegin(); it != document.positions.constEnd(); ++it) {
+            appendPosting(it.key(), id, it.value());
+        }
+    }
+
+    if (m_deadDocuments > 1024 && m_deadDocuments > m_documents.size() / 2) {
+        compact();
+    }
+}
+
+void ContentIndex::remove(const QString &path)
+{
+    retire(path);
+}
+
+void ContentIndex::removeUnder(const QString &directory)
+{
+    const QString prefix = directory.endsWith('/') ? directory : directory + '/';
+    QStringList paths;
+    for (auto it = m_documentIds.constBegin(); it != m_documentIds.constEnd(); ++it) {
+        if (it.key().startsWith(prefix)) {
+            paths.append(it.key());
+        }
+    }
+    for (const QString &path : paths) {
+        retire(path);
+    }
+}
+
+void ContentIndex::clear()
+{
+    m_documents.clear();
+    m_documentIds.clear();
+    m_postings.clear();
+    m_termTrigrams.clear();
+    m_oversized.clear();
+    m_deadDocuments = 0;
+}
+
+int ContentIndex::documentCount() const
+{
+    return m_documentIds.size();
+}
+
+int ContentIndex::termCount() const
+{
+    return m_postings.size();
+}
+
+QStringList ContentIndex::paths() const
+{
+    return m_documentIds.keys();
+}
+
+bool ContentIndex::candidates(const QString &text, QStringList &paths) const
+{
+    const ProximityQuery query = ProximityQuery::parse(text);
+    if (query.isValid()) {
+        return proximityCandidates(query, paths);
+    }
+
+    // Every word narrows the set; words at the ends of the text may be cut
+    // out of longer words in the file
+    QList<QueryWord> words;
+    ProximityQuery::forEachWord(text, [&](qsizetype start, qsizetype length) {
+        const bool atStart = start == 0;
+        const bool atEnd = start + length == text.size();
+        const MatchMode mode = atStart && atEnd ? TermInfix
+                             : atStart ? TermSuffix
+                             : atEnd ? TermPrefix
+                             : ExactTerm;
+        words.append({QStringView(text).sliced(start, length).toString().toCaseFolded(), mode});
+    });
+    QVector<quint32> documents;
+    if (!documentsWithAll(words, documents)) {
+        return false;
+    }
+
+    // The same text as a run of subwords may match inside identifiers, as
+    // "search engine" does in SearchEngine
+    const QStringList subwords = IdentifierTokenizer::subwords(text);
+    if (subwords.size() > 1) {
+        QList<QueryWord> run;
+        for (int i = 0; i < subwords.size(); ++i) {
+            const bool first = i == 0;
+            const bool last = i == subwords.size() - 1;
+            run.append({subwords.at(i), first ? TermSuffix : last ? TermPrefix : ExactTerm});
+        }
+        bool same = run.size() == words.size();
+        for (int i = 0; same && i < run.size(); ++i) {
+            same = run.at(i).word == words.at(i).word && run.at(i).mode == words.at(i).mode;
+        }
+        QVector<quint32> identifiers;
+        if (!same) {
+            if (!documentsWithAll(run, identifiers)) {
+                return false;
+            }
+            QVector<quint32> all(documents.size() + identifiers.size());
+            all.resize(std::set_union(documents.constBegin(), documents.constEnd(), identifiers.constBegin(),
+                                      identifiers.constEnd(), all.begin()) - all.begin());
+            documents = all;
+        }
+    }
+
+    for (quint32 id : documents) {
+        if (m_documents.at(id).live) {
+            paths.append(m_documents.at(id).path);
+        }
+    }
+    for (quint32 id : m_oversized) {
+        if (m_documents.at(id).live) {
+            paths.append(m_documents.at(id).path);
+        }
+    }
+    return true;
+}
+
+bool ContentIndex::save(const QString &fileName) const
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_6_0);
+    out << MAGIC << FORMAT_VERSION << m_basePath << m_maxFileSize;
+
+    out << quint32(m_documents.size());
+    for (const DocumentInfo &info : m_documents) {
+        out << info.path << info.size << info.modified << info.contentHash << info.live << info.oversized;
+    }
+    out << quint32(m_postings.size());
+    for (auto it = m_postings.constBegin(); it != m_postings.constEnd(); ++it) {
+        out << it.key() << it->lastDocument << it->count << it->data;
+    }
+    out << m_oversized;
+
+    return out.status() == QDataStream::Ok && file.commit();
+}
+
+bool ContentIndex::load(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_6_0);
+    quint32 magic = 0;
+    quint32 version = 0;
+    QString basePath;
+    qint64 maxFileSize = 0;
+    in >> magic >> version >> basePath >> maxFileSize;
+    // An index built under another size cap skipped different files
+    if (magic != MAGIC || version != FORMAT_VERSION || maxFileSize != m_maxFileSize) {
+        return false;
+    }
+
+    QVector<DocumentInfo> documents;
+    QHash<QString, quint32> documentIds;
+    int deadDocuments = 0;
+    quint32 count = 0;
+    in >> count;
+    for (quint32 id = 0; id < count && in.status() == QDataStream::Ok; ++id) {
+        DocumentInfo info;
+        in >> info.path >> info.size >> info.modified >> info.contentHash >> info.live >> info.oversized;
+        if (info.live) {
+            documentIds.insert(info.path, id);
+        } else {
+            ++deadDocuments;
+        }
+        documents.append(info);
+    }
+
+    QHash<QString, PostingList> postings;
+    in >> count;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        QString term;
+        PostingList list;
+        in >> term >> list.lastDocument >> list.count >> list.data;
+        if (list.lastDocument >= quint32(documents.size())) {
+            return false;
+        }
+        buildSkips(list);
+        postings.insert(term, list);
+    }
+    QVector<quint32> oversized;
+    in >> oversized;
+
+    if (in.status() != QDataStream::Ok) {
+        return false;
+    }
+    for (quint32 id : oversized) {
+        if (id >= quint32(documents.size())) {
+            return false;
+        }
+    }
+
+    m_documents = documents;
+    m_documentIds = documentIds;
+    m_postings = postings;
+    m_oversized = oversized;
+    m_deadDocuments = deadDocuments;
+    m_basePath = basePath;
+    rebuildTermTrigrams();
+    return true;
+}
+
+bool ContentIndex::constrains(const QString &word, MatchMode mode) const
+{
+    // Stop words never select documents, and a single character cut out of
+    // a longer word would match nearly everything
+    if (mode != ExactTerm && word.size() < 2) {
+        return false;
+    }
+    for (const QString &stopWord : m_stopWords) {
+        if (matchesMode(stopWord, word, mode)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ContentIndex::documentsWithAll(const QList<QueryWord> &words, QVector<quint32> &documents) const
+{
+    // Exact words stay compressed; the others are unions over the vocabulary
+    QList<const PostingList *> lists;
+    QList<QVector<quint32>> expanded;
+    bool narrowed = false;
+    for (const QueryWord &word : words) {
+        if (!constrains(word.word, word.mode)) {
+            continue;
+        }
+        narrowed = true;
+        if (word.mode != ExactTerm) {
+            expanded.append(documentsFor(word.word, word.mode));
+            continue;
+        }
+        auto list = m_postings.constFind(word.word);
+        if (list == m_postings.constEnd()) {
+            documents.clear();
+            return true;
+        }
+        lists.append(&list.value());
+    }
+    if (!narrowed) {
+        return false;
+    }
+
+    // Smallest first, so every later step works on the fewest documents
+    std::sort(lists.begin(), lists.end(), [](const PostingList *a, const PostingList *b) {
+        return a->count < b->count;
+    });
+    std::sort(expanded.begin(), expanded.end(), [](const QVector<quint32> &a, const QVector<quint32> &b) {
+        return a.size() < b.size();
+    });
+
+    int nextList = 0;
+    int nextExpanded = 0;
+    if (!lists.isEmpty() && (expanded.isEmpty() || lists.first()->count <= quint32(expanded.first().size()))) {
+        documents.clear();
+        decode(*lists.first(), documents);
+        nextList = 1;
+    } else {
+        documents = expanded.first();
+        nextExpanded = 1;
+    }
+    while (!documents.isEmpty() && nextExpanded < expanded.size()) {
+        documents = SortedIntersection::intersect(documents, expanded.at(nextExpanded++));
+    }
+    while (!documents.isEmpty() && nextList < lists.size()) {
+        documents = intersect(documents, *lists.at(nextList++));
+    }
+    return true;
+}
+
+QVector<quint32> ContentIndex::documentsFor(const QString &word, MatchMode mode) const
+{
+    QVector<quint32> documents;
+    if (word.size() < 3) {
+        for (auto it = m_postings.constBegin(); it != m_postings.constEnd(); ++it) {
+            if (matchesMode(it.key(), word, mode)) {
+                decode(it.value(), documents);
+            }
+        }
+    } else {
+        // Every term holding word holds all of its trigrams, so the terms
+        // of the rarest one are all there is to check
+        const QStringList *terms = nullptr;
+        for (qsizetype i = 0; i + 3 <= word.size(); ++i) {
+            auto it = m_termTrigrams.constFind(word.mid(i, 3));
+            if (it == m_termTrigrams.constEnd()) {
+                return documents;
+            }
+            if (!terms || it->size() < terms->size()) {
+                terms = &it.value();
+            }
+        }
+        for (const QString &term : *terms) {
+            auto list = m_postings.constFind(term);
+            if (list != m_postings.constEnd() && matchesMode(term, word, mode)) {
+                decode(list.value(), documents);
+            }
+        }
+    }
+    std::sort(documents.begin(), documents.end());
+    documents.erase(std::unique(documents.begin(), documents.end()), documents.end());
+    return documents;
+}
+
+bool ContentIndex::proximityCandidates(const ProximityQuery &query, QStringList &paths) const
+{
+    // Documents that hold every word, found from the document ids alone
+    const QStringList words = query.words();
+    QList<QueryWord> exactWords;
+    for (const QString &word : words) {
+        exactWords.append({word, ExactTerm});
+    }
+    QVector<quint32> documents;
+    if (!documentsWithAll(exactWords, documents)) {
+        return false;
+    }
+
+    // Their positions, gathered in one pass over each word's postings
+    QHash<QString, QHash<quint32, QVector<quint32>>> positions;
+    for (const QString &word : words) {
+        auto list = m_postings.constFind(word);
+        if (list != m_postings.constEnd()) {
+            decodePositions(list.value(), documents, positions[word]);
+        }
+    }
+
+    for (quint32 id : documents) {
+        if (!m_documents.at(id).live) {
+            continue;
+        }
+        const auto found = query.find([&](const QString &word) {
+            return positions.value(word).value(id);
+        }, 1);
+        if (!found.isEmpty()) {
+            paths.append(m_documents.at(id).path);
+        }
+    }
+    for (quint32 id : m_oversized) {
+        if (m_documents.at(id).live) {
+            paths.append(m_documents.at(id).path);
+        }
+    }
+    return true;
+}
+
+void ContentIndex::appendPosting(const QString &term, quint32 document, const QVector<quint32> &positions)
+{
+    QByteArray encoded;
+    quint32 previous = 0;
+    for (quint32 position : positions) {
+        appendVarint(encoded, position - previous);
+        previous = position;
+    }
+    auto list = m_postings.find(term);
+    if (list == m_postings.end()) {
+        list = m_postings.insert(term, PostingList());
+        addTermTrigrams(term);
+    }
+    appendEntry(list.value(), document, encoded.constData(), int(encoded.size()));
+}
+
+void ContentIndex::appendEntry(PostingList &list, quint32 document, const char *positions, int length)
+{
+    if (list.count % SKIP_INTERVAL == 0) {
+        list.skips.append({list.count == 0 ? 0 : list.lastDocument, quint32(list.data.size())});
+    }
+    appendVarint(list.data, list.count == 0 ? document : document - list.lastDocument);
+    appendVarint(list.data, quint32(length));
+    list.data.append(positions, length);
+    list.lastDocument = document;
+    ++list.count;
+}
+
+void ContentIndex::retire(const QString &path)
+{
+    auto id = m_documentIds.find(path);
+    if (id == m_documentIds.end()) {
+        return;
+    }
+    m_documents[id.value()].live = false;
+    m_documentIds.erase(id);
+    ++m_deadDocuments;
+}
+
+void ContentIndex::compact()
+{
+    // Renumber the live documents in order, which keeps postings sorted
+    const quint32 dead = 0xffffffffu;
+    QVector<quint32> remap(m_documents.size(), dead);
+    QVector<DocumentInfo> documents;
+    documents.reserve(m_documentIds.size());
+    for (int id = 0; id < m_documents.size(); ++id) {
+        if (m_documents.at(id).live) {
+            remap[id] = quint32(documents.size());
+            documents.append(m_documents.at(id));
+        }
+    }
+
+    // Positions are copied still encoded
+    QHash<QString, PostingList> postings;
+    for (auto it = m_postings.constBegin(); it != m_postings.constEnd(); ++it) {
+        PostingList list;
+        list.lastDocument = 0;
+        list.count = 0;
+        forEachEntry(it->data, it->count, [&](quint32 id, const uchar *positions, int length) {
+            const quint32 mapped = remap.at(id);
+            if (mapped != dead) {
+                appendEntry(list, mapped, reinterpret_cast<const char *>(positions), length);
+            }
+        });
+        if (list.count > 0) {
+            postings.insert(it.key(), list);
+        }
+    }
+
+    QVector<quint32> oversized;
+    for (quint32 id : m_oversized) {
+        if (remap.at(id) != dead) {
+            oversized.append(remap.at(id));
+        }
+    }
+
+    m_documents = documents;
+    for (auto it = m_documentIds.begin(); it != m_documentIds.end(); ++it) {
+        it.value() = remap.at(it.value());
+    }
+    m_postings = postings;
+    m_oversized = oversized;
+    m_deadDocuments = 0;
+    rebuildTermTrigrams();
+}
+
+void ContentIndex::addTermTrigrams(const QString &term)
+{
+    QSet<QString> seen;
+    for (qsizetype i = 0; i + 3 <= term.size(); ++i) {
+        const QString trigram = term.mid(i, 3);
+        if (!seen.contains(trigram)) {
+            seen.insert(trigram);
+            m_termTrigrams[trigram].append(term);
+        }
+    }
+}
+
+void ContentIndex::rebuildTermTrigrams()
+{
+    m_termTrigrams.clear();
+    for (auto it = m_postings.constBegin(); it != m_postings.constEnd(); ++it) {
+        addTermTrigrams(it.key());
+    }
+}
+
+bool ContentIndex::matchesMode(const QString &term, const QString &word, MatchMode mode)
+{
+    switch (mode) {
+    case TermPrefix:
+        return term.startsWith(word);
+    case TermSuffix:
+        return term.endsWith(word);
+    case TermInfix:
+        return term.contains(word);
+    case ExactTerm:
+    default:
+        return term == word;
+    }
+}
+
+void ContentIndex::decode(const PostingList &list, QVector<quint32> &documents)
+{
+    forEachEntry(list.data, list.count, [&](quint32 document, const uchar *, int) {
+        documents.append(document);
+    });
+}
+
+void ContentIndex::decodePositions(const PostingList &list, const QVector<quint32> &documents,
+                                   QHash<quint32, QVector<quint32>> &positions)
+{
+    // Both sides are sorted, so one merge finds the wanted entries
+    auto wanted = documents.cbegin();
+    forEachEntry(list.data, list.count, [&](quint32 document, const uchar *p, int length) {
+        while (wanted != documents.cend() && *wanted < document) {
+            ++wanted;
+        }
+        if (wanted == documents.cend() || *wanted != document) {
+            return;
+        }
+        QVector<quint32> &decoded = positions[document];
+        const uchar *end = p + length;
+        quint32 position = 0;
+        while (p < end) {
+            position += readVarint(p, end);
+            decoded.append(position);
+        }
+    });
+}
+
+void ContentIndex::buildSkips(PostingList &list)
+{
+    list.skips.clear();
+    const uchar *data = reinterpret_cast<const uchar *>(list.data.constData());
+    const uchar *end = data + list.data.size();
+    const uchar *p = data;
+    quint32 document = 0;
+    for (quint32 i = 0; i < list.count && p < end; ++i) {
+        if (i % SKIP_INTERVAL == 0) {
+            list.skips.append({document, quint32(p - data)});
+        }
+        document += readVarint(p, end);
+        p += qMin<qint64>(readVarint(p, end), end - p);
+    }
+}
+
+QVector<quint32> ContentIndex::intersect(const QVector<quint32> &documents, const PostingList &list)
+{
+    // Comparable sizes: decode the list and intersect the arrays
+    if (qint64(documents.size()) * SKIP_RATIO >= list.count || list.skips.size() < 2) {
+        QVector<quint32> decoded;
+        decoded.reserve(int(list.count));
+        decode(list, decoded);
+        return SortedIntersection::intersect(documents, decoded);
+    }
+
+    // Few documents against a long list: jump to the block that may hold
+    // each one and decode from there
+    QVector<quint32> result;
+    const uchar *data = reinterpret_cast<const uchar *>(list.data.constData());
+    const uchar *end = data + list.data.size();
+    const uchar *p = data;
+    quint32 entry = 0;          // Next entry to decode
+    quint32 current = 0;        // Last decoded document, or the base after a jump
+    bool decoded = false;
+    for (quint32 document : documents) {
+        if (decoded && current >= document) {
+            if (current == document) {
+                result.append(document);
+            }
+            continue;
+        }
+
+        // The last block whose base lies below the document; jump there if
+        // it starts past the next entry
+        auto skip = std::partition_point(list.skips.cbegin() + entry / SKIP_INTERVAL, list.skips.cend(),
+                                         [&](const Skip &s) { return s.base < document; });
+        const quint32 block = quint32(qMax<qsizetype>(skip - list.skips.cbegin() - 1, 0));
+        if (block * SKIP_INTERVAL > entry) {
+            entry = block * SKIP_INTERVAL;
+            p = data + list.skips.at(block).offset;
+            current = list.skips.at(block).base;
+            decoded = false;
+        }
+
+        while ((!decoded || current < document) && entry < list.count && p < end) {
+            current += readVarint(p, end);
+            p += qMin<qint64>(readVarint(p, end), end - p);
+            ++entry;
+            decoded = true;
+        }
+        if (!decoded || current < document) {
+            break;      // List exhausted
+        }
+        if (current == document) {
+            result.append(document);
+        }
+    }
+    return result;
+}
+
+void ContentIndex::appendVarint(QByteArray &data, quint32 value)
+{
+    while (value >= 0x80) {
+        data.append(char((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    data.append(char(value));
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <QStringView>
+#include <QByteArray>
+#include <QVector>
+#include <QHash>
+#include <QSet>
+
+class ProximityQuery;
+
+// Inverted index over the text of files: case-folded word -> files that
+// contain it, and where. A posting is a varint-encoded document id delta,
+// the byte length of its positions and the positions themselves as varint
+// deltas, so document-only lookups skip positions without decoding them.
+// A changed file gets a new, higher id, so postings only ever grow at the
+// end; ids of replaced versions are dropped lazily and reclaimed by
+// compaction.
+//
+// Lookups return candidates, a superset of the files whose text contains
+// the query: words at the ends of the query may be parts of longer words,
+// and case is ignored. The content matcher verifies them. Phrase and NEAR
+// queries (see ProximityQuery) are decided here from the positions; only
+// case-sensitive ones still need the matcher.
+//
+// Stop words are indexed with their positions, so phrases containing them
+// can be checked, but never select documents on their own. Identifiers are
+// also indexed by their subwords (see IdentifierTokenizer), without
+// positions, so "search engine" can be looked up in SearchEngine.
+//
+// Not thread safe; the owner serializes access. prepare() reads no index
+// state besides the stop words and the size cap and may run unlocked.
+class ContentIndex
+{
+public:
+    // A file read and tokenized, ready to be added
+    struct Document {
+        QString path;
+        qint64 size;
+        qint64 modified;        // msecs since epoch
+        quint64 contentHash;
+        bool readable;
+        bool binary;
+        bool oversized;         // Above the size cap; always a candidate
+        bool unchanged;         // Same content as the indexed version
+        QHash<QString, QVector<quint32>> positions;     // Word -> ascending positions; none for subwords
+    };
+
+    ContentIndex();
+
+    void setStopWords(const QSet<QString> &stopWords);
+    void setMaxFileSize(qint64 bytes);
+    qint64 maxFileSize() const;
+
+    // Directory the index was built for
+    void setBasePath(const QString &path);
+    QString basePath() const;
+
+    // Case-folded runs of letters and digits, in position order
+    static QStringList tokenize(QStringView text);
+
+    // True if path is indexed with this size and mtime, so it needn't be read
+    bool isCurrent(const QString &path, qint64 size, qint64 modified) const;
+    quint64 contentHash(const QString &path) const;
+
+    // Reads path; content hashing to previousHash skips tokenization
+    Document prepare(const QString &path, quint64 previousHash = 0) const;
+    // The same for data that isn't a file of its own, e.g. an archive member
+    Document prepare(const QString &path, const QByteArray &data, qint64 modified, quint64 previousHash = 0) const;
+    void add(const Document &document);
+    void remove(const QString &path);
+    void removeUnder(const QString &directory);
+    void clear();
+
+    int documentCount() const;
+    int termCount() const;
+    QStringList paths() const;
+
+    // Files that may contain text, or that do for a proximity query.
+    // Returns false if the index can't narrow the search, e.g. when text
+    // holds nothing but stop words.
+    bool candidates(const QString &text, QStringList &paths) const;
+
+    bool save(const QString &fileName) const;
+    bool load(const QString &fileName);
+
+private:
+    struct DocumentInfo {
+        QString path;
+        qint64 size;
+        qint64 modified;
+        quint64 contentHash;
+        bool live;
+        bool oversized;
+    };
+
+    // Where every SKIP_INTERVAL-th entry starts, so a lookup can jump to
+    // the block that may hold a document instead of decoding up to it
+    struct Skip {
+        quint32 base;           // Document before the block; deltas add to it
+        quint32 offset;
+    };
+
+    struct PostingList {
+        QByteArray data;        // Varint deltas of ascending document ids
+        quint32 lastDocument;
+        quint32 count;
+        QVector<Skip> skips;    // Not saved; rebuilt on load
+    };
+
+    enum MatchMode {
+        ExactTerm,
+        TermPrefix,             // Query word ends the query: it may continue
+        TermSuffix,             // Query word starts the query: it may be preceded
+        TermInfix
+    };
+
+    struct QueryWord {
+        QString word;
+        MatchMode mode;
+    };
+
+    bool constrains(const QString &word, MatchMode mode) const;
+    bool documentsWithAll(const QList<QueryWord> &words, QVector<quint32> &documents) const;
+    QVector<quint32> documentsFor(const QString &word, MatchMode mode) const;
+    bool proximityCandidates(const ProximityQuery &query, QStringList &paths) const;
+    void appendPosting(const QString &term, quint32 document, const QVector<quint32> &positions);
+    void addTermTrigrams(const QString &term);
+    void rebuildTermTrigrams();
+    void retire(const QString &path);
+    void compact();
+
+    void analyze(Document &document, const QByteArray &data, quint64 previousHash) const;
+    static bool matchesMode(const QString &term, const QString &word, MatchMode mode);
+    static void decode(const PostingList &list, QVector<quint32> &documents);
+    static void decodePositions(const PostingList &list, const QVector<quint32> &documents,
+                                QHash<quint32, QVector<quint32>> &positions);
+    static void appendEntry(PostingList &list, quint32 document, const char *positions, int length);
+    static void buildSkips(PostingList &list);
+    static QVector<quint32> intersect(const QVector<quint32> &documents, const PostingList &list);
+    static void appendVarint(QByteArray &data, quint32 value);
+
+    QVector<DocumentInfo> m_documents;
+    QHash<QString, quint32> m_documentIds;  // Live version of each path
+    QHash<QString, PostingList> m_postings;
+    // Trigram -> terms holding it, so a word inside terms is looked up in
+    // the terms sharing its rarest trigram instead of the whole vocabulary.
+    // Not saved; rebuilt on load.
+    QHash<QString, QStringList> m_termTrigrams;
+    QVector<quint32> m_oversized;           // Live ids that have no postings
+    int m_deadDocuments;
+
+    QSet<QString> m_stopWords;
+    qint64 m_maxFileSize;
+    QString m_basePath;
+
+    static const qint64 DEFAULT_MAX_FILE_SIZE = 8 * 1024 * 1024;
+    static const quint32 FORMAT_VERSION = 2;
+    static const quint32 SKIP_INTERVAL = 128;
+    static const int SKIP_RATIO = 32;       // Skip when the list is this many times longer
+};
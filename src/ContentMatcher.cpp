@@ -0,0 +1,956 @@
+#include "ContentMatcher.h"
+#include "IdentifierTokenizer.h"
+#include <QRegularExpressionMatch>
+#include <QRegularExpressionMatchIterator>
+#include <QStringConverter>
+#include <QStringDecoder>
+#include <QSet>
+#include <cctype>
+#include <cstring>
+#include <optional>
+
+namespace {
+
+const qsizetype ENCODING_SNIFF_SIZE = 4096;
+
+bool isTextByte(uchar c)
+{
+    return (c >= 0x20 && c < 0x7F) || c == '\t' || c == '\n' || c == '\r';
+}
+
+// UTF-16 without a byte order mark, when most of it is ASCII: every code
+// unit is then a text byte and a NUL
+std::optional<QStringConverter::Encoding> utf16WithoutBom(QByteArrayView head)
+{
+    const uchar *bytes = reinterpret_cast<const uchar *>(head.data());
+    const qsizetype units = head.size() / 2;
+    if (units < 8 || !memchr(bytes, 0, size_t(head.size()))) {
+        return std::nullopt;
+    }
+
+    qsizetype littleEndian = 0;
+    qsizetype bigEndian = 0;
+    for (qsizetype i = 0; i < units; ++i) {
+        const uchar first = bytes[2 * i];
+        const uchar second = bytes[2 * i + 1];
+        if (second == 0 && isTextByte(first)) {
+            ++littleEndian;
+        } else if (first == 0 && isTextByte(second)) {
+            ++bigEndian;
+        }
+    }
+    if (littleEndian * 10 >= units * 9) {
+        return QStringConverter::Utf16LE;
+    }
+    if (bigEndian * 10 >= units * 9) {
+        return QStringConverter::Utf16BE;
+    }
+    return std::nullopt;
+}
+
+// Multi-byte sequences in bytes read as UTF-8: well formed ones and bytes
+// that start none. A sequence cut off by the end counts as invalid.
+void countUtf8Sequences(const uchar *bytes, qsizetype size, qsizetype &valid, qsizetype &invalid)
+{
+    valid = 0;
+    invalid = 0;
+    qsizetype i = 0;
+    while (i < size) {
+        // Runs of ASCII are checked eight bytes at a time
+        if (i + 8 <= size) {
+            quint64 word;
+            memcpy(&word, bytes + i, sizeof(word));
+            if (!(word & 0x8080808080808080ULL)) {
+                i += 8;
+                continue;
+            }
+        }
+
+        const uchar c = bytes[i];
+        if (c < 0x80) {
+            ++i;
+            continue;
+        }
+        const int extra = (c & 0xE0) == 0xC0 ? 1 : (c & 0xF0) == 0xE0 ? 2 : (c & 0xF8) == 0xF0 ? 3 : -1;
+        bool wellFormed = extra > 0 && c != 0xC0 && c != 0xC1 && c <= 0xF4 && i + extra < size;
+        for (int k = 1; wellFormed && k <= extra; ++k) {
+            wellFormed = (bytes[i + k] & 0xC0) == 0x80;
+        }
+        if (wellFormed) {
+            ++valid;
+            i += extra + 1;
+        } else {
+            ++invalid;
+            ++i;
+        }
+    }
+}
+
+qsizetype lineStartBefore(const char *bytes, qsizetype offset)
+{
+    while (offset > 0 && bytes[offset - 1] != '\n') {
+        --offset;
+    }
+    return offset;
+}
+
+qsizetype lineEndAfter(const char *bytes, qsizetype size, qsizetype offset)
+{
+    const char *newline = static_cast<const char *>(memchr(bytes + offset, '\n', size_t(size - offset)));
+    return newline ? newline - bytes : size;
+}
+
+}
+
+ContentMatcher::ContentMatcher(const SearchEngine::SearchCriteria &criteria)
+    : m_query(criteria.query)
+    , m_caseSensitivity(criteria.caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive)
+    , m_useRegex(criteria.useRegex || criteria.wholeWords)
+    , m_wholeWords(criteria.wholeWords)
+    , m_literalCaseSensitivity(m_caseSensitivity)
+    , m_spansLines(false)
+{
+    if (!criteria.terms.isEmpty()) {
+        // The automaton folds ASCII; other letters get a pattern for each
+        // of their case forms, as Utf8Needle matches them
+        QList<QByteArray> patterns;
+        for (const QString &term : criteria.terms) {
+            if (!term.isEmpty() && !m_terms.contains(term)) {
+                const QList<QByteArray> forms = criteria.caseSensitive ? QList<QByteArray>{term.toUtf8()}
+                                                                       : Utf8Needle::caseForms(term, MAX_TERM_FORMS);
+                for (const QByteArray &form : forms) {
+                    patterns.append(form);
+                    m_patternTerms.append(int(m_terms.size()));
+                }
+                m_terms.append(term);
+            }
+        }
+        m_termAutomaton.build(patterns, !criteria.caseSensitive);
+        m_useRegex = false;
+        return;
+    }
+
+    // Quoted phrases and NEAR compare words, which are whole by definition
+    if (!criteria.useRegex) {
+        m_proximity = ProximityQuery::parse(criteria.query, m_caseSensitivity);
+        if (m_proximity.isValid()) {
+            m_useRegex = false;
+            return;
+        }
+    }
+
+    if (!m_useRegex && !criteria.caseSensitive) {
+        const QStringList subwords = IdentifierTokenizer::subwords(criteria.query);
+        if (subwords.size() > 1) {
+            m_subwords = subwords;
+            for (const QString &subword : subwords) {
+                m_subwordNeedles.append(Utf8Needle(subword, Qt::CaseInsensitive));
+                if (subword.size() > m_longestSubword.size()) {
+                    m_longestSubword = subword;
+                }
+            }
+        }
+    }
+
+    if (!m_useRegex) {
+        m_queryNeedle = Utf8Needle(m_query, m_caseSensitivity);
+        return;
+    }
+
+    QString pattern;
+    if (criteria.useRegex) {
+        pattern = criteria.query;
+        m_literals = requiredLiterals(pattern);
+        m_spansLines = mayMatchLineBreak(pattern);
+        if (hasInlineOption(pattern, QLatin1Char('i'))) {
+            m_literalCaseSensitivity = Qt::CaseInsensitive;
+        }
+    } else {
+        pattern = "\\b" + QRegularExpression::escape(criteria.query) + "\\b";
+        if (!criteria.query.isEmpty()) {
+            m_literals << criteria.query;
+        }
+    }
+
+    // Case folding is left to the regex engine; lowercasing the pattern
+    // would also turn escapes such as \W or \S into their opposites.
+    QRegularExpression::PatternOptions options = QRegularExpression::MultilineOption;
+    if (!criteria.caseSensitive) {
+        options |= QRegularExpression::CaseInsensitiveOption;
+    }
+    m_regex.setPattern(pattern);
+    m_regex.setPatternOptions(options);
+    m_regex.optimize();
+
+    // The longest literal is usually the most selective one
+    for (const QString &literal : m_literals) {
+        m_literalNeedles.append(Utf8Needle(literal, m_literalCaseSensitivity));
+        if (literal.size() > m_longestLiteral.size()) {
+            m_longestLiteral = literal;
+        }
+    }
+    m_longestLiteralNeedle = Utf8Needle(m_longestLiteral, m_literalCaseSensitivity);
+}
+
+bool ContentMatcher::isValid() const
+{
+    return !m_useRegex || m_regex.isValid();
+}
+
+QString ContentMatcher::errorString() const
+{
+    return m_useRegex ? m_regex.errorString() : QString();
+}
+
+bool ContentMatcher::matches(const QString &content, QStringList &matchedLines, int maxLines) const
+{
+    if (m_proximity.isValid()) {
+        return matchesProximity(content, matchedLines, maxLines);
+    }
+    if (!m_useRegex) {
+        return matchesPlain(content, matchedLines, maxLines)
+            || (!m_subwords.isEmpty() && matchesIdentifiers(content, matchedLines, maxLines));
+    }
+    if (!m_regex.isValid()) {
+        return false;
+    }
+    if (!m_longestLiteral.isEmpty()) {
+        return matchesRegexWithPrefilter(content, matchedLines, maxLines);
+    }
+    return matchesRegexFullScan(content, matchedLines, maxLines);
+}
+
+bool ContentMatcher::matches(const QByteArray &data, QStringList &matchedLines, int maxLines) const
+{
+    const QStringConverter::Encoding encoding = detectEncoding(data);
+    if (encoding != QStringConverter::Utf8 || m_proximity.isValid()) {
+        return matches(decode(data, encoding), matchedLines, maxLines);
+    }
+
+    // Past a byte order mark the bytes are those of the decoded text
+    QByteArrayView text(data);
+    if (text.startsWith("\xEF\xBB\xBF")) {
+        text = text.sliced(3);
+    }
+    if (!m_useRegex) {
+        if (matchesPlain(text, matchedLines, maxLines)) {
+            return true;
+        }
+        if (m_subwords.isEmpty()) {
+            return false;
+        }
+        // Identifier runs are only looked for, on decoded lines, in files
+        // that hold every subword
+        for (const Utf8Needle &subword : m_subwordNeedles) {
+            if (subword.indexIn(text.data(), text.size()) < 0) {
+                return false;
+            }
+        }
+        return matchesIdentifiers(decode(text, encoding), matchedLines, maxLines);
+    }
+    if (!m_regex.isValid()) {
+        return false;
+    }
+    if (!m_longestLiteral.isEmpty()) {
+        return matchesRegexWithPrefilter(text, matchedLines, maxLines);
+    }
+    return matchesRegexFullScan(decode(text, encoding), matchedLines, maxLines);
+}
+
+bool ContentMatcher::isMultiTerm() const
+{
+    return !m_terms.isEmpty();
+}
+
+bool ContentMatcher::isProximity() const
+{
+    return m_proximity.isValid();
+}
+
+bool ContentMatcher::matchesTerms(const QByteArray &data, QStringList &matchedLines,
+                                  QHash<QString, QList<int>> &termLines, int maxLines) const
+{
+    // The automaton matches UTF-8; text in other encodings is transcoded
+    const QStringConverter::Encoding encoding = detectEncoding(data);
+    const QByteArray text = encoding == QStringConverter::Utf8 ? data : decode(data, encoding).toUtf8();
+    const char *bytes = text.constData();
+    const qsizetype size = text.size();
+
+    // Line bookkeeping advances lazily, only up to the next hit
+    int line = 1;
+    qsizetype lineStart = 0;
+    qsizetype scanned = 0;
+    qsizetype lastReportedLine = -1;
+
+    m_termAutomaton.scan(bytes, size, [&](int pattern, qsizetype end) {
+        const qsizetype start = end - m_termAutomaton.patternLength(pattern);
+        if (m_wholeWords) {
+            if ((start > 0 && isWordByte(bytes[start - 1])) || (end < size && isWordByte(bytes[end]))) {
+                return true;
+            }
+        }
+
+        while (scanned < start) {
+            const char *newline = static_cast<const char *>(memchr(bytes + scanned, '\n', start - scanned));
+            if (!newline) {
+                scanned = start;
+                break;
+            }
+            ++line;
+            lineStart = newline - bytes + 1;
+            scanned = lineStart;
+        }
+
+        QList<int> &lines = termLines[m_terms.at(m_patternTerms.at(pattern))];
+        if ((lines.isEmpty() || lines.last() != line) && lines.size() < maxLines) {
+            lines.append(line);
+        }
+
+        if (line != lastReportedLine && matchedLines.size() < maxLines) {
+            const char *newline = static_cast<const char *>(memchr(bytes + end, '\n', size - end));
+            const qsizetype lineEnd = newline ? newline - bytes : size;
+            matchedLines.append(QString::fromUtf8(bytes + lineStart, lineEnd - lineStart).trimmed());
+            lastReportedLine = line;
+        }
+        return true;
+    });
+
+    return !termLines.isEmpty();
+}
+
+bool ContentMatcher::looksBinary(const QByteArray &head)
+{
+    if (head.isEmpty()) {
+        return false;
+    }
+
+    // UTF-16 and UTF-32 text legitimately contains NUL bytes; UTF-8 with a
+    // byte order mark doesn't, and is checked like any other
+    const std::optional<QStringConverter::Encoding> marked = QStringConverter::encodingForData(head);
+    if ((marked && *marked != QStringConverter::Utf8)
+        || utf16WithoutBom(QByteArrayView(head).first(qMin(head.size(), ENCODING_SNIFF_SIZE)))) {
+        return false;
+    }
+
+    const uchar *bytes = reinterpret_cast<const uchar *>(head.constData());
+    const qsizetype size = head.size();
+    if (memchr(bytes, 0, size)) {
+        return true;
+    }
+
+    qsizetype control = 0;
+    qsizetype invalid = 0;
+    qsizetype i = 0;
+    while (i < size) {
+        const uchar c = bytes[i];
+        if (c < 0x80) {
+            if (c < 0x20 && c != '\t' && c != '\n' && c != '\r' && c != '\f' && c != '\b' && c != 0x1b) {
+                ++control;
+            }
+            ++i;
+            continue;
+        }
+
+        const int extra = (c & 0xE0) == 0xC0 ? 1 : (c & 0xF0) == 0xE0 ? 2 : (c & 0xF8) == 0xF0 ? 3 : -1;
+        if (extra < 0 || c == 0xC0 || c == 0xC1) {
+            ++invalid;
+            ++i;
+            continue;
+        }
+        if (i + extra >= size) {
+            break; // Sequence cut off by the end of the buffer
+        }
+
+        bool valid = true;
+        for (int k = 1; k <= extra; ++k) {
+            if ((bytes[i + k] & 0xC0) != 0x80) {
+                valid = false;
+                break;
+            }
+        }
+        if (valid) {
+            i += extra + 1;
+        } else {
+            ++invalid;
+            ++i;
+        }
+    }
+
+    // Latin-1 text has some invalid UTF-8, binary data has a lot of it
+    return control * 10 > size || invalid * 10 > size * 3;
+}
+
+QStringConverter::Encoding ContentMatcher::detectEncoding(QByteArrayView data)
+{
+    if (const std::optional<QStringConverter::Encoding> marked = QStringConverter::encodingForData(data)) {
+        return *marked;
+    }
+    if (const std::optional<QStringConverter::Encoding> utf16 =
+            utf16WithoutBom(data.first(qMin(data.size(), ENCODING_SNIFF_SIZE)))) {
+        return *utf16;
+    }
+
+    // A stray byte in UTF-8 text is decoded as a replacement character;
+    // only when invalid bytes outnumber the sequences that make sense is
+    // the text taken for Latin-1, whose accented letters are rarely
+    // followed by what would continue a UTF-8 sequence
+    qsizetype valid;
+    qsizetype invalid;
+    countUtf8Sequences(reinterpret_cast<const uchar *>(data.data()), data.size(), valid, invalid);
+    return invalid > valid ? QStringConverter::Latin1 : QStringConverter::Utf8;
+}
+
+QString ContentMatcher::decodeText(const QByteArray &data)
+{
+    return decode(data, detectEncoding(data));
+}
+
+QString ContentMatcher::decode(QByteArrayView data, QStringConverter::Encoding encoding)
+{
+    QStringDecoder decoder(encoding);
+    QString text = decoder.decode(data);
+
+    if (text.contains(QLatin1Char('\r'))) {
+        text.replace(QLatin1String("\r\n"), QLatin1String("\n"));
+    }
+    return text;
+}
+
+bool ContentMatcher::isWordByte(char byte)
+{
+    const uchar c = static_cast<uchar>(byte);
+    return c >= 0x80 || c == '_' || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+bool ContentMatcher::matchesPlain(const QString &content, QStringList &matchedLines, int maxLines) const
+{
+    bool matched = false;
+    qsizetype from = 0;
+
+    while (from <= content.size()) {
+        const qsizetype hit = content.indexOf(m_query, from, m_caseSensitivity);
+        if (hit < 0) {
+            break;
+        }
+        matched = true;
+
+        const qsizetype lineStart = hit > 0 ? content.lastIndexOf(QLatin1Char('\n'), hit - 1) + 1 : 0;
+        qsizetype lineEnd = content.indexOf(QLatin1Char('\n'), hit);
+        if (lineEnd < 0) {
+            lineEnd = content.size();
+        }
+
+        matchedLines.append(QStringView(content).mid(lineStart, lineEnd - lineStart).trimmed().toString());
+        if (matchedLines.size() >= maxLines) {
+            break;
+        }
+        from = lineEnd + 1;
+    }
+
+    return matched;
+}
+
+bool ContentMatcher::matchesPlain(QByteArrayView text, QStringList &matchedLines, int maxLines) const
+{
+    const char *bytes = text.data();
+    const qsizetype size = text.size();
+    bool matched = false;
+    qsizetype from = 0;
+
+    // Only the lines that are reported get decoded
+    while (from <= size) {
+        const qsizetype hit = m_queryNeedle.indexIn(bytes, size, from);
+        if (hit < 0) {
+            break;
+        }
+        matched = true;
+
+        const qsizetype lineStart = lineStartBefore(bytes, hit);
+        const qsizetype lineEnd = lineEndAfter(bytes, size, hit);
+        matchedLines.append(QString::fromUtf8(bytes + lineStart, lineEnd - lineStart).trimmed());
+        if (matchedLines.size() >= maxLines) {
+            break;
+        }
+        from = lineEnd + 1;
+    }
+
+    return matched;
+}
+
+bool ContentMatcher::matchesProximity(const QString &content, QStringList &matchedLines, int maxLines) const
+{
+    // Positions of the query's words and where each occurrence starts; the
+    // words are numbered exactly as the content index numbers them
+    const QStringList wordList = m_proximity.words();
+    const QSet<QString> words(wordList.begin(), wordList.end());
+    QHash<QString, QVector<quint32>> positions;
+    QHash<quint32, qsizetype> offsets;
+    quint32 position = 0;
+    ProximityQuery::forEachWord(content, [&](qsizetype start, qsizetype length) {
+        const QString word = m_proximity.normalizedWord(QStringView(content).sliced(start, length));
+        if (words.contains(word)) {
+            positions[word].append(position);
+            offsets.insert(position, start);
+        }
+        ++position;
+    });
+
+    const QList<ProximityQuery::Span> spans = m_proximity.find([&](const QString &word) {
+        return positions.value(word);
+    });
+
+    qsizetype lastLineStart = -1;
+    for (const ProximityQuery::Span &span : spans) {
+        if (matchedLines.size() >= maxLines) {
+            break;
+        }
+        const qsizetype hit = offsets.value(span.begin);
+        const qsizetype lineStart = hit > 0 ? content.lastIndexOf(QLatin1Char('\n'), hit - 1) + 1 : 0;
+        if (lineStart == lastLineStart) {
+            continue;
+        }
+        qsizetype lineEnd = content.indexOf(QLatin1Char('\n'), hit);
+        if (lineEnd < 0) {
+            lineEnd = content.size();
+        }
+        matchedLines.append(QStringView(content).mid(lineStart, lineEnd - lineStart).trimmed().toString());
+        lastLineStart = lineStart;
+    }
+
+    return !spans.isEmpty();
+}
+
+bool ContentMatcher::matchesIdentifiers(const QString &content, QStringList &matchedLines, int maxLines) const
+{
+    // Every subword occurs somewhere in a matching file, and the longest one
+    // on every matching line
+    for (const QString &subword : m_subwords) {
+        if (!content.contains(subword, Qt::CaseInsensitive)) {
+            return false;
+        }
+    }
+
+    bool matched = false;
+    qsizetype lineStart = 0;
+    while (lineStart <= content.size()) {
+        qsizetype lineEnd = content.indexOf(QLatin1Char('\n'), lineStart);
+        if (lineEnd < 0) {
+            lineEnd = content.size();
+        }
+        const QStringView line = QStringView(content).mid(lineStart, lineEnd - lineStart);
+        if (line.contains(m_longestSubword, Qt::CaseInsensitive)
+            && IdentifierTokenizer::containsRun(IdentifierTokenizer::subwords(line), m_subwords)) {
+            matched = true;
+            matchedLines.append(line.trimmed().toString());
+            if (matchedLines.size() >= maxLines) {
+                break;
+            }
+        }
+        lineStart = lineEnd + 1;
+    }
+
+    return matched;
+}
+
+bool ContentMatcher::matchesRegexWithPrefilter(const QString &content, QStringList &matchedLines, int maxLines) const
+{
+    // Every match contains all required literals, so a file missing any of
+    // them can be rejected without running the regex at all.
+    for (const QString &literal : m_literals) {
+        if (!content.contains(literal, m_literalCaseSensitivity)) {
+            return false;
+        }
+    }
+
+    // Only lines holding the most selective literal can match; the regex
+    // runs on those candidate lines alone. A match that may span lines
+    // needs the whole text.
+    if (m_spansLines) {
+        return matchesRegexFullScan(content, matchedLines, maxLines);
+    }
+
+    bool matched = false;
+    qsizetype from = 0;
+
+    while (from <= content.size()) {
+        const qsizetype hit = content.indexOf(m_longestLiteral, from, m_literalCaseSensitivity);
+        if (hit < 0) {
+            break;
+        }
+
+        const qsizetype lineStart = hit > 0 ? content.lastIndexOf(QLatin1Char('\n'), hit - 1) + 1 : 0;
+        qsizetype lineEnd = content.indexOf(QLatin1Char('\n'), hit);
+        if (lineEnd < 0) {
+            lineEnd = content.size();
+        }
+
+        const QStringView line = QStringView(content).mid(lineStart, lineEnd - lineStart);
+        if (m_regex.matchView(line).hasMatch()) {
+            matched = true;
+            matchedLines.append(line.trimmed().toString());
+            if (matchedLines.size() >= maxLines) {
+                break;
+            }
+        }
+        from = lineEnd + 1;
+    }
+
+    return matched;
+}
+
+bool ContentMatcher::matchesRegexWithPrefilter(QByteArrayView text, QStringList &matchedLines, int maxLines) const
+{
+    const char *bytes = text.data();
+    const qsizetype size = text.size();
+    for (const Utf8Needle &literal : m_literalNeedles) {
+        if (literal.indexIn(bytes, size) < 0) {
+            return false;
+        }
+    }
+    if (m_spansLines) {
+        return matchesRegexFullScan(decode(text, QStringConverter::Utf8), matchedLines, maxLines);
+    }
+
+    bool matched = false;
+    qsizetype from = 0;
+
+    while (from <= size) {
+        const qsizetype hit = m_longestLiteralNeedle.indexIn(bytes, size, from);
+        if (hit < 0) {
+            break;
+        }
+
+        const qsizetype lineStart = lineStartBefore(bytes, hit);
+        const qsizetype lineEnd = lineEndAfter(bytes, size, hit);
+        QString line = QString::fromUtf8(bytes + lineStart, lineEnd - lineStart);
+        // Lines of decoded text end before the CR of a CRLF
+        if (line.endsWith(QLatin1Char('\r'))) {
+            line.chop(1);
+        }
+        if (m_regex.matchView(line).hasMatch()) {
+            matched = true;
+            matchedLines.append(line.trimmed());
+            if (matchedLines.size() >= maxLines) {
+                break;
+            }
+        }
+        from = lineEnd + 1;
+    }
+
+    return matched;
+}
+
+bool ContentMatcher::matchesRegexFullScan(const QString &content, QStringList &matchedLines, int maxLines) const
+{
+    bool matched = false;
+    qsizetype lastLineEnd = -1;
+
+    QRegularExpressionMatchIterator it = m_regex.globalMatch(content);
+    while (it.hasNext()) {
+        const QRegularExpressionMatch match = it.next();
+        const qsizetype start = match.capturedStart();
+        if (start <= lastLineEnd) {
+            continue; // Line already reported
+        }
+        matched = true;
+
+        const qsizetype lineStart = start > 0 ? content.lastIndexOf(QLatin1Char('\n'), start - 1) + 1 : 0;
+        qsizetype lineEnd = content.indexOf(QLatin1Char('\n'), start);
+        if (lineEnd < 0) {
+            lineEnd = content.size();
+        }
+
+        matchedLines.append(QStringView(content).mid(lineStart, lineEnd - lineStart).trimmed().toString());
+        if (matchedLines.size() >= maxLines) {
+            break;
+        }
+        lastLineEnd = lineEnd;
+    }
+
+    return matched;
+}
+
+QStringList ContentMatcher::requiredLiterals(const QString &pattern)
+{
+    // Extended mode changes the meaning of whitespace and '#'
+    if (hasInlineOption(pattern, QLatin1Char('x'))) {
+        return QStringList();
+    }
+
+    QStringList literals;
+    QString current;
+    auto flush = [&literals, &current]() {
+        if (!current.isEmpty()) {
+            literals.append(current);
+            current.clear();
+        }
+    };
+
+    const int length = pattern.size();
+    int i = 0;
+    while (i < length) {
+        const QChar c = pattern.at(i);
+        QString atom; // Literal text of this atom, empty if it isn't one
+        int next = i + 1;
+
+        if (c == QLatin1Char('\\')) {
+            if (i + 1 >= length) {
+                return QStringList();
+            }
+            const QChar escaped = pattern.at(i + 1);
+            if (escaped == QLatin1Char('Q')) {
+                const int end = pattern.indexOf(QLatin1String("\\E"), i + 2);
+                atom = end < 0 ? pattern.mid(i + 2) : pattern.mid(i + 2, end - i - 2);
+                next = end < 0 ? length : end + 2;
+            } else if (escaped.isLetterOrNumber()) {
+                // Classes, anchors, back references and code points
+                next = skipEscapeArgument(pattern, i + 2);
+            } else {
+                atom = escaped;
+                next = i + 2;
+            }
+        } else if (c == QLatin1Char('[')) {
+            next = skipCharacterClass(pattern, i);
+        } else if (c == QLatin1Char('(')) {
+            next = skipGroup(pattern, i);
+        } else if (c == QLatin1Char('|')) {
+            // A top-level alternation means no single literal is mandatory
+            return QStringList();
+        } else if (c == QLatin1Char('.') || c == QLatin1Char('^') || c == QLatin1Char('$')
+                   || c == QLatin1Char(')') || c == QLatin1Char('*') || c == QLatin1Char('+')
+                   || c == QLatin1Char('?')) {
+            // Not a literal
+        } else {
+            atom = c;
+        }
+
+        // A quantifier applies to the preceding atom only
+        if (next < length) {
+            const QChar q = pattern.at(next);
+            bool quantified = false;
+            int minRepeat = 1;
+            int afterQuantifier = next;
+
+            if (q == QLatin1Char('*') || q == QLatin1Char('?')) {
+                quantified = true;
+                minRepeat = 0;
+                afterQuantifier = next + 1;
+            } else if (q == QLatin1Char('+')) {
+                quantified = true;
+                afterQuantifier = next + 1;
+            } else if (q == QLatin1Char('{')) {
+                int j = next + 1;
+                while (j < length && pattern.at(j).isDigit()) {
+                    ++j;
+                }
+                const QString minText = pattern.mid(next + 1, j - next - 1);
+                if (j < length && pattern.at(j) == QLatin1Char(',')) {
+                    ++j;
+                    while (j < length && pattern.at(j).isDigit()) {
+                        ++j;
+                    }
+                }
+                // Anything else is a literal '{' and handled as the next atom
+                if (j < length && pattern.at(j) == QLatin1Char('}') && j > next + 1) {
+                    quantified = true;
+                    minRepeat = minText.isEmpty() ? 0 : minText.toInt();
+                    afterQuantifier = j + 1;
+                }
+            }
+
+            if (quantified) {
+                // Lazy and possessive suffixes
+                if (afterQuantifier < length
+                    && (pattern.at(afterQuantifier) == QLatin1Char('?') || pattern.at(afterQuantifier) == QLatin1Char('+'))) {
+                    ++afterQuantifier;
+                }
+                if (minRepeat > 0) {
+                    current += atom;
+                } else if (atom.size() > 1) {
+                    // A quoted \Q...\E run only loses its last character
+                    current += atom.left(atom.size() - 1);
+                }
+                // Whatever follows is no longer adjacent to this run
+                flush();
+                i = afterQuantifier;
+                continue;
+            }
+        }
+
+        if (atom.isEmpty()) {
+            flush();
+        } else {
+            current += atom;
+        }
+        i = next;
+    }
+
+    flush();
+    return literals;
+}
+
+bool ContentMatcher::hasInlineOption(const QString &pattern, QChar option)
+{
+    qsizetype pos = pattern.indexOf(QLatin1String("(?"));
+    while (pos >= 0) {
+        for (qsizetype i = pos + 2; i < pattern.size(); ++i) {
+            const QChar c = pattern.at(i);
+            if (c == option) {
+                return true;
+            }
+            if (!c.isLetter()) {
+                break; // ':' '-' ')' or a named group
+            }
+        }
+        pos = pattern.indexOf(QLatin1String("(?"), pos + 2);
+    }
+    return false;
+}
+
+bool ContentMatcher::mayMatchLineBreak(const QString &pattern)
+{
+    // Dot matches newlines under (?s); so do whitespace, negated classes
+    // and escapes that may stand for any character
+    if (hasInlineOption(pattern, QLatin1Char('s')) || pattern.contains(QLatin1Char('\n'))
+        || pattern.contains(QLatin1String("[:space:]")) || pattern.contains(QLatin1String("[:cntrl:]"))
+        || pattern.contains(QLatin1String("[:^"))) {
+        return true;
+    }
+
+    const qsizetype length = pattern.size();
+    for (qsizetype i = 0; i + 1 < length; ++i) {
+        const QChar c = pattern.at(i);
+        if (c == QLatin1Char('[') && pattern.at(i + 1) == QLatin1Char('^')) {
+            return true;
+        }
+        if (c != QLatin1Char('\\')) {
+            continue;
+        }
+        const QChar escaped = pattern.at(i + 1);
+        if (escaped == QLatin1Char('Q')) {
+            const qsizetype end = pattern.indexOf(QLatin1String("\\E"), i + 2);
+            if (end < 0) {
+                break;
+            }
+            i = end + 1;
+            continue;
+        }
+        if (escaped.isDigit() || QStringLiteral("snrRvDWHpPxco").contains(escaped)) {
+            return true;
+        }
+        ++i;
+    }
+    return false;
+}
+
+int ContentMatcher::skipGroup(const QString &pattern, int pos)
+{
+    const int length = pattern.size();
+    int depth = 0;
+
+    for (int i = pos; i < length; ++i) {
+        const QChar c = pattern.at(i);
+        if (c == QLatin1Char('\\')) {
+            if (i + 1 < length && pattern.at(i + 1) == QLatin1Char('Q')) {
+                const int end = pattern.indexOf(QLatin1String("\\E"), i + 2);
+                i = end < 0 ? length : end + 1;
+            } else {
+                ++i;
+            }
+        } else if (c == QLatin1Char('[')) {
+            i = skipCharacterClass(pattern, i) - 1;
+        } else if (c == QLatin1Char('(')) {
+            ++depth;
+        } else if (c == QLatin1Char(')')) {
+            if (--depth == 0) {
+                return i + 1;
+            }
+        }
+    }
+
+    return length;
+}
+
+int ContentMatcher::skipCharacterClass(const QString &pattern, int pos)
+{
+    const int length = pattern.size();
+    int i = pos + 1;
+
+    if (i < length && pattern.at(i) == QLatin1Char('^')) {
+        ++i;
+    }
+    if (i < length && pattern.at(i) == QLatin1Char(']')) {
+        ++i; // A leading ']' is part of the class
+    }
+
+    while (i < length) {
+        const QChar c = pattern.at(i);
+        if (c == QLatin1Char('\\')) {
+            i += 2;
+            continue;
+        }
+        if (c == QLatin1Char('[') && i + 1 < length && pattern.at(i + 1) == QLatin1Char(':')) {
+            const int end = pattern.indexOf(QLatin1String(":]"), i + 2);
+            if (end >= 0) {
+                i = end + 2;
+                continue;
+            }
+        }
+        if (c == QLatin1Char(']')) {
+            return i + 1;
+        }
+        ++i;
+    }
+
+    return length;
+}
+
+int ContentMatcher::skipEscapeArgument(const QString &pattern, int pos)
+{
+    const int length = pattern.size();
+    const QChar letter = pattern.at(pos - 1);
+
+    if (pos < length && pattern.at(pos) == QLatin1Char('{')
+        && QStringLiteral("xpPNogku").contains(letter)) {
+        const int end = pattern.indexOf(QLatin1Char('}'), pos);
+        return end < 0 ? length : end + 1;
+    }
+
+    switch (letter.unicode()) {
+    case 'p':
+    case 'P':
+    case 'c':
+        return qMin(pos + 1, length);
+    case 'k':
+        if (pos < length && (pattern.at(pos) == QLatin1Char('<') || pattern.at(pos) == QLatin1Char('\''))) {
+            const QChar close = pattern.at(pos) == QLatin1Char('<') ? QLatin1Char('>') : QLatin1Char('\'');
+            const int end = pattern.indexOf(close, pos + 1);
+            return end < 0 ? length : end + 1;
+        }
+        return pos;
+    case 'x': {
+        int i = pos;
+        while (i < length && i < pos + 2 && isxdigit(pattern.at(i).toLatin1())) {
+            ++i;
+        }
+        return i;
+    }
+    default:
+        break;
+    }
+
+    // Back references and octal escapes
+    int i = pos;
+    while (i < length && pattern.at(i).isDigit() && letter.isDigit()) {
+        ++i;
+    }
+    if (letter == QLatin1Char('g')) {
+        if (i < length && pattern.at(i) == QLatin1Char('-')) {
+            ++i;
+        }
+        while (i < length && pattern.at(i).isDigit()) {
+            ++i;
+        }
+    }
+    return i;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <QStringView>
+#include <QRegularExpression>
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QHash>
+#include <QStringConverter>
+
+#include "SearchEngine.h"
+#include "AhoCorasick.h"
+#include "ProximityQuery.h"
+#include "Utf8Needle.h"
+
+// Compiled form of a content query. Built once per search so the regex is
+// compiled a single time and the literal prefilter can be reused for every
+// file that is scanned.
+class ContentMatcher
+{
+public:
+    explicit ContentMatcher(const SearchEngine::SearchCriteria &criteria);
+
+    bool isValid() const;
+    QString errorString() const;
+
+    // Returns true if the text matches and appends up to maxLines matching
+    // lines (trimmed) to matchedLines. Matching is line oriented: ^ and $
+    // anchor at line boundaries, as in grep. Phrase and NEAR queries match
+    // word positions instead (see ProximityQuery); their lines are those
+    // where a match starts. Case-insensitive plain queries of several
+    // subwords also match lines where they run through identifiers, so
+    // "search engine" matches SearchEngine (see IdentifierTokenizer).
+    bool matches(const QString &content, QStringList &matchedLines, int maxLines = 10) const;
+
+    // The same on file bytes. UTF-8 is searched as it is and only matching
+    // lines are decoded; other encodings are decoded first.
+    bool matches(const QByteArray &data, QStringList &matchedLines, int maxLines = 10) const;
+
+    // Multi-term queries (SearchCriteria::terms) are compiled into a single
+    // automaton and matched on UTF-8 bytes in one pass; files in other
+    // encodings are transcoded first. Ignoring case, terms match as plain
+    // queries do (see Utf8Needle), except that a term with very many
+    // case-variable letters only matches as written and case folded.
+    // termLines receives the 1-based line numbers at which each term occurs.
+    bool isMultiTerm() const;
+    bool isProximity() const;
+    bool matchesTerms(const QByteArray &data, QStringList &matchedLines,
+                      QHash<QString, QList<int>> &termLines, int maxLines = 10) const;
+
+    // Binary/text classification of the first buffer of a file: NUL bytes,
+    // control characters and UTF-8 validity. UTF-16/32 text, with a byte
+    // order mark or recognised without one, is never reported as binary.
+    static bool looksBinary(const QByteArray &head);
+
+    // Encoding of file bytes. A byte order mark decides; without one,
+    // mostly-ASCII UTF-16 shows in its NUL bytes, and bytes are taken for
+    // Latin-1 when more of them are invalid UTF-8 than valid. A few stray
+    // bytes keep UTF-8 and decode as replacement characters.
+    static QStringConverter::Encoding detectEncoding(QByteArrayView data);
+
+    // Decodes file bytes in the encoding detectEncoding() finds and
+    // normalises CRLF line endings.
+    static QString decodeText(const QByteArray &data);
+
+    // Literals that every match of the pattern must contain. Returns an empty
+    // list when nothing can be proven, e.g. for top-level alternations.
+    static QStringList requiredLiterals(const QString &pattern);
+
+private:
+    bool matchesPlain(const QString &content, QStringList &matchedLines, int maxLines) const;
+    bool matchesProximity(const QString &content, QStringList &matchedLines, int maxLines) const;
+    bool matchesIdentifiers(const QString &content, QStringList &matchedLines, int maxLines) const;
+    bool matchesRegexWithPrefilter(const QString &content, QStringList &matchedLines, int maxLines) const;
+    bool matchesRegexFullScan(const QString &content, QStringList &matchedLines, int maxLines) const;
+    bool matchesPlain(QByteArrayView text, QStringList &matchedLines, int maxLines) const;
+    bool matchesRegexWithPrefilter(QByteArrayView text, QStringList &matchedLines, int maxLines) const;
+
+    static QString decode(QByteArrayView data, QStringConverter::Encoding encoding);
+
+    static bool hasInlineOption(const QString &pattern, QChar option);
+    static bool mayMatchLineBreak(const QString &pattern);
+    static int skipGroup(const QString &pattern, int pos);
+    static int skipCharacterClass(const QString &pattern, int pos);
+    static int skipEscapeArgument(const QString &pattern, int pos);
+
+    static bool isWordByte(char byte);
+
+    QString m_query;
+    Qt::CaseSensitivity m_caseSensitivity;
+    bool m_useRegex;
+    bool m_wholeWords;
+
+    QStringList m_terms;
+    AhoCorasick m_termAutomaton;
+    QVector<int> m_patternTerms;    // Automaton pattern -> index in m_terms
+    static const int MAX_TERM_FORMS = 64;
+
+    ProximityQuery m_proximity;
+
+    QStringList m_subwords;         // Of a plain query that may run through identifiers
+    QString m_longestSubword;
+
+    // The query, subwords and literals for searching UTF-8 bytes
+    Utf8Needle m_queryNeedle;
+    QVector<Utf8Needle> m_subwordNeedles;
+    QVector<Utf8Needle> m_literalNeedles;
+    Utf8Needle m_longestLiteralNeedle;
+
+    QRegularExpression m_regex;
+    QStringList m_literals;
+    QString m_longestLiteral;
+    Qt::CaseSensitivity m_literalCaseSensitivity;
+    bool m_spansLines;              // The regex may match across lines
+};
@@ -0,0 +1,262 @@
+#include "DocumentText.h"
+#include "ArchiveReader.h"
+#include <QDeadlineTimer>
+#include <QRegularExpression>
+#include <QVector>
+#include <QXmlStreamReader>
+#include <algorithm>
+
+namespace {
+
+enum Dialect {
+    NoDocument,
+    OfficeOpenXml,
+    OpenDocument
+};
+
+Dialect dialectOf(const QString &fileName)
+{
+    const QString lower = fileName.toLower();
+    if (lower.endsWith(".docx") || lower.endsWith(".xlsx") || lower.endsWith(".pptx")) {
+        return OfficeOpenXml;
+    }
+    if (lower.endsWith(".odt") || lower.endsWith(".ods") || lower.endsWith(".odp")) {
+        return OpenDocument;
+    }
+    return NoDocument;
+}
+
+// The parts holding a document's text, in reading order
+QStringList partsOf(const QString &fileName, const QStringList &members)
+{
+    const QString lower = fileName.toLower();
+    if (lower.endsWith(".xlsx")) {
+        return QStringList() << "xl/sharedStrings.xml";
+    }
+    if (dialectOf(fileName) == OpenDocument) {
+        return QStringList() << "content.xml";
+    }
+
+    QStringList parts;
+    if (lower.endsWith(".docx")) {
+        static const QRegularExpression extra("^word/(header\\d*|footer\\d*|footnotes|endnotes)\\.xml$");
+        parts = members.filter(extra);
+        std::sort(parts.begin(), parts.end());
+        parts.prepend("word/document.xml");
+        return parts;
+    }
+
+    // slide10.xml comes after slide9.xml
+    static const QRegularExpression slide("^ppt/slides/slide(\\d+)\\.xml$");
+    QVector<QPair<int, QString>> slides;
+    for (const QString &member : members) {
+        const QRegularExpressionMatch match = slide.match(member);
+        if (match.hasMatch()) {
+            slides.append(qMakePair(match.captured(1).toInt(), member));
+        }
+    }
+    std::sort(slides.begin(), slides.end());
+    for (const auto &entry : slides) {
+        parts.append(entry.second);
+    }
+    return parts;
+}
+
+// Turns the elements of one part into text as the reader gets to them
+class PartParser
+{
+public:
+    PartParser(Dialect dialect, QString &text, qsizetype maxLength)
+        : m_dialect(dialect)
+        , m_text(text)
+        , m_maxLength(maxLength)
+        , m_collecting(0)
+        , m_runs(0)
+        , m_skipping(0)
+        , m_full(false)
+    {}
+
+    // False once the text is full or the part turns out broken
+    bool feed(const char *data, qint64 size)
+    {
+        m_reader.addData(QByteArray(data, qsizetype(size)));
+        while (!m_reader.atEnd() && !m_full) {
+            switch (m_reader.readNext()) {
+            case QXmlStreamReader::StartElement:
+                start(m_reader.name());
+                break;
+            case QXmlStreamReader::EndElement:
+                end(m_reader.name());
+                break;
+            case QXmlStreamReader::Characters:
+                if (m_collecting > 0) {
+                    append(m_reader.text());
+                }
+                break;
+            default:
+                break;
+            }
+        }
+        // Running out of data only means the next chunk is needed
+        return !m_full && !failed();
+    }
+
+    bool full() const
+    {
+        return m_full;
+    }
+
+    bool failed() const
+    {
+        return m_reader.hasError() && m_reader.error() != QXmlStreamReader::PrematureEndOfDocumentError;
+    }
+
+private:
+    // Office Open XML keeps text in t elements: w:t in documents, a:t in
+    // slides, t in shared strings. Tabs inside runs and breaks are text
+    // too; tab stops in paragraph properties and phonetic guides aren't.
+    // OpenDocument text is everything inside paragraphs and headings.
+    void start(QStringView name)
+    {
+        if (m_dialect == OfficeOpenXml) {
+            if (name == u"t") {
+                ++m_collecting;
+            } else if (name == u"r") {
+                ++m_runs;
+            } else if (name == u"rPh") {
+                ++m_skipping;
+            } else if (name == u"tab" && m_runs > 0) {
+                append(u"\t");
+            } else if (name == u"br" || name == u"cr") {
+                append(u"\n");
+            }
+            return;
+        }
+
+        if (name == u"p" || name == u"h") {
+            ++m_collecting;
+        } else if (m_collecting == 0) {
+            return;
+        } else if (name == u"s") {
+            // A run of c spaces, one if c is missing
+            int count = 1;
+            for (const QXmlStreamAttribute &attribute : m_reader.attributes()) {
+                if (attribute.name() == u"c") {
+                    count = qBound(1, attribute.value().toInt(), 1024);
+                }
+            }
+            append(QString(count, QLatin1Char(' ')));
+        } else if (name == u"tab") {
+            append(u"\t");
+        } else if (name == u"line-break") {
+            append(u"\n");
+        }
+    }
+
+    void end(QStringView name)
+    {
+        if (m_dialect == OfficeOpenXml) {
+            if (name == u"t") {
+                m_collecting = qMax(0, m_collecting - 1);
+            } else if (name == u"r") {
+                m_runs = qMax(0, m_runs - 1);
+            } else if (name == u"rPh") {
+                m_skipping = qMax(0, m_skipping - 1);
+            } else if (name == u"p" || name == u"si") {
+                append(u"\n");
+            }
+            return;
+        }
+
+        if (name == u"p" || name == u"h") {
+            m_collecting = qMax(0, m_collecting - 1);
+            append(u"\n");
+        }
+    }
+
+    void append(QStringView text)
+    {
+        if (m_skipping > 0 || m_full) {
+            return;
+        }
+        const qsizetype room = m_maxLength - m_text.size();
+        if (text.size() > room) {
+            m_text.append(text.left(qMax(qsizetype(0), room)));
+            m_full = true;
+            return;
+        }
+        m_text.append(text);
+    }
+
+    Dialect m_dialect;
+    QString &m_text;
+    qsizetype m_maxLength;
+    QXmlStreamReader m_reader;
+    int m_collecting;       // Depth of elements whose characters are text
+    int m_runs;
+    int m_skipping;         // Depth of elements whose text is left out
+    bool m_full;
+};
+
+}
+
+bool DocumentText::isDocument(const QString &fileName)
+{
+    return dialectOf(fileName) != NoDocument;
+}
+
+bool DocumentText::extract(const QString &path, QString &text, const Limits &limits, bool *complete)
+{
+    text.clear();
+    if (complete) {
+        *complete = true;
+    }
+    const Dialect dialect = dialectOf(path);
+    if (dialect == NoDocument) {
+        return false;
+    }
+
+    // One pass over the zip for all parts, in reading order; the byte
+    // budget spans them
+    const QDeadlineTimer deadline(limits.timeoutMs);
+    ArchiveReader::Limits archiveLimits;
+    archiveLimits.maxTotalBytes = limits.maxBytes;
+    bool found = false;
+    bool cut = false;
+    const ArchiveReader::MemberPicker pick = [&](const QStringList &members) {
+        return partsOf(path, members);
+    };
+    const bool read = ArchiveReader::streamZipMembers(path, pick, [&](const QString &,
+                                                                      const ArchiveReader::MemberStream &stream) {
+        found = true;
+        if (deadline.hasExpired()) {
+            cut = true;
+            return false;
+        }
+
+        PartParser parser(dialect, text, limits.maxLength);
+        const bool whole = stream([&](const char *data, qint64 size) {
+            if (deadline.hasExpired()) {
+                cut = true;
+                return false;
+            }
+            return parser.feed(data, size);
+        });
+
+        // A part that can't be read or parsed to its end may hide any text
+        if (!whole || parser.failed() || parser.full()) {
+            cut = true;
+        }
+        return !parser.full();
+    }, archiveLimits);
+
+    // Without any of the parts it's no document of its kind
+    if (!read || !found) {
+        text.clear();
+        return false;
+    }
+    if (complete) {
+        *complete = !cut;
+    }
+    return true;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <QString>
+
+// Plain text of office documents, which are zip files of XML parts and so
+// look binary to the content matcher. Office Open XML (.docx, .xlsx, .pptx)
+// and OpenDocument (.odt, .ods, .odp) files are handled:
+//
+//     .docx   word/document.xml, then headers, footers, footnotes, endnotes
+//     .xlsx   xl/sharedStrings.xml, the text cells of all sheets
+//     .pptx   ppt/slides/slideN.xml in slide order
+//     .od?    content.xml
+//
+// Parts are decompressed in chunks and fed to an incremental XML reader as
+// they come, so neither a part nor its markup is held in memory whole; only
+// the text is. Paragraphs, table cells and shared strings end in newlines.
+class DocumentText
+{
+public:
+    struct Limits {
+        int timeoutMs;          // Per document
+        qsizetype maxLength;    // Characters of text kept
+        qint64 maxBytes;        // Decompressed XML read, all parts together
+
+        Limits()
+            : timeoutMs(2000)
+            , maxLength(4 * 1024 * 1024)
+            , maxBytes(256 * 1024 * 1024)
+        {}
+    };
+
+    // By name
+    static bool isDocument(const QString &fileName);
+
+    // False if path can't be read as a document or has none of the parts
+    // its kind keeps text in. When the limits cut the text short, complete
+    // is set to false and text holds what was read.
+    static bool extract(const QString &path, QString &text, const Limits &limits = Limits(),
+                        bool *complete = nullptr);
+};
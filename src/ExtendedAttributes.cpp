@@ -0,0 +1,165 @@
+#include "ExtendedAttributes.h"
+#include <QByteArray>
+#include <QFile>
+#include <QStringDecoder>
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/xattr.h>
+
+namespace {
+
+const char TAGS_ATTRIBUTE[] = "xdg.tags";
+const char COMMENT_ATTRIBUTE[] = "xdg.comment";
+
+ssize_t listAttributes(const QByteArray &path, char *buffer, size_t size)
+{
+#ifdef Q_OS_MACOS
+    return ::listxattr(path.constData(), buffer, size, XATTR_NOFOLLOW);
+#else
+    return ::llistxattr(path.constData(), buffer, size);
+#endif
+}
+
+ssize_t readAttribute(const QByteArray &path, const char *name, char *buffer, size_t size)
+{
+#ifdef Q_OS_MACOS
+    return ::getxattr(path.constData(), name, buffer, size, 0, XATTR_NOFOLLOW);
+#else
+    return ::lgetxattr(path.constData(), name, buffer, size);
+#endif
+}
+
+// Attribute values are usually UTF-8 text; anything else is kept as bytes
+QVariant attributeValue(const QByteArray &bytes)
+{
+    QStringDecoder decoder(QStringDecoder::Utf8);
+    const QString text = decoder.decode(bytes);
+    if (decoder.hasError() || bytes.contains('\0')) {
+        return bytes;
+    }
+    return text;
+}
+
+}
+
+bool ExtendedAttributes::isEmpty() const
+{
+    return tags.isEmpty() && comment.isEmpty() && values.isEmpty();
+}
+
+ExtendedAttributes ExtendedAttributes::read(const QString &path)
+{
+    ExtendedAttributes attributes;
+    const QByteArray nativePath = QFile::encodeName(path);
+
+    // Names come back as one NUL-separated list; the value buffer is
+    // reused for every attribute of the file
+    QByteArray names(1024, Qt::Uninitialized);
+    ssize_t length = listAttributes(nativePath, names.data(), names.size());
+    if (length < 0 && errno == ERANGE) {
+        length = listAttributes(nativePath, nullptr, 0);
+        if (length > 0) {
+            names.resize(length);
+            length = listAttributes(nativePath, names.data(), names.size());
+        }
+    }
+    if (length <= 0) {
+        return attributes;
+    }
+
+    QByteArray value(256, Qt::Uninitialized);
+    for (const char *name = names.constData(); name < names.constData() + length; name += qstrlen(name) + 1) {
+#ifdef Q_OS_MACOS
+        const char *key = name;
+#else
+        // Only user.* attributes are user data; trusted., security. and
+        // system. belong to the kernel and access control
+        if (qstrncmp(name, "user.", 5) != 0) {
+            continue;
+        }
+        const char *key = name + 5;
+#endif
+
+        ssize_t size = readAttribute(nativePath, name, value.data(), value.size());
+        if (size < 0 && errno == ERANGE) {
+            size = readAttribute(nativePath, name, nullptr, 0);
+            if (size > 0) {
+                value.resize(size);
+                size = readAttribute(nativePath, name, value.data(), value.size());
+            }
+        }
+        if (size < 0) {
+            continue;
+        }
+
+        const QByteArray bytes(value.constData(), size);
+        if (qstrcmp(key, TAGS_ATTRIBUTE) == 0) {
+            attributes.tags = tagList(QString::fromUtf8(bytes));
+        } else if (qstrcmp(key, COMMENT_ATTRIBUTE) == 0) {
+            attributes.comment = QString::fromUtf8(bytes);
+        } else {
+            attributes.values.insert(QString::fromUtf8(key), attributeValue(bytes));
+        }
+    }
+
+    return attributes;
+}
+
+bool ExtendedAttributes::matches(const QHash<QString, QVariant> &wanted, const QString &text) const
+{
+    for (auto it = wanted.constBegin(); it != wanted.constEnd(); ++it) {
+        const QString key = it.key().toLower();
+        if (key == "tag" || key == "tags") {
+            for (const QString &tag : tagList(it.value())) {
+                if (!tags.contains(tag, Qt::CaseInsensitive)) {
+                    return false;
+                }
+            }
+        } else if (key == "comment") {
+            if (!comment.contains(it.value().toString(), Qt::CaseInsensitive)) {
+                return false;
+            }
+        } else {
+            auto value = values.constFind(it.key());
+            if (value == values.constEnd()) {
+                return false;
+            }
+            const QString required = it.value().toString();
+            if (!required.isEmpty() && value.value().toString().compare(required, Qt::CaseInsensitive) != 0) {
+                return false;
+            }
+        }
+    }
+
+    if (text.isEmpty()) {
+        return true;
+    }
+    for (const QString &tag : tags) {
+        if (tag.contains(text, Qt::CaseInsensitive)) {
+            return true;
+        }
+    }
+    if (comment.contains(text, Qt::CaseInsensitive)) {
+        return true;
+    }
+    for (auto it = values.constBegin(); it != values.constEnd(); ++it) {
+        if (it.value().typeId() == QMetaType::QString && it.value().toString().contains(text, Qt::CaseInsensitive)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+QStringList ExtendedAttributes::tagList(const QVariant &value)
+{
+    QStringList tags;
+    for (const QString &item : value.toStringList()) {
+        for (const QString &tag : item.split(',', Qt::SkipEmptyParts)) {
+            const QString trimmed = tag.trimmed();
+            if (!trimmed.isEmpty()) {
+                tags.append(trimmed);
+            }
+        }
+    }
+    return tags;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QVariant>
+
+// User-visible extended attributes of a file. On Linux these are the
+// user.* attributes: user.xdg.tags (comma separated) and user.xdg.comment
+// become tags and comment, every other one lands in values under its name
+// without the "user." prefix. On macOS all attributes are listed, keyed by
+// their full name.
+struct ExtendedAttributes
+{
+    QStringList tags;
+    QString comment;
+    QHash<QString, QVariant> values;
+
+    bool isEmpty() const;
+
+    // Reads the attributes of path itself, not of a symlink's target
+    static ExtendedAttributes read(const QString &path);
+
+    // wanted maps "tag"/"tags" to required tags, "comment" to text the
+    // comment must contain, and any other key to the value it must have
+    // (case-insensitive; an empty value only requires the key). text, if
+    // given, must occur in a tag, the comment or a value.
+    bool matches(const QHash<QString, QVariant> &wanted, const QString &text = QString()) const;
+
+    static QStringList tagList(const QVariant &value);
+};
@@ -1,4 +1,6 @@
 #include "FileIndexer.h"
+#include "ExtendedAttributes.h"
+#include "IdentifierTokenizer.h"
 #include <QDir>
 #include <QDirIterator>
 #include <QFileInfo>
@@ -8,6 +10,7 @@
 #include <QTimer>
 #include <QStandardPaths>
 #include <QMutexLocker>
+#include <QRegularExpression>
 #include <QtConcurrent>
 
 FileIndexer::FileIndexer(QObject *parent)
@@ -16,6 +19,8 @@ FileIndexer::FileIndexer(QObject *parent)
     , m_saveTimer(nullptr)
     , m_isIndexing(0)
     , m_isPaused(0)
+    , m_isComplete(0)
+    , m_indexArchives(false)
     , m_totalFiles(0)
     , m_processedFiles(0)
 {
@@ -37,9 +42,10 @@ void FileIndexer::startIndexing(const QString &basePath)
         return;
     }
     
-    m_basePath = basePath.isEmpty() ? QStandardPaths::writableLocation(QStandardPaths::HomeLocation) : basePath;
+    m_basePath = QDir::cleanPath(basePath.isEmpty() ? QStandardPaths::writableLocation(QStandardPaths::HomeLocation) : basePath);
     m_isIndexing.storeRelease(1);
     m_isPaused.storeRelease(0);
+    m_isComplete.storeRelease(0);
     m_processedFiles = 0;
     m_totalFiles = 0;
     
@@ -48,6 +54,9 @@ void FileIndexer::startIndexing(const QString &basePath)
     // Start indexing in background thread
     QFuture<void> future = QtConcurrent::run([this]() {
         indexDirectory(m_basePath);
+        if (m_isIndexing.loadAcquire()) {
+            m_isComplete.storeRelease(1);
+        }
         m_isIndexing.storeRelease(0);
         emit indexingCompleted();
     });
@@ -91,25 +100,66 @@ bool FileIndexer::isIndexing() const
     return m_isIndexing.loadAcquire();
 }
 
+bool FileIndexer::isIndexComplete() const
+{
+    return m_isComplete.loadAcquire();
+}
+
+QString FileIndexer::basePath() const
+{
+    QMutexLocker locker(const_cast<QMutex*>(&m_indexMutex));
+    
+    return m_basePath;
+}
+
 void FileIndexer::updateIndex(const QString &path)
 {
+    QFileInfo fileInfo(path);
+    const QList<IndexedFile> members = fileInfo.isFile() ? listArchive(path) : QList<IndexedFile>();
+    
     QMutexLocker locker(&m_indexMutex);
     
-    QFileInfo fileInfo(path);
     if (fileInfo.exists() && fileInfo.isFile()) {
         IndexedFile indexedFile = createIndexedFile(path);
-        m_fileIndex[path] = indexedFile;
-        m_indexedPaths.insert(path);
+        storeFile(indexedFile);
+        storeArchiveMembers(path, members);
         emit fileIndexed(indexedFile);
     }
 }
 
+void FileIndexer::refreshPath(const QString &path)
+{
+    const QFileInfo info(path);
+    if (info.isFile()) {
+        updateIndex(path);
+        return;
+    }
+    if (!info.isDir()) {
+        removeFromIndex(path);
+        return;
+    }
+    
+    // The directory keeps the mtime it was indexed with, so searches go on
+    // walking it for entries this doesn't cover
+    for (const QFileInfo &entry : QDir(path).entryInfoList(QDir::Files)) {
+        bool current = false;
+        {
+            QMutexLocker locker(&m_indexMutex);
+            auto indexed = m_fileIndex.constFind(entry.filePath());
+            current = indexed != m_fileIndex.constEnd() && indexed->size == entry.size()
+                && indexed->lastModified == entry.lastModified();
+        }
+        if (!current) {
+            updateIndex(entry.filePath());
+        }
+    }
+}
+
 void FileIndexer::removeFromIndex(const QString &path)
 {
     QMutexLocker locker(&m_indexMutex);
     
-    m_fileIndex.remove(path);
-    m_indexedPaths.remove(path);
+    dropFile(path);
 }
 
 void FileIndexer::clearIndex()
@@ -118,6 +168,41 @@ void FileIndexer::clearIndex()
     
     m_fileIndex.clear();
     m_indexedPaths.clear();
+    m_fileIds.clear();
+    m_idPaths.clear();
+    m_sizeColumn.clear();
+    m_modifiedColumn.clear();
+    m_accessedColumn.clear();
+    m_createdColumn.clear();
+    m_extensionBitmaps.clear();
+    for (RoaringBitmap &bitmap : m_categoryBitmaps) {
+        bitmap.clear();
+    }
+    m_tagIndex.clear();
+    m_commentWordIndex.clear();
+    m_attributeIndex.clear();
+    m_nameTokenIndex.clear();
+    m_directoryIds.clear();
+    m_idDirectories.clear();
+    m_directoryTokenIndex.clear();
+    m_archiveMembers.clear();
+    m_directorySummaries.clear();
+    m_isComplete.storeRelease(0);
+}
+
+void FileIndexer::setArchiveIndexing(bool enabled, const ArchiveReader::Limits &limits)
+{
+    QMutexLocker locker(&m_indexMutex);
+    
+    m_indexArchives = enabled;
+    m_archiveLimits = limits;
+}
+
+bool FileIndexer::isArchiveIndexingEnabled() const
+{
+    QMutexLocker locker(const_cast<QMutex*>(&m_indexMutex));
+    
+    return m_indexArchives;
 }
 
 QList<FileIndexer::IndexedFile> FileIndexer::searchIndex(const QString &query) const
@@ -144,6 +229,304 @@ QList<FileIndexer::IndexedFile> FileIndexer::searchIndex(const QString &query) c
     return results;
 }
 
+QStringList FileIndexer::filesMatching(const QString &root, const std::function<bool(const IndexedFile &)> &filter,
+                                       const QList<RangeQuery> &ranges, const QStringList &types) const
+{
+    QMutexLocker locker(const_cast<QMutex*>(&m_indexMutex));
+    
+    const QString prefix = root.endsWith('/') ? root : root + '/';
+    QStringList paths;
+    
+    // Candidates: the files of the requested types, intersected with the
+    // narrowest range. filter rechecks everything else.
+    bool restricted = false;
+    RoaringBitmap candidates;
+    if (!types.isEmpty()) {
+        candidates = typeBitmap(types);
+        restricted = true;
+    }
+    
+    int narrowest = -1;
+    int narrowestCount = m_fileIndex.size();
+    for (int i = 0; i < ranges.size(); ++i) {
+        const RangeQuery &range = ranges.at(i);
+        const int count = column(range.column).count(range.low, range.high);
+        if (count < narrowestCount) {
+            narrowest = i;
+            narrowestCount = count;
+        }
+    }
+    
+    // A range much wider than the type set isn't worth materializing
+    if (narrowest >= 0 && (!restricted || quint64(narrowestCount) < 4 * candidates.cardinality())) {
+        const RangeQuery &range = ranges.at(narrowest);
+        RoaringBitmap inRange;
+        for (quint32 id : column(range.column).range(range.low, range.high)) {
+            inRange.add(id);
+        }
+        candidates = restricted ? candidates & inRange : inRange;
+        restricted = true;
+    }
+    
+    if (restricted) {
+        candidates.forEach([&](quint32 id) {
+            const QString &path = m_idPaths.at(id);
+            if (!path.startsWith(prefix)) {
+                return;
+            }
+            auto it = m_fileIndex.constFind(path);
+            if (it != m_fileIndex.constEnd() && filter(it.value())) {
+                paths.append(path);
+            }
+        });
+        return paths;
+    }
+    
+    for (auto it = m_fileIndex.constBegin(); it != m_fileIndex.constEnd(); ++it) {
+        const IndexedFile &file = it.value();
+        if (file.path.startsWith(prefix) && filter(file)) {
+            paths.append(file.path);
+        }
+    }
+    return paths;
+}
+
+QStringList FileIndexer::filesInRange(RangeColumn rangeColumn, qint64 low, qint64 high) const
+{
+    QMutexLocker locker(const_cast<QMutex*>(&m_indexMutex));
+    
+    QStringList paths;
+    for (quint32 id : column(rangeColumn).range(low, high)) {
+        paths.append(m_idPaths.at(id));
+    }
+    return paths;
+}
+
+int FileIndexer::countInRange(RangeColumn rangeColumn, qint64 low, qint64 high) const
+{
+    QMutexLocker locker(const_cast<QMutex*>(&m_indexMutex));
+    
+    return column(rangeColumn).count(low, high);
+}
+
+void FileIndexer::setTypeCategories(const QHash<QString, QStringList> &categories)
+{
+    QMutexLocker locker(&m_indexMutex);
+    
+    m_categoryBitmaps.clear();
+    m_extensionCategories.clear();
+    for (auto it = categories.constBegin(); it != categories.constEnd(); ++it) {
+        const QString category = it.key().toLower();
+        RoaringBitmap &bitmap = m_categoryBitmaps[category];
+        for (const QString &extension : it.value()) {
+            const QString key = extension.toLower();
+            m_extensionCategories[key].append(category);
+            bitmap |= m_extensionBitmaps.value(key);
+        }
+    }
+}
+
+QStringList FileIndexer::filesWithMetadata(const QString &root, const QHash<QString, QVariant> &wanted,
+                                           const QString &text) const
+{
+    QMutexLocker locker(const_cast<QMutex*>(&m_indexMutex));
+    
+    // Every requirement narrows the candidates; the survivors are verified
+    // against the stored attributes
+    bool restricted = false;
+    RoaringBitmap candidates;
+    auto narrow = [&](const RoaringBitmap &bitmap) {
+        candidates = restricted ? candidates & bitmap : bitmap;
+        restricted = true;
+    };
+    
+    for (auto it = wanted.constBegin(); it != wanted.constEnd(); ++it) {
+        const QString key = it.key().toLower();
+        if (key == "tag" || key == "tags") {
+            for (const QString &tag : ExtendedAttributes::tagList(it.value())) {
+                narrow(m_tagIndex.value(tag.toLower()));
+            }
+        } else if (key == "comment") {
+            narrow(commentCandidates(it.value().toString()));
+        } else {
+            const QHash<QString, RoaringBitmap> values = m_attributeIndex.value(it.key());
+            const QString required = it.value().toString().toLower();
+            if (!required.isEmpty()) {
+                narrow(values.value(required));
+            } else {
+                RoaringBitmap any;
+                for (const RoaringBitmap &bitmap : values) {
+                    any |= bitmap;
+                }
+                narrow(any);
+            }
+        }
+    }
+    
+    if (!text.isEmpty()) {
+        const QString needle = text.toLower();
+        RoaringBitmap any = commentCandidates(text);
+        for (auto it = m_tagIndex.constBegin(); it != m_tagIndex.constEnd(); ++it) {
+            if (it.key().contains(needle)) {
+                any |= it.value();
+            }
+        }
+        for (const QHash<QString, RoaringBitmap> &values : m_attributeIndex) {
+            for (auto it = values.constBegin(); it != values.constEnd(); ++it) {
+                if (it.key().contains(needle)) {
+                    any |= it.value();
+                }
+            }
+        }
+        narrow(any);
+    }
+    
+    QStringList paths;
+    if (!restricted) {
+        return paths;
+    }
+    
+    const QString prefix = root.endsWith('/') ? root : root + '/';
+    candidates.forEach([&](quint32 id) {
+        const QString &path = m_idPaths.at(id);
+        if (!path.startsWith(prefix)) {
+            return;
+        }
+        const IndexedFile file = m_fileIndex.value(path);
+        const ExtendedAttributes attributes{file.tags, file.comment, file.metadata};
+        if (attributes.matches(wanted, text)) {
+            paths.append(path);
+        }
+    });
+    return paths;
+}
+
+QStringList FileIndexer::filesOfTypes(const QStringList &types) const
+{
+    QMutexLocker locker(const_cast<QMutex*>(&m_indexMutex));
+    
+    QStringList paths;
+    typeBitmap(types).forEach([&](quint32 id) {
+        paths.append(m_idPaths.at(id));
+    });
+    return paths;
+}
+
+QHash<QString, quint32> FileIndexer::fileNameCounts() const
+{
+    QMutexLocker locker(const_cast<QMutex*>(&m_indexMutex));
+    
+    QHash<QString, quint32> counts;
+    for (const IndexedFile &file : m_fileIndex) {
+        ++counts[file.name];
+    }
+    return counts;
+}
+
+QVector<quint64> FileIndexer::trigramKeys(QStringView text)
+{
+    QVector<quint64> keys;
+    const QString folded = text.toString().toCaseFolded();
+    if (folded.size() < 3) {
+        return keys;
+    }
+    keys.reserve(folded.size() - 2);
+    for (qsizetype i = 0; i + 3 <= folded.size(); ++i) {
+        keys.append(BloomFilter::hash(QStringView(folded).sliced(i, 3)));
+    }
+    return keys;
+}
+
+quint64 FileIndexer::extensionKey(QStringView extension)
+{
+    // The leading dot keeps extensions apart from trigrams of the same text
+    return BloomFilter::hash(QString('.' + extension.toString().toCaseFolded()));
+}
+
+bool FileIndexer::subtreeMayContain(const QString &directory, const NameProbe &probe) const
+{
+    if (!m_isComplete.loadAcquire()) {
+        return true;
+    }
+    
+    bool ruledOut = false;
+    {
+        QMutexLocker locker(const_cast<QMutex*>(&m_indexMutex));
+        
+        auto summary = m_directorySummaries.constFind(directory);
+        if (summary == m_directorySummaries.constEnd() || summary->modified == 0) {
+            return true;
+        }
+        
+        for (const QList<QVector<quint64>> &group : probe) {
+            bool satisfied = false;
+            for (const QVector<quint64> &keys : group) {
+                if (summary->names.mayContainAll(keys)) {
+                    satisfied = true;
+                    break;
+                }
+            }
+            if (!satisfied) {
+                ruledOut = true;
+                break;
+            }
+        }
+    }
+    if (!ruledOut) {
+        return true;
+    }
+    
+    // A directory's mtime only moves with its own entries, so a name added
+    // deep down shows on no ancestor; each directory is checked on its own.
+    // The stats run without the lock.
+    for (const QPair<QString, qint64> &indexed : directoriesBelow(directory)) {
+        if (!isUnchanged(indexed.first, indexed.second)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+QStringList FileIndexer::changedDirectories(const QString &root, QSet<QString> *unchanged) const
+{
+    QStringList changed;
+    for (const QPair<QString, qint64> &indexed : directoriesBelow(root)) {
+        if (!isUnchanged(indexed.first, indexed.second)) {
+            changed.append(indexed.first);
+        } else if (unchanged) {
+            unchanged->insert(indexed.first);
+        }
+    }
+    return changed;
+}
+
+QList<QPair<QString, qint64>> FileIndexer::directoriesBelow(const QString &root) const
+{
+    QMutexLocker locker(const_cast<QMutex*>(&m_indexMutex));
+    
+    // Root first, then the subdirectories the crawl entered, each with the
+    // mtime it was indexed at (0 if the crawl never got to it)
+    QList<QPair<QString, qint64>> directories;
+    QStringList pending(root);
+    while (!pending.isEmpty()) {
+        const QString path = pending.takeLast();
+        auto summary = m_directorySummaries.constFind(path);
+        if (summary == m_directorySummaries.constEnd()) {
+            directories.append(qMakePair(path, qint64(0)));
+            continue;
+        }
+        directories.append(qMakePair(path, summary->modified));
+        pending += summary->children;
+    }
+    return directories;
+}
+
+bool FileIndexer::isUnchanged(const QString &directory, qint64 modified)
+{
+    const QFileInfo info(directory);
+    return modified != 0 && info.exists() && info.lastModified().toMSecsSinceEpoch() == modified;
+}
+
 FileIndexer::IndexedFile FileIndexer::getIndexedFile(const QString &path) const
 {
     QMutexLocker locker(const_cast<QMutex*>(&m_indexMutex));
@@ -178,6 +561,13 @@ void FileIndexer::indexDirectory(const QString &path)
         return;
     }
     
+    // The base has no entry of its own in the walk below; its mtime vouches
+    // for the entries directly inside it
+    {
+        QMutexLocker locker(&m_indexMutex);
+        m_directorySummaries[path].modified = QFileInfo(path).lastModified().toMSecsSinceEpoch();
+    }
+    
     // First pass: count files for progress
     QDirIterator countIterator(path, QDir::Files, QDirIterator::Subdirectories);
     while (countIterator.hasNext() && m_isIndexing.loadAcquire()) {
@@ -185,8 +575,8 @@ void FileIndexer::indexDirectory(const QString &path)
         m_totalFiles++;
     }
     
-    // Second pass: index files
-    QDirIterator iterator(path, QDir::Files, QDirIterator::Subdirectories);
+    // Second pass: index files, and summarize directories on the way
+    QDirIterator iterator(path, QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
     while (iterator.hasNext() && m_isIndexing.loadAcquire()) {
         // Check if paused
         while (m_isPaused.loadAcquire() && m_isIndexing.loadAcquire()) {
@@ -198,6 +588,10 @@ void FileIndexer::indexDirectory(const QString &path)
         }
         
         QString filePath = iterator.next();
+        if (iterator.fileInfo().isDir()) {
+            indexDirectoryEntry(iterator.fileInfo());
+            continue;
+        }
         indexFile(filePath);
         
         m_processedFiles++;
@@ -217,12 +611,16 @@ void FileIndexer::indexDirectory(const QString &path)
 
 void FileIndexer::indexFile(const QString &path)
 {
+    // Archives are listed before the lock is taken, so searches don't wait
+    // for the decompression
+    const QList<IndexedFile> members = listArchive(path);
+    
     QMutexLocker locker(&m_indexMutex);
     
     try {
         IndexedFile indexedFile = createIndexedFile(path);
-        m_fileIndex[path] = indexedFile;
-        m_indexedPaths.insert(path);
+        storeFile(indexedFile);
+        storeArchiveMembers(path, members);
         
         emit fileIndexed(indexedFile);
     } catch (const std::exception &e) {
@@ -249,12 +647,398 @@ FileIndexer::IndexedFile FileIndexer::createIndexedFile(const QString &path)
     QMimeType mimeType = mimeDatabase.mimeTypeForFile(path);
     file.mimeType = mimeType.name();
     
-    // TODO: Extract tags and comments from extended attributes
-    // This would require macOS-specific code
+    // Tags, comment and other user attributes
+    ExtendedAttributes attributes = ExtendedAttributes::read(path);
+    file.tags = attributes.tags;
+    file.comment = attributes.comment;
+    file.metadata = attributes.values;
     
     return file;
 }
 
+QList<FileIndexer::IndexedFile> FileIndexer::listArchive(const QString &path) const
+{
+    QList<IndexedFile> members;
+    bool enabled;
+    ArchiveReader::Limits limits;
+    {
+        QMutexLocker locker(const_cast<QMutex*>(&m_indexMutex));
+        enabled = m_indexArchives;
+        limits = m_archiveLimits;
+    }
+    if (!enabled || !ArchiveReader::isArchive(path)) {
+        return members;
+    }
+    
+    // Directories inside archives only show in their members' paths
+    QMimeDatabase mimeDatabase;
+    ArchiveReader::forEachMember(path, [&](const ArchiveReader::Member &member, const ArchiveReader::ContentReader &) {
+        if (member.directory) {
+            return true;
+        }
+        IndexedFile file;
+        file.path = member.path;
+        file.name = member.path.mid(member.path.lastIndexOf('/') + 1);
+        file.extension = QFileInfo(file.name).suffix().toLower();
+        file.mimeType = mimeDatabase.mimeTypeForFile(file.name, QMimeDatabase::MatchExtension).name();
+        file.size = member.size;
+        file.lastModified = member.modified;
+        members.append(file);
+        return true;
+    }, limits);
+    return members;
+}
+
+void FileIndexer::storeFile(const IndexedFile &file)
+{
+    auto id = m_fileIds.constFind(file.path);
+    if (id == m_fileIds.constEnd()) {
+        id = m_fileIds.insert(file.path, static_cast<quint32>(m_idPaths.size()));
+        m_idPaths.append(file.path);
+    } else {
+        const IndexedFile previous = m_fileIndex.value(file.path);
+        removeFromColumns(previous, id.value());
+        removeFromTypeBitmaps(previous, id.value());
+        removeFromMetadataIndex(previous, id.value());
+        removeFromNameIndex(previous, id.value());
+    }
+    
+    m_fileIndex[file.path] = file;
+    m_indexedPaths.insert(file.path);
+    addToColumns(file, id.value());
+    addToTypeBitmaps(file, id.value());
+    addToMetadataIndex(file, id.value());
+    addToNameIndex(file, id.value());
+    addToDirectorySummaries(file.path, file.name);
+}
+
+void FileIndexer::storeArchiveMembers(const QString &archive, const QList<IndexedFile> &members)
+{
+    // The previous listing goes entirely; members can't be told apart by
+    // anything cheaper than listing the archive again
+    for (const QString &member : m_archiveMembers.take(archive)) {
+        dropFile(member);
+    }
+    if (members.isEmpty()) {
+        return;
+    }
+    
+    QStringList &paths = m_archiveMembers[archive];
+    for (const IndexedFile &member : members) {
+        storeFile(member);
+        paths.append(member.path);
+    }
+}
+
+void FileIndexer::dropFile(const QString &path)
+{
+    // An archive's members go with it
+    for (const QString &member : m_archiveMembers.take(path)) {
+        dropFile(member);
+    }
+    
+    auto id = m_fileIds.constFind(path);
+    if (id != m_fileIds.constEnd()) {
+        const IndexedFile file = m_fileIndex.value(path);
+        removeFromColumns(file, id.value());
+        removeFromTypeBitmaps(file, id.value());
+        removeFromMetadataIndex(file, id.value());
+        removeFromNameIndex(file, id.value());
+        m_idPaths[id.value()].clear();
+        m_fileIds.erase(id);
+    }
+    
+    m_fileIndex.remove(path);
+    m_indexedPaths.remove(path);
+}
+
+void FileIndexer::indexDirectoryEntry(const QFileInfo &directory)
+{
+    QMutexLocker locker(&m_indexMutex);
+    
+    // The walk doesn't enter linked directories, so they get no summary
+    const QString path = directory.filePath();
+    if (!directory.isSymLink()) {
+        m_directorySummaries[path].modified = directory.lastModified().toMSecsSinceEpoch();
+        if (!m_directoryIds.contains(path)) {
+            m_directorySummaries[directory.path()].children.append(path);
+        }
+    }
+    addToDirectorySummaries(path, directory.fileName());
+    
+    if (!m_directoryIds.contains(path)) {
+        const quint32 id = static_cast<quint32>(m_idDirectories.size());
+        m_directoryIds.insert(path, id);
+        m_idDirectories.append(path);
+        for (const QString &token : IdentifierTokenizer::tokens(directory.fileName())) {
+            m_directoryTokenIndex[token].add(id);
+        }
+    }
+}
+
+void FileIndexer::addToDirectorySummaries(const QString &path, const QString &name)
+{
+    // Members stay out: searches that look inside archives don't prune
+    const QString prefix = m_basePath.endsWith('/') ? m_basePath : m_basePath + '/';
+    if (!path.startsWith(prefix) || ArchiveReader::isVirtualPath(path)) {
+        return;
+    }
+    
+    QVector<quint64> keys = trigramKeys(name);
+    const qsizetype dot = name.lastIndexOf('.');
+    if (dot >= 0) {
+        keys.append(extensionKey(QStringView(name).sliced(dot + 1)));
+    }
+    
+    // Every directory from the parent up to the base sees the name
+    QString directory = path.left(path.lastIndexOf('/'));
+    while (directory.size() >= m_basePath.size() && !directory.isEmpty()) {
+        BloomFilter &filter = m_directorySummaries[directory].names;
+        for (quint64 key : keys) {
+            filter.add(key);
+        }
+        directory.truncate(directory.lastIndexOf('/'));
+    }
+}
+
+void FileIndexer::addToColumns(const IndexedFile &file, quint32 id)
+{
+    m_sizeColumn.insert(file.size, id);
+    if (file.lastModified.isValid()) {
+        m_modifiedColumn.insert(file.lastModified.toMSecsSinceEpoch(), id);
+    }
+    if (file.lastAccessed.isValid()) {
+        m_accessedColumn.insert(file.lastAccessed.toMSecsSinceEpoch(), id);
+    }
+    if (file.created.isValid()) {
+        m_createdColumn.insert(file.created.toMSecsSinceEpoch(), id);
+    }
+}
+
+void FileIndexer::removeFromColumns(const IndexedFile &file, quint32 id)
+{
+    m_sizeColumn.remove(file.size, id);
+    if (file.lastModified.isValid()) {
+        m_modifiedColumn.remove(file.lastModified.toMSecsSinceEpoch(), id);
+    }
+    if (file.lastAccessed.isValid()) {
+        m_accessedColumn.remove(file.lastAccessed.toMSecsSinceEpoch(), id);
+    }
+    if (file.created.isValid()) {
+        m_createdColumn.remove(file.created.toMSecsSinceEpoch(), id);
+    }
+}
+
+void FileIndexer::addToTypeBitmaps(const IndexedFile &file, quint32 id)
+{
+    m_extensionBitmaps[file.extension].add(id);
+    for (const QString &category : m_extensionCategories.value(file.extension)) {
+        m_categoryBitmaps[category].add(id);
+    }
+}
+
+void FileIndexer::removeFromTypeBitmaps(const IndexedFile &file, quint32 id)
+{
+    auto bitmap = m_extensionBitmaps.find(file.extension);
+    if (bitmap != m_extensionBitmaps.end()) {
+        bitmap->remove(id);
+        if (bitmap->isEmpty()) {
+            m_extensionBitmaps.erase(bitmap);
+        }
+    }
+    for (const QString &category : m_extensionCategories.value(file.extension)) {
+        m_categoryBitmaps[category].remove(id);
+    }
+}
+
+void FileIndexer::addToMetadataIndex(const IndexedFile &file, quint32 id)
+{
+    for (const QString &tag : file.tags) {
+        m_tagIndex[tag.toLower()].add(id);
+    }
+    for (const QString &word : commentWords(file.comment)) {
+        m_commentWordIndex[word].add(id);
+    }
+    for (auto it = file.metadata.constBegin(); it != file.metadata.constEnd(); ++it) {
+        if (it.value().typeId() == QMetaType::QString) {
+            m_attributeIndex[it.key()][it.value().toString().toLower()].add(id);
+        }
+    }
+}
+
+void FileIndexer::removeFromMetadataIndex(const IndexedFile &file, quint32 id)
+{
+    auto removeFrom = [id](QHash<QString, RoaringBitmap> &index, const QString &key) {
+        auto bitmap = index.find(key);
+        if (bitmap != index.end()) {
+            bitmap->remove(id);
+            if (bitmap->isEmpty()) {
+                index.erase(bitmap);
+            }
+        }
+    };
+    
+    for (const QString &tag : file.tags) {
+        removeFrom(m_tagIndex, tag.toLower());
+    }
+    for (const QString &word : commentWords(file.comment)) {
+        removeFrom(m_commentWordIndex, word);
+    }
+    for (auto it = file.metadata.constBegin(); it != file.metadata.constEnd(); ++it) {
+        auto values = m_attributeIndex.find(it.key());
+        if (values != m_attributeIndex.end() && it.value().typeId() == QMetaType::QString) {
+            removeFrom(*values, it.value().toString().toLower());
+            if (values->isEmpty()) {
+                m_attributeIndex.erase(values);
+            }
+        }
+    }
+}
+
+void FileIndexer::addToNameIndex(const IndexedFile &file, quint32 id)
+{
+    for (const QString &token : IdentifierTokenizer::tokens(file.name)) {
+        m_nameTokenIndex[token].add(id);
+    }
+}
+
+void FileIndexer::removeFromNameIndex(const IndexedFile &file, quint32 id)
+{
+    for (const QString &token : IdentifierTokenizer::tokens(file.name)) {
+        auto bitmap = m_nameTokenIndex.find(token);
+        if (bitmap != m_nameTokenIndex.end()) {
+            bitmap->remove(id);
+            if (bitmap->isEmpty()) {
+                m_nameTokenIndex.erase(bitmap);
+            }
+        }
+    }
+}
+
+RoaringBitmap FileIndexer::runCandidates(const QHash<QString, RoaringBitmap> &index, const QStringList &run)
+{
+    // Tokens inside the run are looked up directly; those at its ends may
+    // be parts of longer tokens and go through the vocabulary
+    RoaringBitmap candidates;
+    const int last = int(run.size()) - 1;
+    for (int i = 0; i <= last; ++i) {
+        const QString &token = run.at(i);
+        RoaringBitmap matching;
+        if (i > 0 && i < last) {
+            matching = index.value(token);
+        } else {
+            for (auto it = index.constBegin(); it != index.constEnd(); ++it) {
+                const bool matches = last == 0 ? it.key().contains(token)
+                                   : i == 0 ? it.key().endsWith(token)
+                                   : it.key().startsWith(token);
+                if (matches) {
+                    matching |= it.value();
+                }
+            }
+        }
+        candidates = i == 0 ? matching : candidates & matching;
+        if (candidates.isEmpty()) {
+            break;
+        }
+    }
+    return candidates;
+}
+
+bool FileIndexer::nameCandidates(const QString &root, const QString &query, QStringList &paths) const
+{
+    // Substring matches are runs of words; identifier matches runs of
+    // subwords. Both kinds of token share one index.
+    QList<QStringList> runs;
+    runs.append(IdentifierTokenizer::words(query));
+    const QStringList subwords = IdentifierTokenizer::subwords(query);
+    if (subwords.size() > 1 && subwords != runs.first()) {
+        runs.append(subwords);
+    }
+    if (runs.first().isEmpty()) {
+        return false;
+    }
+    
+    QMutexLocker locker(const_cast<QMutex*>(&m_indexMutex));
+    
+    RoaringBitmap files;
+    RoaringBitmap directories;
+    for (const QStringList &run : runs) {
+        files |= runCandidates(m_nameTokenIndex, run);
+        directories |= runCandidates(m_directoryTokenIndex, run);
+    }
+    
+    const QString prefix = root.endsWith('/') ? root : root + '/';
+    files.forEach([&](quint32 id) {
+        if (m_idPaths.at(id).startsWith(prefix)) {
+            paths.append(m_idPaths.at(id));
+        }
+    });
+    directories.forEach([&](quint32 id) {
+        if (m_idDirectories.at(id).startsWith(prefix)) {
+            paths.append(m_idDirectories.at(id));
+        }
+    });
+    return true;
+}
+
+RoaringBitmap FileIndexer::commentCandidates(const QString &text) const
+{
+    // Files with a comment word containing the longest word of text; the
+    // caller checks the full text
+    QString longest;
+    for (const QString &word : commentWords(text)) {
+        if (word.size() > longest.size()) {
+            longest = word;
+        }
+    }
+    
+    RoaringBitmap candidates;
+    for (auto it = m_commentWordIndex.constBegin(); it != m_commentWordIndex.constEnd(); ++it) {
+        if (it.key().contains(longest)) {
+            candidates |= it.value();
+        }
+    }
+    return candidates;
+}
+
+QStringList FileIndexer::commentWords(const QString &comment)
+{
+    static const QRegularExpression separators("[^\\w]+", QRegularExpression::UseUnicodePropertiesOption);
+    QStringList words = comment.toLower().split(separators, Qt::SkipEmptyParts);
+    words.removeDuplicates();
+    return words;
+}
+
+RoaringBitmap FileIndexer::typeBitmap(const QStringList &types) const
+{
+    RoaringBitmap result;
+    for (const QString &type : types) {
+        const QString key = type.toLower();
+        auto category = m_categoryBitmaps.constFind(key);
+        if (category != m_categoryBitmaps.constEnd()) {
+            result |= category.value();
+        } else {
+            result |= m_extensionBitmaps.value(key);
+        }
+    }
+    return result;
+}
+
+const SortedColumn &FileIndexer::column(RangeColumn rangeColumn) const
+{
+    switch (rangeColumn) {
+    case ModifiedColumn:
+        return m_modifiedColumn;
+    case AccessedColumn:
+        return m_accessedColumn;
+    case CreatedColumn:
+        return m_createdColumn;
+    case SizeColumn:
+    default:
+        return m_sizeColumn;
+    }
+}
+
 void FileIndexer::saveIndex()
 {
     QMutexLocker locker(&m_indexMutex);
@@ -10,6 +10,12 @@
 #include <QDateTime>
 #include <QStringList>
 #include <QAtomicInt>
+#include <functional>
+
+#include "SortedColumn.h"
+#include "RoaringBitmap.h"
+#include "BloomFilter.h"
+#include "ArchiveReader.h"
 
 class FileIndexer : public QObject
 {
@@ -30,6 +36,20 @@ public:
         QHash<QString, QVariant> metadata;
     };
 
+    // Columns with a sorted secondary index. Times are msecs since epoch.
+    enum RangeColumn {
+        SizeColumn,
+        ModifiedColumn,
+        AccessedColumn,
+        CreatedColumn
+    };
+
+    struct RangeQuery {
+        RangeColumn column;
+        qint64 low;     // Inclusive
+        qint64 high;    // Inclusive
+    };
+
     explicit FileIndexer(QObject *parent = nullptr);
     ~FileIndexer();
 
@@ -38,12 +58,80 @@ public:
     void pauseIndexing();
     void resumeIndexing();
     bool isIndexing() const;
+    // True once a full pass over basePath() has finished
+    bool isIndexComplete() const;
+    QString basePath() const;
 
     void updateIndex(const QString &path);
     void removeFromIndex(const QString &path);
     void clearIndex();
     
+    // Applies a change event: path is a file, or a directory whose entries
+    // changed. A directory's files are re-read where their size or mtime
+    // moved; new subdirectories stay unknown until the next crawl.
+    void refreshPath(const QString &path);
+    
+    // Members of zip and tar archives are indexed as files of their own,
+    // under virtual paths (see ArchiveReader) and within limits. Off by
+    // default, as listing opens every archive the crawl meets; takes effect
+    // for archives indexed afterwards.
+    void setArchiveIndexing(bool enabled, const ArchiveReader::Limits &limits = ArchiveReader::Limits());
+    bool isArchiveIndexingEnabled() const;
+    
     QList<IndexedFile> searchIndex(const QString &query) const;
+    // Paths of indexed files under root accepted by filter. Range queries
+    // are answered from the sorted columns first: only files inside the most
+    // selective range are passed to filter, which must recheck the others.
+    // A non-empty types list (extensions or category names) is intersected
+    // with that range through the type bitmaps.
+    QStringList filesMatching(const QString &root, const std::function<bool(const IndexedFile &)> &filter,
+                              const QList<RangeQuery> &ranges = QList<RangeQuery>(),
+                              const QStringList &types = QStringList()) const;
+    QStringList filesInRange(RangeColumn column, qint64 low, qint64 high) const;
+    int countInRange(RangeColumn column, qint64 low, qint64 high) const;
+    
+    // Type categories (e.g. "images" -> jpg, png, ...) get a bitmap of their
+    // own, kept up to date alongside the per-extension bitmaps
+    void setTypeCategories(const QHash<QString, QStringList> &categories);
+    QStringList filesOfTypes(const QStringList &types) const;
+    
+    // Files under root whose extended attributes match, answered from the
+    // inverted tag, comment and attribute indexes. Arguments as for
+    // ExtendedAttributes::matches(); with neither given nothing matches.
+    QStringList filesWithMetadata(const QString &root, const QHash<QString, QVariant> &wanted,
+                                  const QString &text = QString()) const;
+    
+    // How many indexed files carry each file name
+    QHash<QString, quint32> fileNameCounts() const;
+    
+    // Files and directories under root whose name may match query, as a
+    // substring or as an identifier (see IdentifierTokenizer), looked up in
+    // the name token index. Case insensitive; the caller verifies the
+    // names. False if query has no words to look up.
+    bool nameCandidates(const QString &root, const QString &query, QStringList &paths) const;
+    
+    // Every indexed directory summarizes the names below it in a Bloom
+    // filter of name trigrams and extensions, so a live walk can skip
+    // subtrees that cannot hold a match. A probe is a list of groups of
+    // alternatives: a subtree may hold a match only if every group has an
+    // alternative whose keys are all in its filter.
+    typedef QList<QList<QVector<quint64>>> NameProbe;
+    static QVector<quint64> trigramKeys(QStringView text);     // Empty below three characters
+    static quint64 extensionKey(QStringView extension);
+    
+    // False if the complete index proves no name below directory satisfies
+    // probe. The filters only know the names the crawl saw, so the proof
+    // also needs every directory of the subtree to have kept the mtime it
+    // was indexed with; that costs a stat per directory, paid only for
+    // subtrees the filter rules out.
+    bool subtreeMayContain(const QString &directory, const NameProbe &probe) const;
+    
+    // The index is a snapshot of the crawl. These are the directories from
+    // root down whose entries may have changed since: their mtime moved,
+    // or the crawl never got to them. The others go to unchanged if given.
+    // Costs a stat per indexed directory.
+    QStringList changedDirectories(const QString &root, QSet<QString> *unchanged = nullptr) const;
+    
     IndexedFile getIndexedFile(const QString &path) const;
     bool isFileIndexed(const QString &path) const;
     
@@ -67,6 +155,27 @@ private:
     void indexDirectory(const QString &path);
     void indexFile(const QString &path);
     IndexedFile createIndexedFile(const QString &path);
+    QList<IndexedFile> listArchive(const QString &path) const;
+    void storeFile(const IndexedFile &file);
+    void storeArchiveMembers(const QString &archive, const QList<IndexedFile> &members);
+    void dropFile(const QString &path);
+    void addToColumns(const IndexedFile &file, quint32 id);
+    void removeFromColumns(const IndexedFile &file, quint32 id);
+    const SortedColumn &column(RangeColumn column) const;
+    void addToTypeBitmaps(const IndexedFile &file, quint32 id);
+    void removeFromTypeBitmaps(const IndexedFile &file, quint32 id);
+    RoaringBitmap typeBitmap(const QStringList &types) const;
+    void addToMetadataIndex(const IndexedFile &file, quint32 id);
+    void removeFromMetadataIndex(const IndexedFile &file, quint32 id);
+    void addToNameIndex(const IndexedFile &file, quint32 id);
+    void removeFromNameIndex(const IndexedFile &file, quint32 id);
+    static RoaringBitmap runCandidates(const QHash<QString, RoaringBitmap> &index, const QStringList &run);
+    RoaringBitmap commentCandidates(const QString &text) const;
+    static QStringList commentWords(const QString &comment);
+    void indexDirectoryEntry(const QFileInfo &directory);
+    void addToDirectorySummaries(const QString &path, const QString &name);
+    QList<QPair<QString, qint64>> directoriesBelow(const QString &root) const;
+    static bool isUnchanged(const QString &directory, qint64 modified);
     void saveIndex();
     void loadIndex();
 
@@ -76,8 +185,50 @@ private:
     
     QHash<QString, IndexedFile> m_fileIndex;
     QSet<QString> m_indexedPaths;
+    
+    // Dense ids for the secondary indexes; ids of removed files stay unused
+    // until the index is cleared
+    QHash<QString, quint32> m_fileIds;
+    QVector<QString> m_idPaths;
+    SortedColumn m_sizeColumn;
+    SortedColumn m_modifiedColumn;
+    SortedColumn m_accessedColumn;
+    SortedColumn m_createdColumn;
+    
+    // File ids per lower-case extension and per type category
+    QHash<QString, RoaringBitmap> m_extensionBitmaps;
+    QHash<QString, RoaringBitmap> m_categoryBitmaps;
+    QHash<QString, QStringList> m_extensionCategories;
+    
+    // Inverted indexes over extended attributes: lower-case tag, lower-case
+    // comment word, and attribute name -> lower-case text value -> file ids
+    QHash<QString, RoaringBitmap> m_tagIndex;
+    QHash<QString, RoaringBitmap> m_commentWordIndex;
+    QHash<QString, QHash<QString, RoaringBitmap>> m_attributeIndex;
+    
+    // Name words and subwords -> file ids, and -> directory ids. Like the
+    // summaries, directories are only ever added until the next reindex.
+    QHash<QString, RoaringBitmap> m_nameTokenIndex;
+    QHash<QString, quint32> m_directoryIds;
+    QVector<QString> m_idDirectories;
+    QHash<QString, RoaringBitmap> m_directoryTokenIndex;
+    
+    // Archive path -> virtual paths of its members, nested ones included
+    QHash<QString, QStringList> m_archiveMembers;
+    bool m_indexArchives;
+    ArchiveReader::Limits m_archiveLimits;
+    
+    // Subtree name filters by directory path. Keys are only ever added, so
+    // removed files leave harmless false positives until the next reindex.
+    struct DirectorySummary {
+        BloomFilter names;
+        qint64 modified = 0;    // 0 until the walk has seen the directory
+        QStringList children;   // Indexed subdirectories; links aren't entered
+    };
+    QHash<QString, DirectorySummary> m_directorySummaries;
     QAtomicInt m_isIndexing;
     QAtomicInt m_isPaused;
+    QAtomicInt m_isComplete;
     
     QString m_basePath;
     int m_totalFiles;
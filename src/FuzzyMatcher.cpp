@@ -0,0 +1,256 @@
+#include "FuzzyMatcher.h"
+#include <cstring>
+
+namespace {
+
+// Scoring constants follow fzf's
+const int SCORE_MATCH = 16;
+const int SCORE_GAP_START = -3;
+const int SCORE_GAP_EXTENSION = -1;
+const int BONUS_BOUNDARY = SCORE_MATCH / 2;
+const int BONUS_NON_WORD = SCORE_MATCH / 2;
+const int BONUS_CAMEL_123 = BONUS_BOUNDARY + SCORE_GAP_EXTENSION;
+const int BONUS_CONSECUTIVE = -(SCORE_GAP_START + SCORE_GAP_EXTENSION);
+const int BONUS_FIRST_CHAR_MULTIPLIER = 2;
+
+}
+
+SearchEngine::FuzzyMatcher::FuzzyMatcher(const QString &query, bool caseSensitive)
+    : m_caseSensitive(caseSensitive)
+    , m_patternBits(0)
+{
+    m_query.reserve(query.size());
+    for (QChar ch : query) {
+        m_query.append(QChar(fold(ch.unicode())));
+    }
+
+    // Myers pattern bitmasks: bit i is set where query[i] == c
+    memset(m_peqAscii, 0, sizeof(m_peqAscii));
+    m_patternBits = qMin<int>(m_query.size(), 64);
+    for (int i = 0; i < m_patternBits; ++i) {
+        const char16_t c = m_query.at(i).unicode();
+        if (c < 128) {
+            m_peqAscii[c] |= quint64(1) << i;
+        } else {
+            m_peqOther[c] |= quint64(1) << i;
+        }
+    }
+}
+
+double SearchEngine::FuzzyMatcher::score(QStringView target) const
+{
+    if (m_query.isEmpty() || target.isEmpty()) {
+        return 0.0;
+    }
+
+    int subsequence = 0;
+    if (subsequenceScore(target, &subsequence)) {
+        const int m = m_query.size();
+        const double best = m * (SCORE_MATCH + BONUS_BOUNDARY) + BONUS_BOUNDARY * (BONUS_FIRST_CHAR_MULTIPLIER - 1);
+        return 0.4 + 0.6 * qBound(0.0, subsequence / best, 1.0);
+    }
+
+    const int allowed = maxTypos();
+    if (allowed == 0) {
+        return 0.0;
+    }
+    const int distance = editDistance(target);
+    if (distance > allowed) {
+        return 0.0;
+    }
+    return 0.3 * (1.0 - double(distance) / (allowed + 1));
+}
+
+bool SearchEngine::FuzzyMatcher::matches(QStringView target, double threshold) const
+{
+    return score(target) > threshold;
+}
+
+int SearchEngine::FuzzyMatcher::maxTypos() const
+{
+    // One typo per four characters, none for very short queries
+    return m_query.size() < 4 ? 0 : qMin(3, static_cast<int>(m_query.size()) / 4);
+}
+
+int SearchEngine::FuzzyMatcher::editDistance(QStringView target) const
+{
+    const int m = m_patternBits;
+    if (m == 0) {
+        return 0;
+    }
+
+    // Myers (1999), with a free start position in the target so the query
+    // may match any substring of it.
+    const quint64 highBit = quint64(1) << (m - 1);
+    quint64 pv = ~quint64(0);
+    quint64 mv = 0;
+    int current = m;
+    int best = m;
+
+    for (QChar ch : target) {
+        const quint64 eq = peq(fold(ch.unicode()));
+        const quint64 xv = eq | mv;
+        const quint64 xh = (((eq & pv) + pv) ^ pv) | eq;
+        quint64 ph = mv | ~(xh | pv);
+        quint64 mh = pv & xh;
+
+        if (ph & highBit) {
+            ++current;
+        } else if (mh & highBit) {
+            --current;
+        }
+
+        ph <<= 1;
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+
+        if (current < best) {
+            best = current;
+            if (best == 0) {
+                break;
+            }
+        }
+    }
+
+    return best;
+}
+
+bool SearchEngine::FuzzyMatcher::subsequenceScore(QStringView target, int *score) const
+{
+    const int m = m_query.size();
+    const int n = target.size();
+    if (m == 0 || m > n) {
+        return false;
+    }
+
+    // Forward pass finds where the first complete subsequence ends
+    int queryIndex = 0;
+    int end = -1;
+    for (int i = 0; i < n; ++i) {
+        if (fold(target.at(i).unicode()) == m_query.at(queryIndex).unicode()) {
+            if (++queryIndex == m) {
+                end = i;
+                break;
+            }
+        }
+    }
+    if (end < 0) {
+        return false;
+    }
+
+    // Backward pass from there tightens the window start
+    int start = 0;
+    queryIndex = m - 1;
+    for (int i = end; i >= 0; --i) {
+        if (fold(target.at(i).unicode()) == m_query.at(queryIndex).unicode()) {
+            if (--queryIndex < 0) {
+                start = i;
+                break;
+            }
+        }
+    }
+
+    int total = 0;
+    int consecutive = 0;
+    int firstBonus = 0;
+    bool inGap = false;
+    queryIndex = 0;
+    CharClass previous = start > 0 ? charClass(target.at(start - 1).unicode()) : NonWord;
+
+    for (int i = start; i <= end; ++i) {
+        const char16_t c = target.at(i).unicode();
+        const CharClass current = charClass(c);
+
+        if (queryIndex < m && fold(c) == m_query.at(queryIndex).unicode()) {
+            int bonus = bonusFor(previous, current);
+            if (consecutive == 0) {
+                firstBonus = bonus;
+            } else {
+                // A chunk keeps the bonus of its first character
+                if (bonus >= BONUS_BOUNDARY && bonus > firstBonus) {
+                    firstBonus = bonus;
+                }
+                bonus = qMax(qMax(bonus, firstBonus), BONUS_CONSECUTIVE);
+            }
+
+            total += SCORE_MATCH + (queryIndex == 0 ? bonus * BONUS_FIRST_CHAR_MULTIPLIER : bonus);
+            inGap = false;
+            ++consecutive;
+            ++queryIndex;
+        } else {
+            total += inGap ? SCORE_GAP_EXTENSION : SCORE_GAP_START;
+            inGap = true;
+            consecutive = 0;
+            firstBonus = 0;
+        }
+        previous = current;
+    }
+
+    *score = total;
+    return true;
+}
+
+SearchEngine::FuzzyMatcher::CharClass SearchEngine::FuzzyMatcher::charClass(char16_t c)
+{
+    if (c < 128) {
+        if (c >= 'a' && c <= 'z') {
+            return Lower;
+        }
+        if (c >= 'A' && c <= 'Z') {
+            return Upper;
+        }
+        if (c >= '0' && c <= '9') {
+            return Number;
+        }
+        if (c == '/' || c == '_' || c == '-' || c == '.' || c == ' ' || c == ',' || c == ':' || c == ';') {
+            return Delimiter;
+        }
+        return NonWord;
+    }
+
+    const QChar ch(c);
+    if (ch.isLower()) {
+        return Lower;
+    }
+    if (ch.isUpper()) {
+        return Upper;
+    }
+    if (ch.isLetter()) {
+        return Letter;
+    }
+    if (ch.isDigit()) {
+        return Number;
+    }
+    return ch.isSpace() ? Delimiter : NonWord;
+}
+
+int SearchEngine::FuzzyMatcher::bonusFor(CharClass previous, CharClass current)
+{
+    if (current > Delimiter) {
+        if (previous == NonWord || previous == Delimiter) {
+            return BONUS_BOUNDARY;
+        }
+        if ((previous == Lower && current == Upper) || (previous != Number && current == Number)) {
+            return BONUS_CAMEL_123;
+        }
+        return 0;
+    }
+    return BONUS_NON_WORD;
+}
+
+char16_t SearchEngine::FuzzyMatcher::fold(char16_t c) const
+{
+    if (m_caseSensitive) {
+        return c;
+    }
+    if (c < 128) {
+        return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+    }
+    return QChar(c).toCaseFolded().unicode();
+}
+
+quint64 SearchEngine::FuzzyMatcher::peq(char16_t c) const
+{
+    return c < 128 ? m_peqAscii[c] : m_peqOther.value(c, 0);
+}
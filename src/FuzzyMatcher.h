@@ -0,0 +1,54 @@
+#pragma once
+
+#include <QString>
+#include <QStringView>
+#include <QHash>
+
+#include "SearchEngine.h"
+
+// Fuzzy name matcher compiled once per query. Subsequence matches are scored
+// fzf-style, with bonuses for word boundaries and camelCase humps; names that
+// are not a subsequence can still match through Myers' bit-parallel edit
+// distance, which tolerates a few typos.
+class SearchEngine::FuzzyMatcher
+{
+public:
+    explicit FuzzyMatcher(const QString &query, bool caseSensitive = false);
+
+    // Score in [0, 1], 0 meaning no match. Subsequence matches always rank
+    // above typo-only matches.
+    double score(QStringView target) const;
+    bool matches(QStringView target, double threshold = 0.0) const;
+
+    // Smallest number of edits that turns the query into a substring of the
+    // target. Only the first 64 query characters are considered.
+    int editDistance(QStringView target) const;
+
+    // fzf-style score of the tightest window containing the query as a
+    // subsequence. Returns false if the query is not a subsequence.
+    bool subsequenceScore(QStringView target, int *score) const;
+
+    int maxTypos() const;
+
+private:
+    enum CharClass {
+        NonWord,
+        Delimiter,
+        Lower,
+        Upper,
+        Letter,
+        Number
+    };
+
+    static CharClass charClass(char16_t c);
+    static int bonusFor(CharClass previous, CharClass current);
+
+    char16_t fold(char16_t c) const;
+    quint64 peq(char16_t c) const;
+
+    QString m_query;
+    bool m_caseSensitive;
+    int m_patternBits;
+    quint64 m_peqAscii[128];
+    QHash<char16_t, quint64> m_peqOther;
+};
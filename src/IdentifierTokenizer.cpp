@@ -0,0 +1,74 @@
+#include "IdentifierTokenizer.h"
+#include "ProximityQuery.h"
+
+QStringList IdentifierTokenizer::words(QStringView text)
+{
+    QStringList words;
+    ProximityQuery::forEachWord(text, [&](qsizetype start, qsizetype length) {
+        words.append(text.sliced(start, length).toString().toCaseFolded());
+    });
+    return words;
+}
+
+QStringList IdentifierTokenizer::subwords(QStringView text)
+{
+    QStringList subwords;
+    ProximityQuery::forEachWord(text, [&](qsizetype start, qsizetype length) {
+        const QStringView word = text.sliced(start, length);
+        forEachSubword(word, [&](qsizetype subStart, qsizetype subLength) {
+            subwords.append(word.sliced(subStart, subLength).toString().toCaseFolded());
+        });
+    });
+    return subwords;
+}
+
+QStringList IdentifierTokenizer::tokens(QStringView text)
+{
+    QStringList tokens = words(text) + subwords(text);
+    tokens.removeDuplicates();
+    return tokens;
+}
+
+bool IdentifierTokenizer::containsRun(const QStringList &text, const QStringList &query)
+{
+    if (query.isEmpty()) {
+        return false;
+    }
+    if (query.size() == 1) {
+        for (const QString &token : text) {
+            if (token.contains(query.first())) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const int last = int(query.size()) - 1;
+    for (int start = 0; start + last < text.size(); ++start) {
+        if (!text.at(start).endsWith(query.first()) || !text.at(start + last).startsWith(query.last())) {
+            continue;
+        }
+        bool equal = true;
+        for (int i = 1; i < last && equal; ++i) {
+            equal = text.at(start + i) == query.at(i);
+        }
+        if (equal) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool IdentifierTokenizer::extendsRun(const QStringList &query, const QStringList &previous)
+{
+    if (previous.isEmpty() || previous.size() > query.size()) {
+        return false;
+    }
+    const int last = int(previous.size()) - 1;
+    for (int i = 0; i < last; ++i) {
+        if (query.at(i) != previous.at(i)) {
+            return false;
+        }
+    }
+    return query.at(last).startsWith(previous.at(last));
+}
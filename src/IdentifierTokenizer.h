@@ -0,0 +1,59 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <QStringView>
+
+// Splits file names and source text the way identifiers are written.
+// Words are runs of letters and digits, so snake_case, kebab-case and
+// dotted names fall apart at their separators; subwords split words
+// further at case changes and at letter/digit boundaries:
+//
+//     SearchEngine.h  -> words searchengine, h;  subwords search, engine, h
+//     HTTPServer2     -> subwords http, server, 2
+//
+// Everything is case folded. A query matches an identifier when its
+// tokens are a consecutive run of the identifier's, under either split, so
+// "search engine" finds SearchEngine.h and "indexer" FileIndexer.cpp.
+class IdentifierTokenizer
+{
+public:
+    static QStringList words(QStringView text);
+    static QStringList subwords(QStringView text);
+
+    // Distinct words and subwords, for indexing
+    static QStringList tokens(QStringView text);
+
+    // True if query is a run of consecutive tokens of text: the first query
+    // token may end a token, the last may begin one and those between must
+    // be equal. A lone query token may lie anywhere inside a token.
+    static bool containsRun(const QStringList &text, const QStringList &query);
+
+    // True if every text containing a run of query also contains one of
+    // previous: previous's tokens begin query's, the last maybe cut short.
+    // A query that grows doesn't always grow its tokens that way: XMLP is
+    // one subword, XMLPa two (xml, pa).
+    static bool extendsRun(const QStringList &query, const QStringList &previous);
+
+    // Calls visit(start, length) for every subword of a word
+    template<typename Visitor>
+    static void forEachSubword(QStringView word, Visitor visit)
+    {
+        qsizetype start = 0;
+        for (qsizetype i = 1; i < word.size(); ++i) {
+            const QChar previous = word.at(i - 1);
+            const QChar current = word.at(i);
+            const bool caseChange = previous.isLower() && current.isUpper();
+            const bool acronymEnd = previous.isUpper() && current.isUpper()
+                && i + 1 < word.size() && word.at(i + 1).isLower();
+            const bool digitChange = previous.isDigit() != current.isDigit();
+            if (caseChange || acronymEnd || digitChange) {
+                visit(start, i - start);
+                start = i;
+            }
+        }
+        if (start < word.size()) {
+            visit(start, word.size() - start);
+        }
+    }
+};
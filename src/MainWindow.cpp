@@ -50,6 +50,8 @@ MainWindow::MainWindow(QWidget *parent)
     , m_searchTimer(nullptr)
     , m_currentHistoryIndex(-1)
     , m_isSearchMode(false)
+    , m_searchJob(0)
+    , m_searchResultCount(0)
     , m_showHiddenFiles(false)
     , m_indexingThread(nullptr)
     , m_contextMenu(nullptr)
@@ -62,6 +64,7 @@ MainWindow::MainWindow(QWidget *parent)
     m_fileSystemModel = std::make_unique<FileSystemModel>(this);
     m_searchEngine = std::make_unique<SearchEngine>(this);
     m_fileIndexer = std::make_unique<FileIndexer>(this);
+    m_searchEngine->setFileIndexer(m_fileIndexer.get());
     m_advancedSearch = std::make_unique<AdvancedSearch>(this);
     m_macOSIntegration = std::make_unique<MacOSIntegration>(this);
     
@@ -339,9 +342,10 @@ void MainWindow::setupConnections()
     // Search
     connect(m_searchField, &QLineEdit::textChanged, this, &MainWindow::onSearchTextChanged);
     connect(m_advancedSearchButton, &QPushButton::clicked, this, &MainWindow::onAdvancedSearchRequested);
-    connect(m_searchTimer, &QTimer::timeout, [this]() {
+    connect(m_searchTimer, &QTimer::timeout, this, [this]() {
         if (!m_searchField->text().isEmpty()) {
-            m_searchEngine->search(m_searchField->text(), m_currentPath);
+            m_searchResultCount = 0;
+            m_searchJob = m_searchEngine->search(m_searchField->text(), m_currentPath);
         }
     });
     
@@ -359,8 +363,13 @@ void MainWindow::setupConnections()
             this, &MainWindow::onFileSelectionChanged);
     
     // Search engine
+    connect(m_searchEngine.get(), &SearchEngine::resultsFound, this, &MainWindow::onResultsFound);
     connect(m_searchEngine.get(), &SearchEngine::searchCompleted, this, &MainWindow::onSearchCompleted);
-    connect(m_searchEngine.get(), &SearchEngine::searchProgress, m_searchProgress, &QProgressBar::setValue);
+    connect(m_searchEngine.get(), &SearchEngine::searchProgress, this, [this](int percentage, quint64 jobId) {
+        if (jobId == m_searchJob) {
+            m_searchProgress->setValue(percentage);
+        }
+    });
     
     // File indexer
     connect(m_fileIndexer.get(), &FileIndexer::indexingProgress, this, &MainWindow::onIndexingProgress);
@@ -371,6 +380,16 @@ void MainWindow::setupFileWatcher()
 {
     m_fileWatcher = new QFileSystemWatcher(this);
     connect(m_fileWatcher, &QFileSystemWatcher::directoryChanged, this, &MainWindow::onDirectoryChanged);
+    connect(m_fileWatcher, &QFileSystemWatcher::directoryChanged, m_searchEngine.get(), &SearchEngine::invalidatePath);
+    
+    // Native change events reach beyond the watched directory
+    connect(m_macOSIntegration.get(), &MacOSIntegration::fileSystemEventOccurred, this,
+            [this](const MacOSIntegration::FileSystemEventInfo &event) {
+        m_searchEngine->invalidatePath(event.path);
+        if (!event.oldPath.isEmpty()) {
+            m_searchEngine->invalidatePath(event.oldPath);
+        }
+    });
 }
 
 void MainWindow::onDirectoryChanged(const QString &path)
@@ -407,9 +426,24 @@ void MainWindow::onSearchTextChanged(const QString &text)
     }
 }
 
-void MainWindow::onSearchCompleted(const QList<SearchEngine::SearchResult> &results)
+void MainWindow::onResultsFound(const QList<SearchEngine::SearchResult> &results, quint64 jobId)
 {
+    if (jobId != m_searchJob) {
+        return;
+    }
+    // Batches arrive while the walk runs; the count shows before the
+    // ranked list does
+    m_searchResultCount += results.size();
+    m_statusWidget->showMessage(QString("%1 results so far").arg(m_searchResultCount), 0);
+}
+
+void MainWindow::onSearchCompleted(const QList<SearchEngine::SearchResult> &results, quint64 jobId)
+{
+    if (jobId != m_searchJob) {
+        return;
+    }
     m_searchProgress->setVisible(false);
+    m_statusWidget->showMessage(QString("%1 results").arg(results.size()));
     // Update view with search results
     // This would require a custom model for search results
     qDebug() << "Search completed with" << results.size() << "results";
@@ -42,7 +42,8 @@ private slots:
     void onDirectoryChanged(const QString &path);
     void onFileSelectionChanged(const QModelIndex &current, const QModelIndex &previous);
     void onSearchTextChanged(const QString &text);
-    void onSearchCompleted(const QList<SearchEngine::SearchResult> &results);
+    void onResultsFound(const QList<SearchEngine::SearchResult> &results, quint64 jobId);
+    void onSearchCompleted(const QList<SearchEngine::SearchResult> &results, quint64 jobId);
     void onIndexingProgress(int progress);
     void onIndexingCompleted();
     void onAdvancedSearchRequested();
@@ -130,6 +131,8 @@ private:
     // State
     QString m_currentPath;
     bool m_isSearchMode;
+    quint64 m_searchJob;        // The search whose results are shown
+    int m_searchResultCount;    // Found so far by m_searchJob
     bool m_showHiddenFiles;
     
     // Threading
@@ -0,0 +1,199 @@
+#include "ProximityQuery.h"
+#include <QRegularExpression>
+#include <algorithm>
+
+namespace {
+
+const int MAX_DISTANCE = 10000;
+
+struct Operand {
+    QString text;
+    bool quoted;
+};
+
+// Quoted strings and whitespace separated words; an unbalanced quote runs
+// to the end of the text
+QList<Operand> splitOperands(const QString &text)
+{
+    QList<Operand> operands;
+    QString current;
+    bool quoted = false;
+    auto flush = [&](bool wasQuoted) {
+        if (!current.isEmpty()) {
+            operands.append({current, wasQuoted});
+            current.clear();
+        }
+    };
+    for (QChar ch : text) {
+        if (ch == '"') {
+            flush(quoted);
+            quoted = !quoted;
+        } else if (ch.isSpace() && !quoted) {
+            flush(false);
+        } else {
+            current.append(ch);
+        }
+    }
+    flush(quoted);
+    return operands;
+}
+
+}
+
+ProximityQuery::ProximityQuery()
+    : m_caseSensitivity(Qt::CaseInsensitive)
+{
+}
+
+ProximityQuery ProximityQuery::parse(const QString &text, Qt::CaseSensitivity cs)
+{
+    static const QRegularExpression nearPattern("^NEAR(?:/(\\d+))?$");
+
+    ProximityQuery query;
+    query.m_caseSensitivity = cs;
+
+    // Quotes alone only make a phrase of a query that is one quoted string.
+    // Inside other text, as in #include "config.h", they are searched for.
+    const QString trimmed = text.trimmed();
+    const bool wholeQuoted = trimmed.size() > 2 && trimmed.startsWith('"') && trimmed.endsWith('"')
+        && trimmed.count('"') == 2;
+
+    const QList<Operand> operands = splitOperands(text);
+    bool sawNear = false;
+
+    QList<Phrase> phrases;
+    Phrase current{QStringList(), -1};
+    for (const Operand &operand : operands) {
+        const QRegularExpressionMatch near = operand.quoted ? QRegularExpressionMatch()
+                                                            : nearPattern.match(operand.text);
+        if (near.hasMatch()) {
+            // NEAR needs a phrase on both sides
+            if (current.words.isEmpty()) {
+                return ProximityQuery();
+            }
+            sawNear = true;
+            phrases.append(current);
+            current.words.clear();
+            current.distance = near.capturedLength(1) > 0
+                ? qMin(near.captured(1).toInt(), MAX_DISTANCE) : DEFAULT_DISTANCE;
+            continue;
+        }
+
+        // Juxtaposed operands continue the phrase
+        forEachWord(operand.text, [&](qsizetype start, qsizetype length) {
+            current.words.append(query.normalizedWord(QStringView(operand.text).sliced(start, length)));
+        });
+    }
+    if (current.words.isEmpty() || (!wholeQuoted && !sawNear)) {
+        return ProximityQuery();
+    }
+    phrases.append(current);
+
+    query.m_phrases = phrases;
+    return query;
+}
+
+bool ProximityQuery::isValid() const
+{
+    return !m_phrases.isEmpty();
+}
+
+const QList<ProximityQuery::Phrase> &ProximityQuery::phrases() const
+{
+    return m_phrases;
+}
+
+QStringList ProximityQuery::words() const
+{
+    QStringList words;
+    for (const Phrase &phrase : m_phrases) {
+        for (const QString &word : phrase.words) {
+            if (!words.contains(word)) {
+                words.append(word);
+            }
+        }
+    }
+    return words;
+}
+
+QString ProximityQuery::normalizedWord(QStringView word) const
+{
+    return m_caseSensitivity == Qt::CaseInsensitive ? word.toString().toCaseFolded() : word.toString();
+}
+
+QList<ProximityQuery::Span> ProximityQuery::find(const PositionLookup &positions, int maxMatches) const
+{
+    QList<Span> matches;
+    if (m_phrases.isEmpty()) {
+        return matches;
+    }
+
+    // One chain per partial match: where its latest phrase is, and what the
+    // whole match covers. Chains stay ordered by their latest phrase.
+    struct Chain {
+        Span last;
+        Span whole;
+    };
+    QVector<Chain> chains;
+    const quint32 firstLength = quint32(m_phrases.first().words.size());
+    for (quint32 start : phraseStarts(m_phrases.first(), positions)) {
+        const Span span{start, start + firstLength};
+        chains.append({span, span});
+    }
+
+    for (int i = 1; i < m_phrases.size() && !chains.isEmpty(); ++i) {
+        const Phrase &phrase = m_phrases.at(i);
+        const quint32 length = quint32(phrase.words.size());
+        const quint32 previousLength = quint32(m_phrases.at(i - 1).words.size());
+        const quint32 reach = quint32(phrase.distance);
+
+        QVector<Chain> extended;
+        for (quint32 start : phraseStarts(phrase, positions)) {
+            const Span span{start, start + length};
+
+            // Every chain whose latest phrase starts in this window is within
+            // reach on one side; it only has to not overlap
+            const quint32 low = start > reach + previousLength ? start - reach - previousLength : 0;
+            auto chain = std::lower_bound(chains.cbegin(), chains.cend(), low, [](const Chain &c, quint32 value) {
+                return c.last.begin < value;
+            });
+            for (; chain != chains.cend() && chain->last.begin <= span.end + reach; ++chain) {
+                if (chain->last.end <= span.begin || chain->last.begin >= span.end) {
+                    extended.append({span, {qMin(chain->whole.begin, span.begin), qMax(chain->whole.end, span.end)}});
+                    break;
+                }
+            }
+        }
+        chains = extended;
+    }
+
+    for (const Chain &chain : chains) {
+        if (maxMatches >= 0 && matches.size() >= maxMatches) {
+            break;
+        }
+        matches.append(chain.whole);
+    }
+    return matches;
+}
+
+QVector<quint32> ProximityQuery::phraseStarts(const Phrase &phrase, const PositionLookup &positions) const
+{
+    // Positions of the first word whose successors follow one by one
+    QVector<quint32> starts = positions(phrase.words.first());
+    for (int i = 1; i < phrase.words.size() && !starts.isEmpty(); ++i) {
+        const QVector<quint32> following = positions(phrase.words.at(i));
+        QVector<quint32> kept;
+        auto next = following.cbegin();
+        for (quint32 start : starts) {
+            next = std::lower_bound(next, following.cend(), start + quint32(i));
+            if (next == following.cend()) {
+                break;
+            }
+            if (*next == start + quint32(i)) {
+                kept.append(start);
+            }
+        }
+        starts = kept;
+    }
+    return starts;
+}
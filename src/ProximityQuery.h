@@ -0,0 +1,78 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <QStringView>
+#include <QVector>
+#include <QList>
+#include <functional>
+
+// Content query over word positions: phrases joined by NEAR, e.g.
+//
+//     "connection reset by peer"
+//     timeout NEAR/5 retry
+//     "connection reset" NEAR peer
+//
+// A quoted string or a run of bare words is a phrase whose words must be
+// adjacent; punctuation between them is ignored. NEAR/n allows at most n
+// words between two phrases, in either order, and NEAR alone allows
+// DEFAULT_DISTANCE. Only a query with NEAR, or one that is a single quoted
+// string, is a proximity query; other text keeps substring semantics,
+// quotes included.
+//
+// Word positions count every word of a file, as produced by forEachWord(),
+// so the content index and a scan of the file text agree on them.
+class ProximityQuery
+{
+public:
+    struct Phrase {
+        QStringList words;
+        int distance;           // Most words between this phrase and the previous one
+    };
+
+    // Word positions covered by one match; end is exclusive
+    struct Span {
+        quint32 begin;
+        quint32 end;
+    };
+
+    typedef std::function<QVector<quint32>(const QString &word)> PositionLookup;
+
+    ProximityQuery();
+
+    // Words are case folded unless the search is case sensitive
+    static ProximityQuery parse(const QString &text, Qt::CaseSensitivity cs = Qt::CaseInsensitive);
+
+    bool isValid() const;
+    const QList<Phrase> &phrases() const;
+    QStringList words() const;          // Distinct
+    QString normalizedWord(QStringView word) const;
+
+    // Matches in one document. positions(word) returns the ascending
+    // positions of word; maxMatches < 0 finds all of them.
+    QList<Span> find(const PositionLookup &positions, int maxMatches = -1) const;
+
+    // Calls visit(start, length) for every run of letters and digits
+    template<typename Visitor>
+    static void forEachWord(QStringView text, Visitor visit)
+    {
+        qsizetype start = -1;
+        for (qsizetype i = 0; i <= text.size(); ++i) {
+            const bool word = i < text.size() && text.at(i).isLetterOrNumber();
+            if (word && start < 0) {
+                start = i;
+            } else if (!word && start >= 0) {
+                visit(start, i - start);
+                start = -1;
+            }
+        }
+    }
+
+    static const int DEFAULT_DISTANCE = 10;
+
+private:
+    QVector<quint32> phraseStarts(const Phrase &phrase, const PositionLookup &positions) const;
+
+    QList<Phrase> m_phrases;
+    Qt::CaseSensitivity m_caseSensitivity;
+};
@@ -0,0 +1,536 @@
+#include "QueryPlan.h"
+#include <QDate>
+#include <QDateTime>
+#include <QRegularExpression>
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+const qint64 UNBOUNDED_LOW = std::numeric_limits<qint64>::min();
+const qint64 UNBOUNDED_HIGH = std::numeric_limits<qint64>::max();
+
+QString rangeSource(const QString &key, qint64 low, qint64 high)
+{
+    return QString("%1:%2..%3").arg(key).arg(low).arg(high);
+}
+
+}
+
+QueryPlan::QueryPlan()
+    : m_statStart(0)
+{
+}
+
+QueryPlan::QueryPlan(const SearchEngine::SearchCriteria &criteria, const QHash<QString, QStringList> &typeExtensions)
+    : m_statStart(0)
+{
+    // Regular expressions keep their text untouched; "a:b" may be part of one
+    if (criteria.useRegex || criteria.type == SearchEngine::RegexSearch) {
+        m_text = criteria.query;
+    } else {
+        QStringList text;
+        bool parsedAny = false;
+        QList<bool> quoted;
+        const QStringList tokens = splitTokens(criteria.query, &quoted);
+        for (int i = 0; i < tokens.size(); ++i) {
+            const QString &token = tokens.at(i);
+            if (parseToken(token, typeExtensions)) {
+                parsedAny = true;
+            } else if (quoted.at(i) && criteria.type == SearchEngine::ContentSearch) {
+                // Quotes make a phrase query of the content text
+                text.append('"' + token + '"');
+            } else {
+                text.append(token);
+            }
+        }
+        m_text = parsedAny ? text.join(' ') : criteria.query;
+    }
+
+    // Filters set through SearchCriteria go through the same planner
+    if (!criteria.fileTypes.isEmpty()) {
+        Predicate predicate{Extension, false, QStringList(), UNBOUNDED_LOW, UNBOUNDED_HIGH, QString()};
+        for (const QString &type : criteria.fileTypes) {
+            const QString key = type.toLower();
+            predicate.values += typeExtensions.contains(key) ? typeExtensions.value(key) : QStringList(key);
+        }
+        predicate.values.sort();
+        predicate.values.removeDuplicates();
+        predicate.source = "ext:" + predicate.values.join(',');
+        addPredicate(predicate);
+    }
+
+    for (const QString &pattern : criteria.excludePatterns) {
+        Predicate predicate{Name, true, QStringList(pattern), UNBOUNDED_LOW, UNBOUNDED_HIGH,
+                            "-name:" + pattern.toLower()};
+        addPredicate(predicate);
+    }
+
+    if (criteria.useSizeFilter && (criteria.minSize > 0 || criteria.maxSize > 0)) {
+        Predicate predicate{Size, false, QStringList(), criteria.minSize > 0 ? criteria.minSize : 0,
+                            criteria.maxSize > 0 ? criteria.maxSize : UNBOUNDED_HIGH, QString()};
+        predicate.source = rangeSource("size", predicate.low, predicate.high);
+        addPredicate(predicate);
+    }
+
+    if (criteria.useDateFilter && (criteria.dateFrom.isValid() || criteria.dateTo.isValid())) {
+        Predicate predicate{Modified, false, QStringList(),
+                            criteria.dateFrom.isValid() ? criteria.dateFrom.toMSecsSinceEpoch() : UNBOUNDED_LOW,
+                            criteria.dateTo.isValid() ? criteria.dateTo.toMSecsSinceEpoch() : UNBOUNDED_HIGH,
+                            QString()};
+        predicate.source = rangeSource("modified", predicate.low, predicate.high);
+        addPredicate(predicate);
+    }
+
+    // Cheap before expensive, then most selective first
+    std::stable_sort(m_predicates.begin(), m_predicates.end(), [](const Predicate &a, const Predicate &b) {
+        if (a.cost() != b.cost()) {
+            return a.cost() < b.cost();
+        }
+        return a.selectivity() < b.selectivity();
+    });
+
+    m_statStart = m_predicates.size();
+    for (int i = 0; i < m_predicates.size(); ++i) {
+        if (m_predicates.at(i).cost() == StatCost) {
+            m_statStart = i;
+            break;
+        }
+    }
+}
+
+QueryPlan::Cost QueryPlan::Predicate::cost() const
+{
+    return (field == Size || field == Modified) ? StatCost : EntryCost;
+}
+
+double QueryPlan::Predicate::selectivity() const
+{
+    // Rough share of entries that pass; only the relative order matters
+    double passing = 1.0;
+    switch (field) {
+    case Extension:
+        passing = qMin(1.0, 0.05 * values.size());
+        break;
+    case Name:
+        passing = 0.1;
+        break;
+    case Path:
+        passing = 0.3;
+        break;
+    case Size:
+        passing = 0.3;
+        break;
+    case Modified:
+        passing = 0.2;
+        break;
+    }
+    return negated ? 1.0 - passing : passing;
+}
+
+bool QueryPlan::isValid() const
+{
+    return m_error.isEmpty();
+}
+
+QString QueryPlan::errorString() const
+{
+    return m_error;
+}
+
+QString QueryPlan::text() const
+{
+    return m_text;
+}
+
+const QList<QueryPlan::Predicate> &QueryPlan::predicates() const
+{
+    return m_predicates;
+}
+
+bool QueryPlan::isEmpty() const
+{
+    return m_predicates.isEmpty();
+}
+
+bool QueryPlan::needsStat() const
+{
+    return m_statStart < m_predicates.size();
+}
+
+bool QueryPlan::filesOnly() const
+{
+    for (const Predicate &predicate : m_predicates) {
+        if (!predicate.negated && predicate.field != Name && predicate.field != Path) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool QueryPlan::implies(const QueryPlan &other) const
+{
+    for (const Predicate &required : other.m_predicates) {
+        bool implied = false;
+        for (const Predicate &predicate : m_predicates) {
+            if (implies(predicate, required)) {
+                implied = true;
+                break;
+            }
+        }
+        if (!implied) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool QueryPlan::matchesEntry(QStringView fileName, QStringView filePath) const
+{
+    for (int i = 0; i < m_statStart; ++i) {
+        if (!matches(m_predicates.at(i), fileName, filePath)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool QueryPlan::matchesStat(qint64 size, qint64 modifiedMSecs) const
+{
+    for (int i = m_statStart; i < m_predicates.size(); ++i) {
+        const Predicate &predicate = m_predicates.at(i);
+        const qint64 value = predicate.field == Size ? size : modifiedMSecs;
+        const bool inRange = value >= predicate.low && value <= predicate.high;
+        if (inRange == predicate.negated) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool QueryPlan::parseToken(const QString &token, const QHash<QString, QStringList> &typeExtensions)
+{
+    const bool negated = token.startsWith('-');
+    const QString body = negated ? token.mid(1) : token;
+    const int colon = body.indexOf(':');
+    if (colon <= 0) {
+        return false;
+    }
+
+    const QString key = body.left(colon).toLower();
+    const QString value = body.mid(colon + 1);
+
+    Predicate predicate{Name, negated, QStringList(), UNBOUNDED_LOW, UNBOUNDED_HIGH, QString()};
+    QString canonicalKey;
+    if (key == "name") {
+        predicate.field = Name;
+        canonicalKey = "name";
+    } else if (key == "ext" || key == "extension") {
+        predicate.field = Extension;
+        canonicalKey = "ext";
+    } else if (key == "path") {
+        predicate.field = Path;
+        canonicalKey = "path";
+    } else if (key == "size") {
+        predicate.field = Size;
+        canonicalKey = "size";
+    } else if (key == "modified" || key == "mtime") {
+        predicate.field = Modified;
+        canonicalKey = "modified";
+    } else {
+        return false; // Not a field, e.g. "C:" or "http:"; keep it as text
+    }
+
+    if (value.isEmpty()) {
+        m_error = QString("Missing value for %1:").arg(key);
+        return true;
+    }
+
+    const QString prefix = negated ? "-" : "";
+    switch (predicate.field) {
+    case Name:
+    case Path:
+        predicate.values.append(value);
+        predicate.source = prefix + canonicalKey + ":" + value.toLower();
+        break;
+    case Extension:
+        for (QString extension : value.split(',', Qt::SkipEmptyParts)) {
+            extension = extension.toLower();
+            if (extension.startsWith('.')) {
+                extension.remove(0, 1);
+            }
+            predicate.values += typeExtensions.contains(extension) ? typeExtensions.value(extension)
+                                                                     : QStringList(extension);
+        }
+        predicate.values.sort();
+        predicate.values.removeDuplicates();
+        predicate.source = prefix + canonicalKey + ":" + predicate.values.join(',');
+        break;
+    case Size:
+        if (!parseSize(value, predicate)) {
+            m_error = QString("Invalid size: %1").arg(value);
+            return true;
+        }
+        predicate.source = prefix + rangeSource(canonicalKey, predicate.low, predicate.high);
+        break;
+    case Modified:
+        if (!parseModified(value, predicate)) {
+            m_error = QString("Invalid date: %1").arg(value);
+            return true;
+        }
+        predicate.source = prefix + rangeSource(canonicalKey, predicate.low, predicate.high);
+        break;
+    }
+
+    addPredicate(predicate);
+    return true;
+}
+
+bool QueryPlan::parseSize(const QString &value, Predicate &predicate)
+{
+    const int range = value.indexOf("..");
+    if (range >= 0) {
+        qint64 low = 0;
+        qint64 high = 0;
+        if (!parseByteCount(value.left(range), low) || !parseByteCount(value.mid(range + 2), high)) {
+            return false;
+        }
+        predicate.low = low;
+        predicate.high = high;
+        return low <= high;
+    }
+
+    QString number = value;
+    QString op;
+    parseComparison(number, op);
+    qint64 bytes = 0;
+    if (!parseByteCount(number, bytes)) {
+        return false;
+    }
+
+    // Counts are never negative, so only bytes + 1 can overflow
+    if (op == ">" && bytes == UNBOUNDED_HIGH) {
+        return false;
+    }
+    if (op == ">") {
+        predicate.low = bytes + 1;
+    } else if (op == ">=") {
+        predicate.low = bytes;
+    } else if (op == "<") {
+        predicate.low = 0;
+        predicate.high = bytes - 1;
+    } else if (op == "<=") {
+        predicate.low = 0;
+        predicate.high = bytes;
+    } else {
+        predicate.low = bytes;
+        predicate.high = bytes;
+    }
+    return true;
+}
+
+bool QueryPlan::parseModified(const QString &value, Predicate &predicate)
+{
+    QString text = value;
+    QString op;
+    parseComparison(text, op);
+
+    // Relative ages: "<7d" is newer than seven days, ">7d" older
+    static const QRegularExpression agePattern("^(\\d+)(s|min|h|d|w|y)$",
+                                               QRegularExpression::CaseInsensitiveOption);
+    const QRegularExpressionMatch age = agePattern.match(text);
+    if (age.hasMatch()) {
+        const QString unit = age.captured(2).toLower();
+        qint64 unitMSecs = 1000;
+        if (unit == "min") {
+            unitMSecs = 60 * 1000LL;
+        } else if (unit == "h") {
+            unitMSecs = 3600 * 1000LL;
+        } else if (unit == "d") {
+            unitMSecs = 86400 * 1000LL;
+        } else if (unit == "w") {
+            unitMSecs = 7 * 86400 * 1000LL;
+        } else if (unit == "y") {
+            unitMSecs = 365 * 86400 * 1000LL;
+        }
+        const qint64 boundary = QDateTime::currentMSecsSinceEpoch() - age.captured(1).toLongLong() * unitMSecs;
+        if (op == ">" || op == ">=") {
+            predicate.high = boundary;
+        } else {
+            predicate.low = boundary;
+        }
+        return true;
+    }
+
+    // Calendar dates in local time: ">2024-01-31" is after that day
+    const QDate date = QDate::fromString(text, Qt::ISODate);
+    if (!date.isValid()) {
+        return false;
+    }
+    const qint64 dayStart = date.startOfDay().toMSecsSinceEpoch();
+    const qint64 dayEnd = date.addDays(1).startOfDay().toMSecsSinceEpoch() - 1;
+    if (op == ">") {
+        predicate.low = dayEnd + 1;
+    } else if (op == ">=") {
+        predicate.low = dayStart;
+    } else if (op == "<") {
+        predicate.high = dayStart - 1;
+    } else if (op == "<=") {
+        predicate.high = dayEnd;
+    } else {
+        predicate.low = dayStart;
+        predicate.high = dayEnd;
+    }
+    return true;
+}
+
+void QueryPlan::addPredicate(const Predicate &predicate)
+{
+    for (const Predicate &existing : m_predicates) {
+        if (existing.source == predicate.source) {
+            return;
+        }
+    }
+    m_predicates.append(predicate);
+}
+
+QStringList QueryPlan::splitTokens(const QString &query, QList<bool> *quoted)
+{
+    // Whitespace separated; double quotes group words, as in name:"my file"
+    QStringList tokens;
+    QString current;
+    bool inQuotes = false;
+    bool hadQuotes = false;
+    auto flush = [&]() {
+        if (!current.isEmpty()) {
+            tokens.append(current);
+            if (quoted) {
+                quoted->append(hadQuotes);
+            }
+            current.clear();
+        }
+        hadQuotes = false;
+    };
+    for (QChar ch : query) {
+        if (ch == '"') {
+            inQuotes = !inQuotes;
+            hadQuotes = true;
+        } else if (ch.isSpace() && !inQuotes) {
+            flush();
+        } else {
+            current.append(ch);
+        }
+    }
+    flush();
+    return tokens;
+}
+
+bool QueryPlan::parseComparison(QString &value, QString &op)
+{
+    static const char *const operators[] = {">=", "<=", ">", "<", "="};
+    for (const char *candidate : operators) {
+        if (value.startsWith(QLatin1String(candidate))) {
+            op = QLatin1String(candidate);
+            value.remove(0, op.size());
+            return true;
+        }
+    }
+    op.clear();
+    return false;
+}
+
+bool QueryPlan::parseByteCount(const QString &value, qint64 &bytes)
+{
+    static const QRegularExpression sizePattern("^(\\d+(?:\\.\\d+)?)([kmgt]?)b?$",
+                                                QRegularExpression::CaseInsensitiveOption);
+    const QRegularExpressionMatch match = sizePattern.match(value.trimmed());
+    if (!match.hasMatch()) {
+        return false;
+    }
+
+    double amount = match.captured(1).toDouble();
+    const QString unit = match.captured(2).toLower();
+    if (unit == "k") {
+        amount *= 1024.0;
+    } else if (unit == "m") {
+        amount *= 1024.0 * 1024.0;
+    } else if (unit == "g") {
+        amount *= 1024.0 * 1024.0 * 1024.0;
+    } else if (unit == "t") {
+        amount *= 1024.0 * 1024.0 * 1024.0 * 1024.0;
+    }
+    // Converting a double beyond qint64 is undefined; no file is that big
+    if (amount >= static_cast<double>(std::numeric_limits<qint64>::max())) {
+        return false;
+    }
+    bytes = static_cast<qint64>(amount);
+    return true;
+}
+
+bool QueryPlan::matches(const Predicate &predicate, QStringView fileName, QStringView filePath)
+{
+    bool found = false;
+    switch (predicate.field) {
+    case Name:
+        found = fileName.contains(predicate.values.first(), Qt::CaseInsensitive);
+        break;
+    case Path:
+        found = filePath.contains(predicate.values.first(), Qt::CaseInsensitive);
+        break;
+    case Extension:
+        {
+            const qsizetype dot = fileName.lastIndexOf('.');
+            if (dot >= 0) {
+                const QStringView suffix = fileName.sliced(dot + 1);
+                for (const QString &extension : predicate.values) {
+                    if (suffix.compare(extension, Qt::CaseInsensitive) == 0) {
+                        found = true;
+                        break;
+                    }
+                }
+            }
+        }
+        break;
+    case Size:
+    case Modified:
+        found = true; // Decided by matchesStat
+        break;
+    }
+    return found != predicate.negated;
+}
+
+bool QueryPlan::implies(const Predicate &predicate, const Predicate &other)
+{
+    if (predicate.field != other.field || predicate.negated != other.negated) {
+        return false;
+    }
+    if (predicate.source == other.source) {
+        return true;
+    }
+
+    switch (predicate.field) {
+    case Name:
+    case Path:
+        // "name:report2" implies "name:report"; "-name:tmp" implies "-name:tmpfile"
+        return predicate.negated
+            ? other.values.first().contains(predicate.values.first(), Qt::CaseInsensitive)
+            : predicate.values.first().contains(other.values.first(), Qt::CaseInsensitive);
+    case Extension:
+        {
+            const QStringList &subset = predicate.negated ? other.values : predicate.values;
+            const QStringList &superset = predicate.negated ? predicate.values : other.values;
+            for (const QString &extension : subset) {
+                if (!superset.contains(extension)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    case Size:
+    case Modified:
+        return predicate.negated
+            ? predicate.low <= other.low && predicate.high >= other.high
+            : predicate.low >= other.low && predicate.high <= other.high;
+    }
+    return false;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <QStringView>
+#include <QList>
+#include <QHash>
+
+#include "SearchEngine.h"
+
+// Filters of a search compiled into an ordered list of predicates. Field
+// predicates are parsed out of the query text, e.g.
+//
+//     report ext:cpp,h size:>1M modified:<7d -path:build
+//
+// and the criteria's own filters (fileTypes, excludePatterns, size and date
+// ranges) are folded in. Predicates that only need the directory entry run
+// before those that need a stat, and within each group the most selective
+// run first. Whatever is not a field predicate is left in text().
+class QueryPlan
+{
+public:
+    enum Field {
+        Name,       // name:foo      file name contains foo
+        Extension,  // ext:cpp,h     suffix is one of the values (or a category like images)
+        Path,       // path:src      full path contains src
+        Size,       // size:>1M  size:<=10k  size:1M..5M
+        Modified    // modified:<7d (newer than 7 days)  modified:>=2024-01-31
+    };
+
+    enum Cost {
+        EntryCost,  // Decided from the name and path alone
+        StatCost    // Needs size or timestamps
+    };
+
+    struct Predicate {
+        Field field;
+        bool negated;
+        QStringList values;     // Name, Path, Extension (lower case)
+        qint64 low;             // Size in bytes, Modified in msecs since epoch (inclusive)
+        qint64 high;
+        QString source;         // Canonical form, used to compare plans
+
+        Cost cost() const;
+        double selectivity() const;
+    };
+
+    QueryPlan();
+    QueryPlan(const SearchEngine::SearchCriteria &criteria, const QHash<QString, QStringList> &typeExtensions);
+
+    bool isValid() const;
+    QString errorString() const;
+
+    // The query with field predicates removed
+    QString text() const;
+
+    const QList<Predicate> &predicates() const;
+    bool isEmpty() const;
+    bool needsStat() const;
+
+    // Extension, size and date predicates never match directories
+    bool filesOnly() const;
+
+    // True if every entry this plan accepts is also accepted by other
+    bool implies(const QueryPlan &other) const;
+
+    bool matchesEntry(QStringView fileName, QStringView filePath) const;
+    bool matchesStat(qint64 size, qint64 modifiedMSecs) const;
+
+private:
+    bool parseToken(const QString &token, const QHash<QString, QStringList> &typeExtensions);
+    bool parseSize(const QString &value, Predicate &predicate);
+    bool parseModified(const QString &value, Predicate &predicate);
+    void addPredicate(const Predicate &predicate);
+
+    static QStringList splitTokens(const QString &query, QList<bool> *quoted = nullptr);
+    static bool parseComparison(QString &value, QString &op);
+    static bool parseByteCount(const QString &value, qint64 &bytes);
+    static bool matches(const Predicate &predicate, QStringView fileName, QStringView filePath);
+    static bool implies(const Predicate &predicate, const Predicate &other);
+
+    QList<Predicate> m_predicates;
+    int m_statStart;            // Index of the first StatCost predicate
+    QString m_text;
+    QString m_error;
+};
@@ -0,0 +1,304 @@
+#include "RoaringBitmap.h"
+#include "SortedIntersection.h"
+#include <algorithm>
+
+RoaringBitmap::RoaringBitmap()
+{
+}
+
+void RoaringBitmap::add(quint32 value)
+{
+    const quint16 key = quint16(value >> 16);
+    const quint16 low = quint16(value & 0xffff);
+
+    int index = findContainer(key);
+    if (index < 0) {
+        index = -index - 1;
+        Container container;
+        container.key = key;
+        container.cardinality = 0;
+        m_containers.insert(index, container);
+    }
+
+    Container &container = m_containers[index];
+    if (container.isBitmap()) {
+        quint64 &word = container.bits[low >> 6];
+        const quint64 mask = quint64(1) << (low & 63);
+        if (!(word & mask)) {
+            word |= mask;
+            ++container.cardinality;
+        }
+        return;
+    }
+
+    auto it = std::lower_bound(container.array.begin(), container.array.end(), low);
+    if (it != container.array.end() && *it == low) {
+        return;
+    }
+    container.array.insert(it, low);
+    if (++container.cardinality > ARRAY_LIMIT) {
+        toBitmap(container);
+    }
+}
+
+void RoaringBitmap::remove(quint32 value)
+{
+    const int index = findContainer(quint16(value >> 16));
+    if (index < 0) {
+        return;
+    }
+
+    Container &container = m_containers[index];
+    const quint16 low = quint16(value & 0xffff);
+    if (container.isBitmap()) {
+        quint64 &word = container.bits[low >> 6];
+        const quint64 mask = quint64(1) << (low & 63);
+        if (!(word & mask)) {
+            return;
+        }
+        word &= ~mask;
+        if (--container.cardinality <= ARRAY_LIMIT) {
+            toArray(container);
+        }
+    } else {
+        auto it = std::lower_bound(container.array.begin(), container.array.end(), low);
+        if (it == container.array.end() || *it != low) {
+            return;
+        }
+        container.array.erase(it);
+        --container.cardinality;
+    }
+
+    if (container.cardinality == 0) {
+        m_containers.remove(index);
+    }
+}
+
+bool RoaringBitmap::contains(quint32 value) const
+{
+    const int index = findContainer(quint16(value >> 16));
+    if (index < 0) {
+        return false;
+    }
+
+    const Container &container = m_containers.at(index);
+    const quint16 low = quint16(value & 0xffff);
+    if (container.isBitmap()) {
+        return container.bits.at(low >> 6) & (quint64(1) << (low & 63));
+    }
+    return std::binary_search(container.array.constBegin(), container.array.constEnd(), low);
+}
+
+void RoaringBitmap::clear()
+{
+    m_containers.clear();
+}
+
+bool RoaringBitmap::isEmpty() const
+{
+    return m_containers.isEmpty();
+}
+
+quint64 RoaringBitmap::cardinality() const
+{
+    quint64 total = 0;
+    for (const Container &container : m_containers) {
+        total += container.cardinality;
+    }
+    return total;
+}
+
+RoaringBitmap RoaringBitmap::operator|(const RoaringBitmap &other) const
+{
+    RoaringBitmap result;
+    result.m_containers.reserve(m_containers.size() + other.m_containers.size());
+
+    int i = 0;
+    int j = 0;
+    while (i < m_containers.size() && j < other.m_containers.size()) {
+        const Container &a = m_containers.at(i);
+        const Container &b = other.m_containers.at(j);
+        if (a.key < b.key) {
+            result.m_containers.append(a);
+            ++i;
+        } else if (b.key < a.key) {
+            result.m_containers.append(b);
+            ++j;
+        } else {
+            result.m_containers.append(unite(a, b));
+            ++i;
+            ++j;
+        }
+    }
+    for (; i < m_containers.size(); ++i) {
+        result.m_containers.append(m_containers.at(i));
+    }
+    for (; j < other.m_containers.size(); ++j) {
+        result.m_containers.append(other.m_containers.at(j));
+    }
+    return result;
+}
+
+RoaringBitmap RoaringBitmap::operator&(const RoaringBitmap &other) const
+{
+    RoaringBitmap result;
+
+    int i = 0;
+    int j = 0;
+    while (i < m_containers.size() && j < other.m_containers.size()) {
+        const Container &a = m_containers.at(i);
+        const Container &b = other.m_containers.at(j);
+        if (a.key < b.key) {
+            ++i;
+        } else if (b.key < a.key) {
+            ++j;
+        } else {
+            Container both = intersect(a, b);
+            if (both.cardinality > 0) {
+                result.m_containers.append(both);
+            }
+            ++i;
+            ++j;
+        }
+    }
+    return result;
+}
+
+RoaringBitmap &RoaringBitmap::operator|=(const RoaringBitmap &other)
+{
+    *this = *this | other;
+    return *this;
+}
+
+RoaringBitmap &RoaringBitmap::operator&=(const RoaringBitmap &other)
+{
+    *this = *this & other;
+    return *this;
+}
+
+QVector<quint32> RoaringBitmap::toVector() const
+{
+    QVector<quint32> values;
+    values.reserve(static_cast<int>(cardinality()));
+    forEach([&values](quint32 value) {
+        values.append(value);
+    });
+    return values;
+}
+
+int RoaringBitmap::findContainer(quint16 key) const
+{
+    // Index of the container, or -(insertion point) - 1
+    int low = 0;
+    int high = m_containers.size() - 1;
+    while (low <= high) {
+        const int middle = (low + high) / 2;
+        const quint16 current = m_containers.at(middle).key;
+        if (current < key) {
+            low = middle + 1;
+        } else if (current > key) {
+            high = middle - 1;
+        } else {
+            return middle;
+        }
+    }
+    return -low - 1;
+}
+
+RoaringBitmap::Container RoaringBitmap::unite(const Container &a, const Container &b)
+{
+    Container result;
+    result.key = a.key;
+
+    if (!a.isBitmap() && !b.isBitmap()) {
+        result.array.resize(a.array.size() + b.array.size());
+        auto end = std::set_union(a.array.constBegin(), a.array.constEnd(),
+                                  b.array.constBegin(), b.array.constEnd(), result.array.begin());
+        result.array.resize(end - result.array.begin());
+        result.cardinality = result.array.size();
+        if (result.cardinality > ARRAY_LIMIT) {
+            toBitmap(result);
+        }
+        return result;
+    }
+
+    // At least one side is dense; OR word by word
+    const Container &dense = a.isBitmap() ? a : b;
+    const Container &other = a.isBitmap() ? b : a;
+    result.bits = dense.bits;
+    if (other.isBitmap()) {
+        for (int word = 0; word < BITMAP_WORDS; ++word) {
+            result.bits[word] |= other.bits.at(word);
+        }
+    } else {
+        for (quint16 low : other.array) {
+            result.bits[low >> 6] |= quint64(1) << (low & 63);
+        }
+    }
+
+    result.cardinality = 0;
+    for (quint64 word : result.bits) {
+        result.cardinality += qPopulationCount(word);
+    }
+    return result;
+}
+
+RoaringBitmap::Container RoaringBitmap::intersect(const Container &a, const Container &b)
+{
+    Container result;
+    result.key = a.key;
+
+    if (a.isBitmap() && b.isBitmap()) {
+        result.bits.resize(BITMAP_WORDS);
+        result.cardinality = 0;
+        for (int word = 0; word < BITMAP_WORDS; ++word) {
+            result.bits[word] = a.bits.at(word) & b.bits.at(word);
+            result.cardinality += qPopulationCount(result.bits.at(word));
+        }
+        if (result.cardinality <= ARRAY_LIMIT) {
+            toArray(result);
+        }
+        return result;
+    }
+
+    if (a.isBitmap() || b.isBitmap()) {
+        // Probe the dense side for every id of the sparse side
+        const Container &dense = a.isBitmap() ? a : b;
+        const Container &sparse = a.isBitmap() ? b : a;
+        for (quint16 low : sparse.array) {
+            if (dense.bits.at(low >> 6) & (quint64(1) << (low & 63))) {
+                result.array.append(low);
+            }
+        }
+    } else {
+        result.array = SortedIntersection::intersect(a.array, b.array);
+    }
+    result.cardinality = result.array.size();
+    return result;
+}
+
+void RoaringBitmap::toBitmap(Container &container)
+{
+    container.bits.fill(0, BITMAP_WORDS);
+    for (quint16 low : container.array) {
+        container.bits[low >> 6] |= quint64(1) << (low & 63);
+    }
+    container.array.clear();
+    container.array.squeeze();
+}
+
+void RoaringBitmap::toArray(Container &container)
+{
+    QVector<quint16> array;
+    array.reserve(container.cardinality);
+    for (int word = 0; word < BITMAP_WORDS; ++word) {
+        quint64 bits = container.bits.at(word);
+        while (bits) {
+            array.append(quint16(word * 64 + qCountTrailingZeroBits(bits)));
+            bits &= bits - 1;
+        }
+    }
+    container.array = array;
+    container.bits.clear();
+    container.bits.squeeze();
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <QVector>
+#include <QtAlgorithms>
+
+// Compressed set of 32-bit ids in the style of Roaring bitmaps. Ids are
+// grouped by their high 16 bits; each group is stored as a sorted array of
+// low halves while it holds at most ARRAY_LIMIT ids, and as a 65536-bit
+// bitmap beyond that. Sparse sets stay small and dense sets make unions and
+// intersections word-wise operations.
+class RoaringBitmap
+{
+public:
+    RoaringBitmap();
+
+    void add(quint32 value);
+    void remove(quint32 value);
+    bool contains(quint32 value) const;
+    void clear();
+
+    bool isEmpty() const;
+    quint64 cardinality() const;
+
+    RoaringBitmap operator|(const RoaringBitmap &other) const;
+    RoaringBitmap operator&(const RoaringBitmap &other) const;
+    RoaringBitmap &operator|=(const RoaringBitmap &other);
+    RoaringBitmap &operator&=(const RoaringBitmap &other);
+
+    // Ids in ascending order
+    QVector<quint32> toVector() const;
+
+    template<typename Visitor>
+    void forEach(Visitor visitor) const;
+
+private:
+    struct Container {
+        quint16 key;
+        int cardinality;
+        QVector<quint16> array;     // Sorted low halves, while cardinality <= ARRAY_LIMIT
+        QVector<quint64> bits;      // BITMAP_WORDS words otherwise
+
+        bool isBitmap() const { return !bits.isEmpty(); }
+    };
+
+    int findContainer(quint16 key) const;
+
+    static Container unite(const Container &a, const Container &b);
+    static Container intersect(const Container &a, const Container &b);
+    static void toBitmap(Container &container);
+    static void toArray(Container &container);
+
+    static const int ARRAY_LIMIT = 4096;
+    static const int BITMAP_WORDS = 65536 / 64;
+
+    QVector<Container> m_containers;    // Sorted by key
+};
+
+template<typename Visitor>
+void RoaringBitmap::forEach(Visitor visitor) const
+{
+    for (const Container &container : m_containers) {
+        const quint32 high = quint32(container.key) << 16;
+        if (!container.isBitmap()) {
+            for (quint16 low : container.array) {
+                visitor(high | low);
+            }
+            continue;
+        }
+        for (int word = 0; word < BITMAP_WORDS; ++word) {
+            quint64 bits = container.bits.at(word);
+            while (bits) {
+                visitor(high | quint32(word * 64 + qCountTrailingZeroBits(bits)));
+                bits &= bits - 1;
+            }
+        }
+    }
+}
@@ -1,4 +1,15 @@
 #include "SearchEngine.h"
+#include "ContentMatcher.h"
+#include "FuzzyMatcher.h"
+#include "QueryPlan.h"
+#include "FileIndexer.h"
+#include "ExtendedAttributes.h"
+#include "SuggestionTrie.h"
+#include "ContentIndex.h"
+#include "ProximityQuery.h"
+#include "IdentifierTokenizer.h"
+#include "ArchiveReader.h"
+#include "DocumentText.h"
 #include <QDir>
 #include <QDirIterator>
 #include <QFileInfo>
@@ -6,21 +17,325 @@
 #include <QRegularExpression>
 #include <QThread>
 #include <QElapsedTimer>
+#include <QDeadlineTimer>
 #include <QStandardPaths>
+#include <QMutexLocker>
+#include <QMimeDatabase>
 #include <QDebug>
 #include <QtConcurrent>
 #include <QFuture>
 #include <algorithm>
+#include <vector>
+#include <sys/stat.h>
+#include <dirent.h>
+
+namespace {
+
+QString suggestionsFile()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/suggestions.trie";
+}
+
+QString contentIndexFile()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/content.idx";
+}
+
+// Keeps the best `capacity` results seen so far. The heap's front is the
+// worst kept result, so a search costs O(N log K) and holds at most K
+// results no matter how many files match.
+class TopResults
+{
+public:
+    explicit TopResults(int capacity)
+        : m_capacity(qMax(0, capacity))
+        , m_sequence(0)
+    {}
+    
+    bool accepts(double score) const
+    {
+        if (static_cast<int>(m_heap.size()) < m_capacity) {
+            return true;
+        }
+        return m_capacity > 0 && score > m_heap.front().result.relevanceScore;
+    }
+    
+    void offer(const SearchEngine::SearchResult &result)
+    {
+        if (!accepts(result.relevanceScore)) {
+            return;
+        }
+        
+        Entry entry{result, m_sequence++};
+        if (static_cast<int>(m_heap.size()) < m_capacity) {
+            m_heap.push_back(std::move(entry));
+        } else {
+            std::pop_heap(m_heap.begin(), m_heap.end(), betterThan);
+            m_heap.back() = std::move(entry);
+        }
+        std::push_heap(m_heap.begin(), m_heap.end(), betterThan);
+    }
+    
+    // Kept results in discovery order
+    QList<SearchEngine::SearchResult> take()
+    {
+        std::sort(m_heap.begin(), m_heap.end(), [](const Entry &a, const Entry &b) {
+            return a.sequence < b.sequence;
+        });
+        
+        QList<SearchEngine::SearchResult> results;
+        results.reserve(static_cast<qsizetype>(m_heap.size()));
+        for (Entry &entry : m_heap) {
+            results.append(std::move(entry.result));
+        }
+        m_heap.clear();
+        return results;
+    }
+    
+private:
+    struct Entry {
+        SearchEngine::SearchResult result;
+        quint64 sequence;
+    };
+    
+    // Ties go to the result found first
+    static bool betterThan(const Entry &a, const Entry &b)
+    {
+        if (a.result.relevanceScore != b.result.relevanceScore) {
+            return a.result.relevanceScore > b.result.relevanceScore;
+        }
+        return a.sequence < b.sequence;
+    }
+    
+    std::vector<Entry> m_heap;
+    int m_capacity;
+    quint64 m_sequence;
+};
+
+SearchEngine::SearchCriteria withQuery(SearchEngine::SearchCriteria criteria, const QString &query)
+{
+    criteria.query = query;
+    return criteria;
+}
+
+qint64 modifiedNsecs(const struct stat &st)
+{
+#ifdef Q_OS_MACOS
+    return qint64(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    return qint64(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+}
+
+}
+
+// Everything compiled from the criteria once per search. The matchers see
+// the query with its field predicates (ext:, size:, ...) stripped.
+struct SearchEngine::SearchContext
+{
+    SearchContext(const SearchJob &searchJob, const QHash<QString, QStringList> &typeExtensions)
+        : job(searchJob)
+        , plan(searchJob.criteria, typeExtensions)
+        , criteria(withQuery(searchJob.criteria, plan.text()))
+        , contentMatcher(criteria)
+        , fuzzyMatcher(criteria.query, criteria.caseSensitive)
+        , topResults(searchJob.criteria.maxResults)
+        , matchCount(0)
+        , candidatesOverflowed(false)
+        , deadline(searchJob.criteria.timeoutMs > 0 ? QDeadlineTimer(searchJob.criteria.timeoutMs)
+                                                : QDeadlineTimer(QDeadlineTimer::Forever))
+        , incomplete(false)
+        , metadataFromIndex(false)
+        , pruneSubtrees(false)
+    {
+        // Name regexes are compiled here once, not per directory entry
+        if (criteria.type == RegexSearch) {
+            nameRegex.setPattern(criteria.query);
+        } else if (criteria.useRegex || criteria.wholeWords) {
+            nameRegex.setPattern(criteria.useRegex ? criteria.query
+                                                   : "\\b" + QRegularExpression::escape(criteria.query) + "\\b");
+            if (!criteria.caseSensitive) {
+                nameRegex.setPatternOptions(QRegularExpression::CaseInsensitiveOption);
+            }
+        }
+        nameRegex.optimize();
+        
+        if (criteria.type == FileNameSearch && !criteria.caseSensitive && !criteria.useRegex && !criteria.wholeWords) {
+            queryWords = IdentifierTokenizer::words(criteria.query);
+            querySubwords = IdentifierTokenizer::subwords(criteria.query);
+            for (const QString &subword : querySubwords) {
+                if (subword.size() > longestSubword.size()) {
+                    longestSubword = subword;
+                }
+            }
+        }
+    }
+    
+    const SearchJob &job;
+    QueryPlan plan;
+    SearchCriteria criteria;
+    ContentMatcher contentMatcher;
+    FuzzyMatcher fuzzyMatcher;
+    QRegularExpression nameRegex;
+    TopResults topResults;
+    int matchCount;
+    
+    // Results not yet streamed through resultsFound
+    QList<SearchResult> pendingResults;
+    QElapsedTimer batchTimer;
+    
+    // Every match, for refining this search as the query grows
+    QStringList candidates;
+    bool candidatesOverflowed;
+    
+    // Where a stopped search left off: directories not walked yet and
+    // candidates not checked yet. Paths already checked are skipped.
+    QList<PendingDirectory> unwalked;
+    QStringList unchecked;
+    QSet<QString> checkedPaths;
+    
+    // Directories whose files came from the file index; a walk of the
+    // changed ones around them doesn't enter them
+    QSet<QString> indexedDirectories;
+    
+    // Set once the deadline cuts the search short
+    QDeadlineTimer deadline;
+    bool incomplete;
+    
+    // Candidates came from the index's attribute lookup and already match
+    bool metadataFromIndex;
+    
+    // Names a subtree must hold for the walk to enter it
+    FileIndexer::NameProbe subtreeProbe;
+    bool pruneSubtrees;
+    
+    // Case-insensitive name queries also match as identifiers, so "search
+    // engine" finds SearchEngine.h; empty where that doesn't apply
+    QStringList queryWords;
+    QStringList querySubwords;
+    QString longestSubword;
+};
+
+// One directory entry, as much as readdir() tells about it. The stat is
+// deferred until a filter, the content reader or the result needs it.
+struct SearchEngine::DirectoryEntry
+{
+    enum Kind {
+        Unknown,    // Symlink or no d_type; resolve() to find out
+        File,
+        Directory,
+        Other       // Sockets, FIFOs, devices, dangling links
+    };
+    
+    explicit DirectoryEntry(const QString &entryPath)
+        : path(entryPath)
+        , name(entryPath.mid(entryPath.lastIndexOf('/') + 1))
+        , kind(Unknown)
+        , symlink(false)
+        , resolved(false)
+        , exists(false)
+        , size(0)
+        , modified(0)
+        , device(0)
+        , inode(0)
+        , modifiedNsecs(0)
+        , hidden(false)
+        , content(nullptr)
+    {}
+    
+    // Follows symlinks like QFileInfo. Returns false if the entry is gone.
+    // Archive members exist while their archive does and keep the size and
+    // mtime they were given.
+    bool resolve()
+    {
+        if (resolved) {
+            return exists;
+        }
+        resolved = true;
+        
+        struct stat st;
+        const QString archive = ArchiveReader::archivePath(path);
+        exists = ::stat(QFile::encodeName(archive).constData(), &st) == 0;
+        if (exists && archive.size() < path.size()) {
+            kind = S_ISREG(st.st_mode) ? File : Other;
+        } else if (exists) {
+            kind = S_ISREG(st.st_mode) ? File : S_ISDIR(st.st_mode) ? Directory : Other;
+            size = static_cast<qint64>(st.st_size);
+            device = static_cast<quint64>(st.st_dev);
+            inode = static_cast<quint64>(st.st_ino);
+            modifiedNsecs = ::modifiedNsecs(st);
+            modified = modifiedNsecs / 1000000;
+#ifdef Q_OS_MACOS
+            hidden = (st.st_flags & UF_HIDDEN) != 0;
+#endif
+        } else {
+            kind = Other;
+        }
+        return exists;
+    }
+    
+    QString path;
+    QString name;
+    Kind kind;
+    bool symlink;
+    bool resolved;
+    bool exists;
+    qint64 size;
+    qint64 modified;    // msecs since epoch
+    
+    // Of the file itself, once resolved; keys the binary verdict cache
+    quint64 device;
+    quint64 inode;
+    qint64 modifiedNsecs;
+    
+    // Hidden by a file flag (UF_HIDDEN on macOS), once resolved; dot files
+    // are told by their name
+    bool hidden;
+    
+    // Members listed by the walk: reads their data from the open archive
+    const ArchiveReader::ContentReader *content;
+};
+
+QString SearchEngine::SearchResult::fileName() const
+{
+    return filePath.mid(filePath.lastIndexOf('/') + 1);
+}
+
+QString SearchEngine::SearchResult::directory() const
+{
+    const int slash = filePath.lastIndexOf('/');
+    return slash > 0 ? filePath.left(slash) : QStringLiteral("/");
+}
+
+QFileInfo SearchEngine::SearchResult::fileInfo() const
+{
+    return QFileInfo(filePath);
+}
+
+QString SearchEngine::SearchResult::mimeType() const
+{
+    return QMimeDatabase().mimeTypeForFile(filePath).name();
+}
 
 SearchEngine::SearchEngine(QObject *parent)
     : QObject(parent)
-    , m_isSearching(0)
-    , m_searchCancelled(0)
+    , m_nextJobId(1)
+    , m_generation(0)
+    , m_lastSearchComplete(1)
     , m_maxResults(10000)
     , m_maxDepth(100)
     , m_timeoutMs(30000)
     , m_threadCount(QThread::idealThreadCount())
+    , m_contentIndex(new ContentIndex)
     , m_indexBuilt(false)
+    , m_indexCancelled(0)
+    , m_indexArchiveContent(0)
+    , m_fileIndexer(nullptr)
+    , m_suggestions(new SuggestionTrie)
+    , m_hasLastCandidates(false)
+    , m_cacheClock(0)
+    , m_cacheEpoch(0)
+    , m_cacheMaxStaleness(0)
     , m_lastSearchTime(0)
     , m_resultCount(0)
 {
@@ -37,65 +352,143 @@ SearchEngine::SearchEngine(QObject *parent)
     m_fileTypeExtensions["videos"] = QStringList() << "mp4" << "avi" << "mov" << "wmv" << "flv" << "mkv";
     m_fileTypeExtensions["audio"] = QStringList() << "mp3" << "wav" << "flac" << "aac" << "ogg" << "m4a";
     m_fileTypeExtensions["archives"] = QStringList() << "zip" << "rar" << "7z" << "tar" << "gz" << "bz2";
+    
+    // Suggestions from the last run are usable before the index is
+    m_suggestions->open(suggestionsFile());
+    
+    m_searchPool.setMaxThreadCount(qMax(1, m_threadCount));
+    
+    // The saved content index only makes the first build incremental; it
+    // isn't searched before that build has confirmed it
+    m_contentIndex->setStopWords(m_stopWords);
+    m_contentIndex->load(contentIndexFile());
+    connect(&m_indexWatcher, &QFutureWatcher<void>::finished, this, &SearchEngine::onIndexingFinished);
 }
 
 SearchEngine::~SearchEngine()
 {
-    if (m_isSearching.loadAcquire()) {
-        cancelSearch();
+    for (const std::shared_ptr<SearchJob> &job : m_jobs) {
+        job->cancelled.storeRelease(1);
     }
+    m_jobs.clear();
+    m_indexCancelled.storeRelease(1);
+    m_indexWatcher.waitForFinished();
+    m_searchPool.waitForDone();
+    m_suggestionBuild.waitForFinished();
 }
 
-void SearchEngine::search(const QString &query, const QString &basePath)
+quint64 SearchEngine::search(const QString &query, const QString &basePath)
 {
     SearchCriteria criteria;
     criteria.query = query;
     criteria.type = FileNameSearch;
     criteria.customPath = basePath;
     criteria.scope = basePath.isEmpty() ? CurrentDirectory : CustomPath;
+    criteria.maxResults = m_maxResults;
+    criteria.maxDepth = m_maxDepth;
+    criteria.timeoutMs = m_timeoutMs;
     
-    search(criteria);
+    return search(criteria);
 }
 
-void SearchEngine::search(const SearchCriteria &criteria)
+quint64 SearchEngine::search(const SearchCriteria &criteria, SearchPriority priority)
 {
-    if (m_isSearching.loadAcquire()) {
+    if (priority == InteractivePriority) {
+        // Bumping the generation makes the previous interactive job stale
+        // at once, even before its worker sees the cancel flag
+        m_generation.fetchAndAddOrdered(1);
         cancelSearch();
+        saveSearch(criteria);
     }
     
-    m_isSearching.storeRelease(1);
-    m_searchCancelled.storeRelease(0);
+    std::shared_ptr<SearchJob> job(new SearchJob);
+    job->id = m_nextJobId++;
+    job->generation = m_generation.loadAcquire();
+    job->priority = priority;
+    job->criteria = criteria;
+    job->cancelled.storeRelease(0);
+    job->resultCount = 0;
+    job->complete = false;
+    job->timer.start();
+    m_jobs.insert(job->id, job);
     
-    emit searchStarted(criteria.query);
+    emit searchStarted(criteria.query, job->id);
     
-    m_elapsedTimer->start();
-    
-    // Start search in separate thread
-    QFuture<void> future = QtConcurrent::run([this, criteria]() {
-        performSearch(criteria);
-    });
-    
-    m_searchWatcher.setFuture(future);
-    connect(&m_searchWatcher, &QFutureWatcher<void>::finished, this, &SearchEngine::onSearchFinished);
+    // Queued interactive jobs are started before queued background ones
+    m_searchPool.start([this, job]() {
+        runJob(job);
+    }, priority == InteractivePriority ? 1 : 0);
+    return job->id;
 }
 
 void SearchEngine::cancelSearch()
 {
-    m_searchCancelled.storeRelease(1);
-    m_searchWatcher.cancel();
-    m_isSearching.storeRelease(0);
-    emit searchCancelled();
+    QList<quint64> interactive;
+    for (const std::shared_ptr<SearchJob> &job : m_jobs) {
+        if (job->priority == InteractivePriority) {
+            interactive.append(job->id);
+        }
+    }
+    for (quint64 jobId : interactive) {
+        cancelJob(jobId);
+    }
+}
+
+void SearchEngine::cancelJob(quint64 jobId)
+{
+    std::shared_ptr<SearchJob> job = m_jobs.take(jobId);
+    if (!job) {
+        return;
+    }
+    job->cancelled.storeRelease(1);
+    emit searchCancelled(jobId);
 }
 
 bool SearchEngine::isSearching() const
 {
-    return m_isSearching.loadAcquire();
+    return !m_jobs.isEmpty();
+}
+
+bool SearchEngine::isJobRunning(quint64 jobId) const
+{
+    return m_jobs.contains(jobId);
 }
 
-void SearchEngine::performSearch(const SearchCriteria &criteria)
+void SearchEngine::runJob(const std::shared_ptr<SearchJob> &job)
 {
-    QList<SearchResult> results;
+    // A job cancelled while it waited for a thread never starts
+    if (!isStale(*job)) {
+        performSearch(*job);
+    }
     
+    const quint64 jobId = job->id;
+    QMetaObject::invokeMethod(this, [this, jobId]() {
+        onSearchFinished(jobId);
+    }, Qt::QueuedConnection);
+}
+
+bool SearchEngine::isStale(const SearchJob &job) const
+{
+    return job.cancelled.loadAcquire()
+        || (job.priority == InteractivePriority && job.generation != m_generation.loadAcquire());
+}
+
+void SearchEngine::post(quint64 jobId, std::function<void()> signal)
+{
+    // Signals are emitted on the engine's thread, in the order the worker
+    // posted them; whatever arrives after its job went stale is dropped
+    QMetaObject::invokeMethod(this, [this, jobId, signal]() {
+        auto job = m_jobs.constFind(jobId);
+        if (job != m_jobs.constEnd() && !isStale(*job.value())) {
+            signal();
+        }
+    }, Qt::QueuedConnection);
+}
+
+void SearchEngine::performSearch(SearchJob &job)
+{
+    const SearchCriteria &criteria = job.criteria;
+    const quint64 jobId = job.id;
     QString searchPath;
     switch (criteria.scope) {
     case CurrentDirectory:
@@ -115,289 +508,1156 @@ void SearchEngine::performSearch(const SearchCriteria &criteria)
         break;
     }
     
-    searchInDirectory(searchPath, criteria, results);
+    // Compile the queries once for the whole search
+    SearchContext context(job, m_fileTypeExtensions);
+    if (!context.plan.isValid()) {
+        const QString error = QString("Invalid query: %1").arg(context.plan.errorString());
+        post(jobId, [this, error, jobId]() {
+            emit searchError(error, jobId);
+            emit searchCompleted(QList<SearchResult>(), jobId);
+        });
+        return;
+    }
+    if (criteria.type == ContentSearch && !context.contentMatcher.isValid()) {
+        const QString error = QString("Invalid search pattern: %1").arg(context.contentMatcher.errorString());
+        post(jobId, [this, error, jobId]() {
+            emit searchError(error, jobId);
+            emit searchCompleted(QList<SearchResult>(), jobId);
+        });
+        return;
+    }
+    
+    // Re-issued queries are answered from the cache. Change events only
+    // name paths, and only for watched directories, so searches that look
+    // at contents, sizes, dates or attributes are never cached, and
+    // entries expire after RESULT_CACHE_TTL_MS. An invalidation while the
+    // search runs keeps its results out.
+    const bool cacheable = criteria.type != ContentSearch && criteria.type != MetadataSearch
+        && criteria.type != SizeSearch && criteria.type != DateSearch
+        && criteria.metadata.isEmpty() && !context.plan.needsStat();
+    const QString key = cacheable ? cacheKey(criteria, searchPath) : QString();
+    quint64 cacheEpoch = 0;
+    if (cacheable) {
+        QMutexLocker locker(&m_resultCacheMutex);
+        cacheEpoch = m_cacheEpoch;
+    }
+    QList<SearchResult> cached;
+    if (cacheable && cachedResults(key, cached)) {
+        job.resultCount = cached.size();
+        job.complete = true;
+        post(jobId, [this, cached, jobId]() {
+            if (!cached.isEmpty()) {
+                emit resultsFound(cached, jobId);
+            }
+            emit searchCompleted(cached, jobId);
+        });
+        return;
+    }
+    
+    // A query that narrows the last one only needs to recheck that search's
+    // matches, and to finish its walk if it was cut short
+    bool refine = false;
+    QStringList candidates;
+    QList<PendingDirectory> unwalked;
+    {
+        QMutexLocker locker(&m_candidateMutex);
+        if (m_hasLastCandidates && m_lastCandidates.searchPath == searchPath
+            && isRefinementOf(criteria, m_lastCandidates.criteria)) {
+            refine = true;
+            candidates = m_lastCandidates.paths;
+            unwalked = m_lastCandidates.unwalked;
+        }
+    }
+    
+    // Otherwise predicates the file index can answer narrow the candidates
+    // without touching the disk, and so do words the content index holds
+    bool fromFileIndex = false;
+    if (!refine && indexCandidates(searchPath, context, candidates)) {
+        refine = fromFileIndex = true;
+    }
+    if (!refine && contentCandidates(searchPath, context, candidates)) {
+        refine = true;
+    }
+    if (!refine && nameCandidates(searchPath, context, candidates)) {
+        refine = fromFileIndex = true;
+    }
+    if (fromFileIndex) {
+        addChangedDirectories(searchPath, context, unwalked);
+    }
+    
+    if (refine) {
+        searchCandidates(candidates, context);
+        if (!unwalked.isEmpty()) {
+            // Walked entries aren't index matches; they are checked in full
+            context.metadataFromIndex = false;
+            context.checkedPaths = QSet<QString>(candidates.constBegin(), candidates.constEnd());
+            context.pruneSubtrees = buildSubtreeProbe(context);
+            searchInDirectories(unwalked, context);
+        }
+    } else {
+        context.pruneSubtrees = buildSubtreeProbe(context);
+        searchInDirectory(searchPath, context);
+    }
+    flushResults(context);
+    
+    // Partial results are still ranked and delivered but never cached.
+    // Background searches leave the refinement state to interactive ones.
+    const bool complete = !context.incomplete && !isStale(job);
+    job.complete = complete;
     
-    // Rank results by relevance
+    // A stopped search still narrows the next one: its matches so far and
+    // whatever it didn't get to are all the next query has to look at
+    if (job.priority == InteractivePriority) {
+        QMutexLocker locker(&m_candidateMutex);
+        m_hasLastCandidates = !context.candidatesOverflowed;
+        m_lastCandidates.criteria = criteria;
+        m_lastCandidates.searchPath = searchPath;
+        m_lastCandidates.paths = context.candidatesOverflowed ? QStringList() : context.candidates + context.unchecked;
+        m_lastCandidates.unwalked = complete || context.candidatesOverflowed ? QList<PendingDirectory>()
+                                                                             : context.unwalked;
+    }
+    
+    // The walk only kept the best maxResults matches; order them
+    QList<SearchResult> results = context.topResults.take();
     rankResults(results, criteria);
     
-    // Limit results
-    if (results.size() > criteria.maxResults) {
-        results = results.mid(0, criteria.maxResults);
+    if (complete && cacheable) {
+        storeResults(key, criteria, searchPath, results, cacheEpoch);
+    } else if (context.incomplete) {
+        const QString reason = QString("Search stopped after %1 ms; results are partial").arg(criteria.timeoutMs);
+        post(jobId, [this, reason, jobId]() {
+            emit searchIncomplete(reason, jobId);
+        });
     }
     
-    m_resultCount = results.size();
-    emit searchCompleted(results);
+    job.resultCount = results.size();
+    post(jobId, [this, results, jobId]() {
+        emit searchCompleted(results, jobId);
+    });
 }
 
-void SearchEngine::searchInDirectory(const QString &path, const SearchCriteria &criteria, QList<SearchResult> &results)
+void SearchEngine::searchInDirectory(const QString &path, SearchContext &context)
 {
-    if (m_searchCancelled.loadAcquire()) {
-        return;
+    searchInDirectories(QList<PendingDirectory>() << PendingDirectory{QDir::cleanPath(path), 0}, context);
+}
+
+void SearchEngine::searchInDirectories(QList<PendingDirectory> pending, SearchContext &context)
+{
+    const SearchCriteria &criteria = context.criteria;
+    
+    // Explicit stack so descent can stop at maxDepth (entries of the search
+    // root are depth 0). readdir() is used directly: its d_type tells files
+    // from directories, so entries whose name doesn't match are never
+    // stat'ed.
+    QSet<QString> followedLinks;
+    
+    while (!pending.isEmpty()) {
+        if (isStale(context.job) || context.deadline.hasExpired()) {
+            context.incomplete = context.incomplete || !isStale(context.job);
+            context.unwalked = pending;
+            return;
+        }
+        const PendingDirectory directory = pending.takeLast();
+        if (criteria.maxDepth >= 0 && directory.depth > criteria.maxDepth) {
+            continue;
+        }
+        
+        // When the search stops inside this directory, it is left to be
+        // walked again whole, without the subdirectories queued from it
+        const int queuedBefore = pending.size();
+        auto leaveUnwalked = [&]() {
+            context.unwalked = pending.mid(0, queuedBefore);
+            context.unwalked.append(directory);
+        };
+        const bool descend = criteria.searchSubfolders
+            && (criteria.maxDepth < 0 || directory.depth < criteria.maxDepth);
+        const QString prefix = directory.path.endsWith('/') ? directory.path : directory.path + '/';
+        
+        DIR *handle = ::opendir(QFile::encodeName(directory.path).constData());
+        if (!handle) {
+            continue;
+        }
+        
+        while (struct dirent *ent = ::readdir(handle)) {
+            if (isStale(context.job)) {
+                leaveUnwalked();
+                ::closedir(handle);
+                return;
+            }
+            if (context.deadline.hasExpired()) {
+                context.incomplete = true;
+                leaveUnwalked();
+                ::closedir(handle);
+                return;
+            }
+            
+            // Don't hold back a partial batch while nothing else matches
+            if (!context.pendingResults.isEmpty() && context.batchTimer.hasExpired(RESULT_BATCH_INTERVAL_MS)) {
+                flushResults(context);
+            }
+            
+            const char *rawName = ent->d_name;
+            if (rawName[0] == '.') {
+                if (rawName[1] == '\0' || (rawName[1] == '.' && rawName[2] == '\0') || !criteria.searchHiddenFiles) {
+                    continue;
+                }
+            }
+            
+            DirectoryEntry entry(prefix + QFile::decodeName(rawName));
+            switch (ent->d_type) {
+            case DT_REG:
+                entry.kind = DirectoryEntry::File;
+                break;
+            case DT_DIR:
+                entry.kind = DirectoryEntry::Directory;
+                break;
+            case DT_LNK:
+                entry.symlink = true;
+                entry.resolve();
+                break;
+            case DT_UNKNOWN:
+                entry.resolve();
+                break;
+            default:
+                entry.kind = DirectoryEntry::Other;
+                break;
+            }
+            
+            if (entry.kind == DirectoryEntry::Other && !criteria.searchSystemFiles) {
+                continue;
+            }
+            
+#ifdef Q_OS_MACOS
+            // Directories the Finder hides take a stat to spot; hidden files
+            // are dropped once searchEntry() resolves them
+            if (entry.kind == DirectoryEntry::Directory && !criteria.searchHiddenFiles
+                && entry.resolve() && entry.hidden) {
+                continue;
+            }
+#endif
+            
+            if (descend && entry.kind == DirectoryEntry::Directory && !context.indexedDirectories.contains(entry.path)) {
+                if (!entry.symlink) {
+                    if (!context.pruneSubtrees || subtreeMayMatch(entry, context)) {
+                        pending.append({entry.path, directory.depth + 1});
+                    }
+                } else if (criteria.followSymlinks) {
+                    // Each link target is entered once, which also breaks cycles
+                    const QString target = QFileInfo(entry.path).canonicalFilePath();
+                    if (!target.isEmpty() && !followedLinks.contains(target)) {
+                        followedLinks.insert(target);
+                        pending.append({entry.path, directory.depth + 1});
+                    }
+                }
+            }
+            
+            searchEntry(entry, context);
+            if (criteria.searchArchives && entry.kind == DirectoryEntry::File && ArchiveReader::isArchive(entry.name)) {
+                searchArchive(entry.path, context);
+            }
+        }
+        ::closedir(handle);
     }
+}
+
+bool SearchEngine::indexCandidates(const QString &searchPath, SearchContext &context, QStringList &paths)
+{
+    const SearchCriteria &criteria = context.criteria;
+    const QueryPlan &plan = context.plan;
     
-    QDirIterator::IteratorFlags flags = QDirIterator::NoIteratorFlags;
-    if (criteria.searchSubfolders) {
-        flags |= QDirIterator::Subdirectories;
+    // The index holds regular, non-hidden files reached without following
+    // links, so it can only stand in for the walk when the search rules out
+    // everything else anyway
+    const bool metadata = criteria.type == MetadataSearch
+        && (!criteria.metadata.isEmpty() || !criteria.query.isEmpty());
+    if (!m_fileIndexer || (!metadata && (plan.isEmpty() || !plan.filesOnly()))
+        || criteria.searchHiddenFiles || criteria.followSymlinks || !m_fileIndexer->isIndexComplete()) {
+        return false;
     }
-    if (criteria.followSymlinks) {
-        flags |= QDirIterator::FollowSymlinks;
+    
+    const QString root = QDir::cleanPath(searchPath);
+    const QString indexRoot = QDir::cleanPath(m_fileIndexer->basePath());
+    if (indexRoot.isEmpty() || !dependsOn(indexRoot, true, root)) {
+        return false;
     }
     
-    QDir::Filters filters = QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot;
-    if (criteria.searchHiddenFiles) {
-        filters |= QDir::Hidden;
+    const QString prefix = root.endsWith('/') ? root : root + '/';
+    const int maxDepth = criteria.searchSubfolders ? criteria.maxDepth : 0;
+    auto withinDepth = [&](const QString &path) {
+        return maxDepth < 0 || path.count('/') - prefix.count('/') <= maxDepth;
+    };
+    
+    // Tags, comments and attributes are looked up in the inverted indexes.
+    // Only files are indexed, so tagged directories are left out.
+    if (metadata) {
+        paths = m_fileIndexer->filesWithMetadata(root, criteria.metadata, criteria.query);
+        paths.erase(std::remove_if(paths.begin(), paths.end(), [&](const QString &path) {
+            return !withinDepth(path);
+        }), paths.end());
+        context.metadataFromIndex = true;
+        return true;
     }
-    if (criteria.searchSystemFiles) {
-        filters |= QDir::System;
+    
+    // Size and date ranges go to the index's sorted columns, types to its
+    // bitmaps; categories are looked up by name
+    QList<FileIndexer::RangeQuery> ranges;
+    QStringList types = criteria.fileTypes;
+    for (const QueryPlan::Predicate &predicate : plan.predicates()) {
+        if (predicate.negated) {
+            continue;
+        }
+        if (predicate.field == QueryPlan::Extension && types.isEmpty()) {
+            types = predicate.values;
+        } else if (predicate.field == QueryPlan::Size) {
+            ranges.append({FileIndexer::SizeColumn, predicate.low, predicate.high});
+        } else if (predicate.field == QueryPlan::Modified) {
+            ranges.append({FileIndexer::ModifiedColumn, predicate.low, predicate.high});
+        }
     }
     
-    QDirIterator iterator(path, filters, flags);
+    paths = m_fileIndexer->filesMatching(root, [&](const FileIndexer::IndexedFile &file) {
+        if (!withinDepth(file.path) || (!criteria.searchArchives && ArchiveReader::isVirtualPath(file.path))) {
+            return false;
+        }
+        return plan.matchesEntry(file.name, file.path)
+            && plan.matchesStat(file.size, file.lastModified.toMSecsSinceEpoch());
+    }, ranges, types);
+    return true;
+}
+
+bool SearchEngine::contentCandidates(const QString &searchPath, const SearchContext &context, QStringList &paths)
+{
+    const SearchCriteria &criteria = context.criteria;
+    
+    // The content index holds the words of non-hidden text files reached
+    // without following links. Regex queries have no words to look up.
+    if (criteria.type != ContentSearch || criteria.useRegex || criteria.includeBinaryFiles
+        || criteria.searchHiddenFiles || criteria.followSymlinks) {
+        return false;
+    }
     
-    while (iterator.hasNext() && !m_searchCancelled.loadAcquire()) {
-        QString filePath = iterator.next();
-        QFileInfo fileInfo(filePath);
+    const QString root = QDir::cleanPath(searchPath);
+    QStringList candidates;
+    {
+        QMutexLocker locker(&m_indexMutex);
+        const QString indexRoot = m_contentIndex->basePath();
+        if (!m_indexBuilt || indexRoot.isEmpty() || !dependsOn(indexRoot, true, root)) {
+            return false;
+        }
         
-        // Apply filters
-        if (!matchesFilters(fileInfo, criteria)) {
+        // Terms are alternatives, so their candidates add up
+        const QStringList texts = criteria.terms.isEmpty() ? QStringList(criteria.query) : criteria.terms;
+        for (const QString &text : texts) {
+            if (!m_contentIndex->candidates(text, candidates)) {
+                return false;
+            }
+        }
+    }
+    candidates.removeDuplicates();
+    
+    const QString prefix = root.endsWith('/') ? root : root + '/';
+    const int maxDepth = criteria.searchSubfolders ? criteria.maxDepth : 0;
+    for (const QString &path : candidates) {
+        if (path.startsWith(prefix)
+            && (maxDepth < 0 || path.count('/') - prefix.count('/') <= maxDepth)
+            && (criteria.searchArchives || !ArchiveReader::isVirtualPath(path))) {
+            paths.append(path);
+        }
+    }
+    return true;
+}
+
+bool SearchEngine::nameCandidates(const QString &searchPath, const SearchContext &context, QStringList &paths)
+{
+    const SearchCriteria &criteria = context.criteria;
+    
+    // The name token index holds the non-hidden files and directories the
+    // indexer reached without following links
+    if (criteria.type != FileNameSearch || context.queryWords.isEmpty() || !m_fileIndexer
+        || criteria.searchHiddenFiles || criteria.followSymlinks || !m_fileIndexer->isIndexComplete()) {
+        return false;
+    }
+    
+    const QString root = QDir::cleanPath(searchPath);
+    const QString indexRoot = QDir::cleanPath(m_fileIndexer->basePath());
+    if (indexRoot.isEmpty() || !dependsOn(indexRoot, true, root)) {
+        return false;
+    }
+    
+    QStringList candidates;
+    if (!m_fileIndexer->nameCandidates(root, criteria.query, candidates)) {
+        return false;
+    }
+    
+    const QString prefix = root.endsWith('/') ? root : root + '/';
+    const int maxDepth = criteria.searchSubfolders ? criteria.maxDepth : 0;
+    for (const QString &path : candidates) {
+        if ((maxDepth < 0 || path.count('/') - prefix.count('/') <= maxDepth)
+            && (criteria.searchArchives || !ArchiveReader::isVirtualPath(path))) {
+            paths.append(path);
+        }
+    }
+    return true;
+}
+
+bool SearchEngine::buildSubtreeProbe(SearchContext &context) const
+{
+    const SearchCriteria &criteria = context.criteria;
+    
+    // The summaries cover what the indexer walks: no hidden entries, no
+    // followed links, no sockets or devices, no archive members
+    if (!m_fileIndexer || criteria.searchHiddenFiles || criteria.followSymlinks || criteria.searchSystemFiles
+        || criteria.searchArchives || !m_fileIndexer->isIndexComplete()) {
+        return false;
+    }
+    
+    FileIndexer::NameProbe &probe = context.subtreeProbe;
+    if (criteria.type == FileNameSearch && !criteria.useRegex) {
+        // A name matching as an identifier only holds the query's subwords
+        QVector<quint64> keys;
+        if (context.querySubwords.isEmpty()) {
+            keys = FileIndexer::trigramKeys(criteria.query);
+        }
+        for (const QString &subword : context.querySubwords) {
+            keys += FileIndexer::trigramKeys(subword);
+        }
+        if (!keys.isEmpty()) {
+            probe.append({keys});
+        }
+    }
+    for (const QueryPlan::Predicate &predicate : context.plan.predicates()) {
+        if (predicate.negated) {
             continue;
         }
-        
-        // Check if file matches search criteria
-        bool matches = false;
-        QStringList matchedLines;
-        
-        switch (criteria.type) {
-        case FileNameSearch:
-            matches = matchesFileName(fileInfo.fileName(), criteria);
-            break;
-        case ContentSearch:
-            matches = matchesContent(filePath, criteria, matchedLines);
-            break;
-        case MetadataSearch:
-            matches = matchesMetadata(fileInfo, criteria);
-            break;
-        case FuzzySearch:
-            matches = fuzzyMatch(criteria.query, fileInfo.fileName());
-            break;
-        case RegexSearch:
-            {
-                QRegularExpression regex(criteria.query);
-                matches = regex.match(fileInfo.fileName()).hasMatch();
+        if (predicate.field == QueryPlan::Name) {
+            const QVector<quint64> keys = FileIndexer::trigramKeys(predicate.values.first());
+            if (!keys.isEmpty()) {
+                probe.append({keys});
             }
-            break;
-        default:
-            matches = matchesFileName(fileInfo.fileName(), criteria);
-            break;
+        } else if (predicate.field == QueryPlan::Extension) {
+            QList<QVector<quint64>> alternatives;
+            for (const QString &extension : predicate.values) {
+                alternatives.append({FileIndexer::extensionKey(extension)});
+            }
+            probe.append(alternatives);
+        }
+    }
+    return !probe.isEmpty();
+}
+
+bool SearchEngine::subtreeMayMatch(const DirectoryEntry &directory, const SearchContext &context) const
+{
+    // The indexer only rules out subtrees it has seen no change in since the
+    // crawl; otherwise the walk goes in and looks
+    return m_fileIndexer->subtreeMayContain(directory.path, context.subtreeProbe);
+}
+
+void SearchEngine::addChangedDirectories(const QString &searchPath, SearchContext &context,
+                                         QList<PendingDirectory> &pending) const
+{
+    // The file index is a snapshot: directories whose entries changed since
+    // it was taken are walked on top of its candidates. The walk skips the
+    // unchanged directories below them, whose files the candidates cover.
+    const SearchCriteria &criteria = context.criteria;
+    const QString root = QDir::cleanPath(searchPath);
+    const QString prefix = root.endsWith('/') ? root : root + '/';
+    const int maxDepth = criteria.searchSubfolders ? criteria.maxDepth : 0;
+    for (const QString &directory : m_fileIndexer->changedDirectories(root, &context.indexedDirectories)) {
+        const int depth = directory == root ? 0 : directory.count('/') - prefix.count('/') + 1;
+        if (maxDepth < 0 || depth <= maxDepth) {
+            pending.append({directory, depth});
+        }
+    }
+}
+
+void SearchEngine::setFileIndexer(FileIndexer *indexer)
+{
+    if (m_fileIndexer) {
+        disconnect(m_fileIndexer, nullptr, this, nullptr);
+    }
+    m_fileIndexer = indexer;
+    if (m_fileIndexer) {
+        m_fileIndexer->setTypeCategories(m_fileTypeExtensions);
+        connect(m_fileIndexer, &FileIndexer::indexingCompleted, this, &SearchEngine::rebuildSuggestions);
+        connect(m_fileIndexer, &FileIndexer::indexingCompleted, this, [this]() {
+            if (m_fileIndexer->isIndexComplete()) {
+                buildIndex(m_fileIndexer->basePath());
+            }
+        });
+    }
+}
+
+void SearchEngine::searchCandidates(const QStringList &paths, SearchContext &context)
+{
+    // Archive members are checked after the other files, in one pass over
+    // each archive: a compressed tar can only be read from its start
+    QStringList files;
+    QStringList archives;
+    QHash<QString, QStringList> members;
+    for (const QString &path : paths) {
+        if (!ArchiveReader::isVirtualPath(path)) {
+            files.append(path);
+            continue;
+        }
+        const QString archive = ArchiveReader::archivePath(path);
+        if (!members.contains(archive)) {
+            archives.append(archive);
+        }
+        members[archive].append(path);
+    }
+    auto leaveUnchecked = [&](int archive) {
+        for (int i = archive; i < archives.size(); ++i) {
+            context.unchecked += members.value(archives.at(i));
+        }
+    };
+    
+    for (int i = 0; i < files.size(); ++i) {
+        const QString &filePath = files.at(i);
+        if (isStale(context.job)) {
+            context.unchecked = files.mid(i);
+            leaveUnchecked(0);
+            return;
+        }
+        if (context.deadline.hasExpired()) {
+            context.incomplete = true;
+            context.unchecked = files.mid(i);
+            leaveUnchecked(0);
+            return;
+        }
+        if (!context.pendingResults.isEmpty() && context.batchTimer.hasExpired(RESULT_BATCH_INTERVAL_MS)) {
+            flushResults(context);
+        }
+        DirectoryEntry entry(filePath);
+        searchEntry(entry, context);
+    }
+    
+    for (int i = 0; i < archives.size(); ++i) {
+        const QStringList &wanted = members.value(archives.at(i));
+        QSet<QString> remaining(wanted.constBegin(), wanted.constEnd());
+        if (!searchArchive(archives.at(i), context, &remaining)) {
+            context.unchecked += QStringList(remaining.constBegin(), remaining.constEnd());
+            leaveUnchecked(i + 1);
+            return;
+        }
+    }
+}
+
+bool SearchEngine::searchArchive(const QString &path, SearchContext &context, QSet<QString> *wanted)
+{
+    // Members are matched as the listing streams by; a content search reads
+    // them from the open archive, so the archive is only gone through once.
+    // Given wanted, only those members are matched, and taken out of it.
+    // False if the search was stopped on the way.
+    bool stopped = false;
+    ArchiveReader::forEachMember(path, [&](const ArchiveReader::Member &member,
+                                           const ArchiveReader::ContentReader &content) {
+        if (isStale(context.job)) {
+            stopped = true;
+            return false;
+        }
+        if (context.deadline.hasExpired()) {
+            context.incomplete = true;
+            stopped = true;
+            return false;
+        }
+        if (member.directory) {
+            return true;
+        }
+        if (wanted && !wanted->remove(member.path)) {
+            return true;
         }
         
-        if (matches) {
-            SearchResult result;
-            result.filePath = filePath;
-            result.fileName = fileInfo.fileName();
-            result.directory = fileInfo.dir().absolutePath();
-            result.fileInfo = fileInfo;
-            result.mimeType = m_mimeDatabase.mimeTypeForFile(filePath).name();
-            result.lastModified = fileInfo.lastModified();
-            result.fileSize = fileInfo.size();
-            result.matchedLines = matchedLines;
-            result.relevanceScore = calculateRelevanceScore(result, criteria);
-            
-            results.append(result);
-            
-            // Emit individual result
-            emit resultFound(result);
-            
-            // Check if we've reached the maximum results
-            if (results.size() >= criteria.maxResults) {
-                break;
+        DirectoryEntry entry(member.path);
+        if (entry.name.startsWith('.') && !context.criteria.searchHiddenFiles) {
+            return true;
+        }
+        entry.kind = DirectoryEntry::File;
+        entry.resolved = true;
+        entry.exists = true;
+        entry.size = member.size;
+        entry.modified = member.modified.isValid() ? member.modified.toMSecsSinceEpoch() : 0;
+        entry.content = &content;
+        searchEntry(entry, context);
+        return !wanted || !wanted->isEmpty();
+    }, m_archiveLimits);
+    return !stopped;
+}
+
+void SearchEngine::searchEntry(DirectoryEntry &entry, SearchContext &context)
+{
+    const SearchCriteria &criteria = context.criteria;
+    const QString &filePath = entry.path;
+    const QString &fileName = entry.name;
+    
+    // Candidates of a cut-short search were checked before its walk resumed
+    if (!context.checkedPaths.isEmpty() && context.checkedPaths.contains(filePath)) {
+        return;
+    }
+    
+    // Planned filters on the name and path need no stat
+    const QueryPlan &plan = context.plan;
+    if (!plan.matchesEntry(fileName, filePath)) {
+        return;
+    }
+    
+    // Name matchers also run before anything touches the inode
+    bool matches = false;
+    SearchResult result;
+    
+    switch (criteria.type) {
+    case FileNameSearch:
+        matches = matchesFileName(fileName, context, result) || matchesIdentifier(fileName, context);
+        break;
+    case ContentSearch:
+    case MetadataSearch:
+        matches = true; // Decided below, once the entry is known to exist
+        break;
+    case FuzzySearch:
+        // A query of field predicates only matches whatever passed them
+        matches = criteria.query.isEmpty() ? !plan.isEmpty() : context.fuzzyMatcher.matches(fileName);
+        break;
+    case RegexSearch:
+        matches = context.nameRegex.match(fileName).hasMatch();
+        break;
+    default:
+        matches = matchesFileName(fileName, context, result);
+        break;
+    }
+    
+    if (!matches) {
+        return;
+    }
+    
+    // From here on size and mtime are needed, for filters or for the result
+    if (!entry.resolve()) {
+        return;
+    }
+    if (entry.hidden && !criteria.searchHiddenFiles) {
+        return;
+    }
+    if (plan.filesOnly() && entry.kind != DirectoryEntry::File) {
+        return;
+    }
+    if (plan.needsStat() && !plan.matchesStat(entry.size, entry.modified)) {
+        return;
+    }
+    
+    if (criteria.type == ContentSearch) {
+        const bool member = entry.content || ArchiveReader::isVirtualPath(filePath);
+        if (entry.kind != DirectoryEntry::File) {
+            matches = false;
+        } else if (member) {
+            matches = matchesArchiveMember(entry, context, result);
+        } else if (DocumentText::isDocument(entry.name)) {
+            matches = matchesDocument(entry, context, result);
+        } else {
+            matches = matchesContent(entry, context, result);
+        }
+    } else if (criteria.type == MetadataSearch) {
+        matches = context.metadataFromIndex || matchesMetadata(filePath, criteria);
+    }
+    
+    if (!matches) {
+        return;
+    }
+    
+    if (context.candidates.size() < MAX_REFINEMENT_CANDIDATES) {
+        context.candidates.append(filePath);
+    } else {
+        context.candidatesOverflowed = true;
+    }
+    
+    result.filePath = filePath;
+    result.lastModified = QDateTime::fromMSecsSinceEpoch(entry.modified);
+    result.fileSize = entry.size;
+    result.relevanceScore = calculateRelevanceScore(result, context);
+    ++context.matchCount;
+    
+    if (context.topResults.accepts(result.relevanceScore)) {
+        context.topResults.offer(result);
+        queueResult(result, context);
+    }
+}
+
+bool SearchEngine::isRefinementOf(const SearchCriteria &criteria, const SearchCriteria &previous) const
+{
+    // Only substring queries are monotonic: whatever contains "report2" also
+    // contains "report". Regex, whole-word, fuzzy and multi-term queries can
+    // gain matches as they grow.
+    if (criteria.type != previous.type
+        || (criteria.type != FileNameSearch && criteria.type != ContentSearch)
+        || criteria.useRegex || previous.useRegex
+        || criteria.wholeWords || previous.wholeWords
+        || !criteria.terms.isEmpty() || !previous.terms.isEmpty()) {
+        return false;
+    }
+    
+    // Switching to case-insensitive broadens the query
+    if (previous.caseSensitive && !criteria.caseSensitive) {
+        return false;
+    }
+    
+    // Same traversal
+    if (criteria.searchSubfolders != previous.searchSubfolders
+        || criteria.followSymlinks != previous.followSymlinks
+        || criteria.searchHiddenFiles != previous.searchHiddenFiles
+        || criteria.searchSystemFiles != previous.searchSystemFiles
+        || criteria.searchArchives != previous.searchArchives
+        || criteria.includeBinaryFiles != previous.includeBinaryFiles) {
+        return false;
+    }
+    if (previous.maxDepth >= 0 && (criteria.maxDepth < 0 || criteria.maxDepth > previous.maxDepth)) {
+        return false;
+    }
+    
+    // The free text must extend the previous text, and every previous
+    // predicate must still hold, possibly tightened
+    const QueryPlan plan(criteria, m_fileTypeExtensions);
+    const QueryPlan previousPlan(previous, m_fileTypeExtensions);
+    if (!plan.isValid() || !previousPlan.isValid()) {
+        return false;
+    }
+    if (!plan.text().contains(previousPlan.text(), previous.caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive)) {
+        return false;
+    }
+    
+    // Phrases and NEAR match words, not substrings, on either side
+    if (criteria.type == ContentSearch
+        && (ProximityQuery::parse(plan.text()).isValid() || ProximityQuery::parse(previousPlan.text()).isValid())) {
+        return false;
+    }
+    if (!plan.implies(previousPlan)) {
+        return false;
+    }
+    
+    // Identifier matching only narrows while the words and subwords grow
+    // at their end (see IdentifierTokenizer::extendsRun). It runs on names
+    // whenever case is ignored, and on content for several subwords; text
+    // without words matched everything before.
+    if (!criteria.caseSensitive) {
+        const QStringList subwords = IdentifierTokenizer::subwords(plan.text());
+        const QStringList previousSubwords = IdentifierTokenizer::subwords(previousPlan.text());
+        const bool identifiers = !previousSubwords.isEmpty()
+            && (criteria.type == FileNameSearch || subwords.size() > 1 || previousSubwords.size() > 1);
+        if (identifiers
+            && (!IdentifierTokenizer::extendsRun(subwords, previousSubwords)
+                || !IdentifierTokenizer::extendsRun(IdentifierTokenizer::words(plan.text()),
+                                                    IdentifierTokenizer::words(previousPlan.text())))) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+QString SearchEngine::cacheKey(const SearchCriteria &criteria, const QString &searchPath) const
+{
+    // Order-insensitive lists and case-folded text where the search ignores
+    // case, so equivalent criteria share an entry
+    auto normalized = [](QStringList list, bool fold) {
+        if (fold) {
+            for (QString &item : list) {
+                item = item.toLower();
             }
         }
+        list.sort();
+        list.removeDuplicates();
+        return list.join(QChar(0x1f));
+    };
+    
+    const bool fold = !criteria.caseSensitive;
+    QStringList parts;
+    parts << QString::number(criteria.type)
+          << QDir::cleanPath(searchPath)
+          << (fold ? criteria.query.toLower() : criteria.query)
+          << normalized(criteria.terms, fold)
+          << normalized(criteria.fileTypes, true)
+          << normalized(criteria.excludePatterns, true)
+          << QString::number(criteria.maxResults)
+          << QString::number(criteria.maxDepth);
+    
+    quint32 flags = 0;
+    flags |= criteria.caseSensitive ? 1u << 0 : 0;
+    flags |= criteria.wholeWords ? 1u << 1 : 0;
+    flags |= criteria.useRegex ? 1u << 2 : 0;
+    flags |= criteria.includeBinaryFiles ? 1u << 3 : 0;
+    flags |= criteria.followSymlinks ? 1u << 4 : 0;
+    flags |= criteria.searchHiddenFiles ? 1u << 5 : 0;
+    flags |= criteria.searchSystemFiles ? 1u << 6 : 0;
+    flags |= criteria.searchSubfolders ? 1u << 7 : 0;
+    flags |= criteria.searchArchives ? 1u << 8 : 0;
+    parts << QString::number(flags);
+    
+    if (!criteria.metadata.isEmpty()) {
+        QStringList metadata;
+        for (auto it = criteria.metadata.constBegin(); it != criteria.metadata.constEnd(); ++it) {
+            metadata << it.key() + '=' + it.value().toStringList().join(',').toLower();
+        }
+        parts << normalized(metadata, false);
+    }
+    
+    if (criteria.useSizeFilter) {
+        parts << QString("size:%1-%2").arg(criteria.minSize).arg(criteria.maxSize);
+    }
+    if (criteria.useDateFilter) {
+        parts << QString("date:%1-%2")
+                 .arg(criteria.dateFrom.isValid() ? criteria.dateFrom.toMSecsSinceEpoch() : 0)
+                 .arg(criteria.dateTo.isValid() ? criteria.dateTo.toMSecsSinceEpoch() : 0);
+    }
+    
+    return parts.join(QChar(0x1e));
+}
+
+bool SearchEngine::cachedResults(const QString &key, QList<SearchResult> &results)
+{
+    QMutexLocker locker(&m_resultCacheMutex);
+    
+    auto it = m_resultCache.find(key);
+    if (it == m_resultCache.end()) {
+        return false;
+    }
+    
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (now - it->storedAt > RESULT_CACHE_TTL_MS
+        || (it->invalidatedAt != 0 && now - it->invalidatedAt > m_cacheMaxStaleness)) {
+        m_resultCache.erase(it);
+        return false;
+    }
+    
+    it->lastUsed = ++m_cacheClock;
+    results = it->results;
+    return true;
+}
+
+void SearchEngine::storeResults(const QString &key, const SearchCriteria &criteria, const QString &searchPath,
+                                const QList<SearchResult> &results, quint64 epoch)
+{
+    QMutexLocker locker(&m_resultCacheMutex);
+    
+    // Something changed since the search started; its results may miss it
+    if (epoch != m_cacheEpoch) {
+        return;
+    }
+    
+    if (!m_resultCache.contains(key) && m_resultCache.size() >= MAX_CACHED_SEARCHES) {
+        auto oldest = m_resultCache.begin();
+        for (auto it = m_resultCache.begin(); it != m_resultCache.end(); ++it) {
+            if (it->lastUsed < oldest->lastUsed) {
+                oldest = it;
+            }
+        }
+        m_resultCache.erase(oldest);
+    }
+    
+    CachedSearch entry;
+    entry.results = results;
+    entry.searchPath = QDir::cleanPath(searchPath);
+    entry.recursive = criteria.searchSubfolders;
+    entry.lastUsed = ++m_cacheClock;
+    entry.storedAt = QDateTime::currentMSecsSinceEpoch();
+    entry.invalidatedAt = 0;
+    m_resultCache.insert(key, entry);
+}
+
+bool SearchEngine::affects(const QString &path, const QString &root, bool recursive)
+{
+    // Moving or deleting an ancestor of the root changes everything below it
+    return dependsOn(root, recursive, path) || root.startsWith(path.endsWith('/') ? path : path + '/');
+}
+
+bool SearchEngine::dependsOn(const QString &root, bool recursive, const QString &path)
+{
+    // A change to the root itself, or to an entry directly inside it,
+    // affects every search of root. Deeper changes only matter to
+    // recursive searches.
+    if (path == root) {
+        return true;
+    }
+    
+    const QString prefix = root.endsWith('/') ? root : root + '/';
+    if (!path.startsWith(prefix)) {
+        return false;
     }
+    return recursive || path.indexOf('/', prefix.size()) < 0;
 }
 
-bool SearchEngine::matchesFileName(const QString &fileName, const SearchCriteria &criteria)
+void SearchEngine::invalidatePath(const QString &path)
 {
-    QString query = criteria.query;
-    QString target = fileName;
+    const QString changed = QDir::cleanPath(path);
     
-    if (!criteria.caseSensitive) {
-        query = query.toLower();
-        target = target.toLower();
+    {
+        QMutexLocker locker(&m_resultCacheMutex);
+        ++m_cacheEpoch;
+        const qint64 now = QDateTime::currentMSecsSinceEpoch();
+        for (auto it = m_resultCache.begin(); it != m_resultCache.end();) {
+            if (!affects(changed, it->searchPath, it->recursive)) {
+                ++it;
+            } else if (m_cacheMaxStaleness > 0) {
+                if (it->invalidatedAt == 0) {
+                    it->invalidatedAt = now;
+                }
+                ++it;
+            } else {
+                it = m_resultCache.erase(it);
+            }
+        }
     }
     
-    if (criteria.useRegex) {
-        QRegularExpression regex(query);
-        return regex.match(target).hasMatch();
-    } else if (criteria.wholeWords) {
-        QRegularExpression regex("\\b" + QRegularExpression::escape(query) + "\\b");
-        return regex.match(target).hasMatch();
-    } else {
-        return target.contains(query);
+    {
+        QMutexLocker locker(&m_candidateMutex);
+        if (m_hasLastCandidates
+            && affects(changed, QDir::cleanPath(m_lastCandidates.searchPath), m_lastCandidates.criteria.searchSubfolders)) {
+            m_hasLastCandidates = false;
+            m_lastCandidates.paths.clear();
+            m_lastCandidates.unwalked.clear();
+        }
+    }
+    
+    // Change events keep the file and content indexes current too
+    if (m_indexBuilt || (m_fileIndexer && m_fileIndexer->isIndexComplete())) {
+        updateIndex(changed);
     }
 }
 
-bool SearchEngine::matchesContent(const QString &filePath, const SearchCriteria &criteria, QStringList &matchedLines)
+void SearchEngine::queueResult(const SearchResult &result, SearchContext &context)
 {
-    if (!criteria.includeBinaryFiles && isBinaryFile(filePath)) {
-        return false;
+    if (context.pendingResults.isEmpty()) {
+        context.pendingResults.reserve(RESULT_BATCH_SIZE);
+        context.batchTimer.start();
     }
+    context.pendingResults.append(result);
     
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        return false;
+    if (context.pendingResults.size() >= RESULT_BATCH_SIZE
+        || context.batchTimer.hasExpired(RESULT_BATCH_INTERVAL_MS)) {
+        flushResults(context);
     }
-    
-    QTextStream stream(&file);
-    QString content = stream.readAll();
-    file.close();
-    
-    QString query = criteria.query;
-    QString target = content;
-    
-    if (!criteria.caseSensitive) {
-        query = query.toLower();
-        target = target.toLower();
+}
+
+void SearchEngine::flushResults(SearchContext &context)
+{
+    if (context.pendingResults.isEmpty()) {
+        return;
+    }
+    if (isStale(context.job)) {
+        context.pendingResults.clear();
+        return;
     }
     
-    bool matches = false;
-    if (criteria.useRegex) {
-        QRegularExpression regex(query);
-        matches = regex.match(target).hasMatch();
-    } else if (criteria.wholeWords) {
-        QRegularExpression regex("\\b" + QRegularExpression::escape(query) + "\\b");
-        matches = regex.match(target).hasMatch();
-    } else {
-        matches = target.contains(query);
-    }
-    
-    if (matches) {
-        // Extract matching lines
-        QStringList lines = content.split('\n');
-        for (const QString &line : lines) {
-            QString testLine = criteria.caseSensitive ? line : line.toLower();
-            if (testLine.contains(query)) {
-                matchedLines.append(line.trimmed());
-                if (matchedLines.size() >= 10) { // Limit to 10 matching lines
-                    break;
-                }
-            }
+    // The batch is handed over whole; the next one starts a fresh list
+    QList<SearchResult> batch;
+    batch.swap(context.pendingResults);
+    const quint64 jobId = context.job.id;
+    post(jobId, [this, batch, jobId]() {
+        emit resultsFound(batch, jobId);
+    });
+}
+
+bool SearchEngine::matchesFileName(const QString &fileName, const SearchContext &context, SearchResult &result)
+{
+    const SearchCriteria &criteria = context.criteria;
+    const Qt::CaseSensitivity cs = criteria.caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive;
+    
+    if (criteria.useRegex || criteria.wholeWords) {
+        const QRegularExpressionMatch match = context.nameRegex.match(fileName);
+        if (!match.hasMatch()) {
+            return false;
         }
+        result.nameMatches.append({static_cast<int>(match.capturedStart()), static_cast<int>(match.capturedLength())});
+        return true;
     }
     
-    return matches;
+    const int start = fileName.indexOf(criteria.query, 0, cs);
+    if (start < 0) {
+        return false;
+    }
+    result.nameMatches.append({start, static_cast<int>(criteria.query.size())});
+    return true;
 }
 
-bool SearchEngine::matchesMetadata(const QFileInfo &fileInfo, const SearchCriteria &criteria)
+bool SearchEngine::matchesIdentifier(const QString &fileName, const SearchContext &context)
 {
-    Q_UNUSED(fileInfo)
-    Q_UNUSED(criteria)
-    // This would check file metadata like tags, comments, etc.
-    return false;
+    // Any match holds every subword somewhere in the name
+    if (context.queryWords.isEmpty() || !fileName.contains(context.longestSubword, Qt::CaseInsensitive)) {
+        return false;
+    }
+    if (IdentifierTokenizer::containsRun(IdentifierTokenizer::words(fileName), context.queryWords)) {
+        return true;
+    }
+    return context.querySubwords.size() > 1
+        && IdentifierTokenizer::containsRun(IdentifierTokenizer::subwords(fileName), context.querySubwords);
 }
 
-bool SearchEngine::matchesFilters(const QFileInfo &fileInfo, const SearchCriteria &criteria)
+bool SearchEngine::matchesContent(const DirectoryEntry &entry, const SearchContext &context, SearchResult &result)
 {
-    // Size filter
-    if (criteria.useSizeFilter) {
-        qint64 fileSize = fileInfo.size();
-        if (criteria.minSize > 0 && fileSize < criteria.minSize) {
-            return false;
-        }
-        if (criteria.maxSize > 0 && fileSize > criteria.maxSize) {
-            return false;
-        }
-    }
+    const SearchCriteria &criteria = context.criteria;
     
-    // Date filter
-    if (criteria.useDateFilter) {
-        QDateTime modifiedTime = fileInfo.lastModified();
-        if (criteria.dateFrom.isValid() && modifiedTime < criteria.dateFrom) {
-            return false;
-        }
-        if (criteria.dateTo.isValid() && modifiedTime > criteria.dateTo) {
-            return false;
-        }
+    // The walk's stat already identifies the file; no second one is needed
+    const FileIdentity identity = {entry.device, entry.inode, entry.modifiedNsecs, entry.size};
+    const bool haveIdentity = entry.exists && entry.inode != 0;
+    int verdict = haveIdentity ? cachedBinaryVerdict(identity) : -1;
+    
+    // Known binary files are skipped without being opened
+    if (verdict == 1 && !criteria.includeBinaryFiles) {
+        return false;
     }
     
-    // File type filter
-    if (!criteria.fileTypes.isEmpty()) {
-        QString extension = fileInfo.suffix().toLower();
-        bool matchesType = false;
-        for (const QString &type : criteria.fileTypes) {
-            if (m_fileTypeExtensions.contains(type)) {
-                if (m_fileTypeExtensions[type].contains(extension)) {
-                    matchesType = true;
-                    break;
-                }
-            } else if (type.toLower() == extension) {
-                matchesType = true;
-                break;
-            }
-        }
-        if (!matchesType) {
-            return false;
-        }
+    QFile file(entry.path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
     }
     
-    // Exclude patterns
-    for (const QString &pattern : criteria.excludePatterns) {
-        if (fileInfo.fileName().contains(pattern, Qt::CaseInsensitive)) {
-            return false;
+    // Classify on the first buffer of the single content read
+    QByteArray data = file.read(SNIFF_BUFFER_SIZE);
+    if (verdict < 0) {
+        const bool binary = ContentMatcher::looksBinary(data);
+        if (haveIdentity) {
+            storeBinaryVerdict(identity, binary);
         }
+        verdict = binary ? 1 : 0;
+    }
+    if (verdict == 1 && !criteria.includeBinaryFiles) {
+        return false;
     }
     
-    return true;
+    data += file.readAll();
+    file.close();
+    
+    return matchesText(data, context, result);
 }
 
-double SearchEngine::calculateFuzzyScore(const QString &query, const QString &target)
+bool SearchEngine::matchesArchiveMember(const DirectoryEntry &entry, const SearchContext &context, SearchResult &result)
 {
-    if (query.isEmpty() || target.isEmpty()) {
-        return 0.0;
+    // Members the walk lists come from the open archive; index candidates
+    // are looked up in theirs
+    QByteArray data;
+    const bool read = entry.content ? (*entry.content)(data)
+                                    : ArchiveReader::readMember(entry.path, data, m_archiveLimits);
+    if (!read) {
+        return false;
     }
-    
-    QString lowerQuery = query.toLower();
-    QString lowerTarget = target.toLower();
-    
-    // Simple fuzzy matching using Levenshtein distance
-    int maxLen = qMax(lowerQuery.length(), lowerTarget.length());
-    int distance = 0;
-    
-    int minLen = qMin(lowerQuery.length(), lowerTarget.length());
-    for (int i = 0; i < minLen; ++i) {
-        if (lowerQuery[i] != lowerTarget[i]) {
-            distance++;
-        }
+    if (!context.criteria.includeBinaryFiles && ContentMatcher::looksBinary(data.left(SNIFF_BUFFER_SIZE))) {
+        return false;
+    }
+    return matchesText(data, context, result);
+}
+
+bool SearchEngine::matchesDocument(const DirectoryEntry &entry, const SearchContext &context, SearchResult &result)
+{
+    // The text, not the zip around it, is searched; it is never binary.
+    // Text past the limits is missed here as it is in the index.
+    QString text;
+    if (!DocumentText::extract(entry.path, text, m_documentLimits)) {
+        return matchesContent(entry, context, result);
+    }
+    return matchesText(text.toUtf8(), context, result);
+}
+
+bool SearchEngine::matchesText(const QByteArray &data, const SearchContext &context, SearchResult &result)
+{
+    const ContentMatcher &contentMatcher = context.contentMatcher;
+    if (contentMatcher.isMultiTerm()) {
+        // All terms are matched in one pass over the bytes as UTF-8
+        return contentMatcher.matchesTerms(data, result.matchedLines, result.termMatches);
     }
-    distance += qAbs(lowerQuery.length() - lowerTarget.length());
     
-    return 1.0 - (double)distance / maxLen;
+    // Literal prefiltering and line extraction happen inside the matcher,
+    // on the raw bytes unless the file needs decoding
+    return contentMatcher.matches(data, result.matchedLines);
+}
+
+bool SearchEngine::matchesMetadata(const QString &filePath, const SearchCriteria &criteria)
+{
+    // Without requirements every file would match
+    if (criteria.metadata.isEmpty() && criteria.query.isEmpty()) {
+        return false;
+    }
+    return ExtendedAttributes::read(filePath).matches(criteria.metadata, criteria.query);
+}
+
+double SearchEngine::calculateFuzzyScore(const QString &query, const QString &target)
+{
+    return FuzzyMatcher(query).score(target);
 }
 
 bool SearchEngine::fuzzyMatch(const QString &query, const QString &target, double threshold)
 {
-    return calculateFuzzyScore(query, target) >= threshold;
+    return FuzzyMatcher(query).matches(target, threshold);
 }
 
 bool SearchEngine::isBinaryFile(const QString &filePath)
 {
+    FileIdentity identity;
+    const bool haveIdentity = fileIdentity(filePath, identity);
+    if (haveIdentity) {
+        const int verdict = cachedBinaryVerdict(identity);
+        if (verdict >= 0) {
+            return verdict == 1;
+        }
+    }
+    
     QFile file(filePath);
     if (!file.open(QIODevice::ReadOnly)) {
         return true; // Assume binary if we can't read it
     }
     
-    // Read first 1KB to check for null bytes
-    QByteArray data = file.read(1024);
+    QByteArray data = file.read(SNIFF_BUFFER_SIZE);
     file.close();
     
-    return data.contains('\0');
+    const bool binary = ContentMatcher::looksBinary(data);
+    if (haveIdentity) {
+        storeBinaryVerdict(identity, binary);
+    }
+    return binary;
+}
+
+bool SearchEngine::fileIdentity(const QString &filePath, FileIdentity &identity) const
+{
+    struct stat st;
+    if (::stat(QFile::encodeName(filePath).constData(), &st) != 0) {
+        return false;
+    }
+    
+    identity.device = static_cast<quint64>(st.st_dev);
+    identity.inode = static_cast<quint64>(st.st_ino);
+    identity.modifiedNsecs = modifiedNsecs(st);
+    identity.size = static_cast<qint64>(st.st_size);
+    return true;
+}
+
+int SearchEngine::cachedBinaryVerdict(const FileIdentity &identity)
+{
+    QMutexLocker locker(&m_binaryVerdictMutex);
+    
+    auto it = m_binaryVerdicts.constFind(qMakePair(identity.device, identity.inode));
+    if (it == m_binaryVerdicts.constEnd()) {
+        return -1;
+    }
+    // A changed file has to be sniffed again
+    if (it->modifiedNsecs != identity.modifiedNsecs || it->size != identity.size) {
+        return -1;
+    }
+    return it->binary ? 1 : 0;
+}
+
+void SearchEngine::storeBinaryVerdict(const FileIdentity &identity, bool binary)
+{
+    QMutexLocker locker(&m_binaryVerdictMutex);
+    
+    if (m_binaryVerdicts.size() >= MAX_BINARY_VERDICTS) {
+        m_binaryVerdicts.clear();
+    }
+    m_binaryVerdicts.insert(qMakePair(identity.device, identity.inode),
+                            BinaryVerdict{identity.modifiedNsecs, identity.size, binary});
 }
 
-double SearchEngine::calculateRelevanceScore(const SearchResult &result, const SearchCriteria &criteria)
+double SearchEngine::calculateRelevanceScore(const SearchResult &result, const SearchContext &context)
 {
+    const SearchCriteria &criteria = context.criteria;
     double score = 0.0;
     
     QString query = criteria.caseSensitive ? criteria.query : criteria.query.toLower();
-    QString fileName = criteria.caseSensitive ? result.fileName : result.fileName.toLower();
+    const QString name = result.fileName();
+    QString fileName = criteria.caseSensitive ? name : name.toLower();
     
     // Exact match gets highest score
     if (fileName == query) {
@@ -413,9 +1673,12 @@ double SearchEngine::calculateRelevanceScore(const SearchResult &result, const S
     }
     // Fuzzy match
     else {
-        score += calculateFuzzyScore(query, fileName) * 25.0;
+        score += context.fuzzyMatcher.score(name) * 45.0;
     }
     
+    // Multi-term content queries favour files hitting more distinct terms
+    score += result.termMatches.size() * 10.0;
+    
     // Bonus for recent files
     qint64 daysSinceModified = result.lastModified.daysTo(QDateTime::currentDateTime());
     if (daysSinceModified < 7) {
@@ -431,7 +1694,8 @@ void SearchEngine::rankResults(QList<SearchResult> &results, const SearchCriteri
 {
     Q_UNUSED(criteria)
     
-    std::sort(results.begin(), results.end(), [](const SearchResult &a, const SearchResult &b) {
+    // Stable, so equally scored results keep their discovery order
+    std::stable_sort(results.begin(), results.end(), [](const SearchResult &a, const SearchResult &b) {
         return a.relevanceScore > b.relevanceScore;
     });
 }
@@ -469,6 +1733,7 @@ int SearchEngine::timeout() const
 void SearchEngine::setThreadCount(int threadCount)
 {
     m_threadCount = threadCount;
+    m_searchPool.setMaxThreadCount(qMax(1, threadCount));
 }
 
 int SearchEngine::threadCount() const
@@ -476,6 +1741,28 @@ int SearchEngine::threadCount() const
     return m_threadCount;
 }
 
+void SearchEngine::setCacheMaxStaleness(int milliseconds)
+{
+    QMutexLocker locker(&m_resultCacheMutex);
+    m_cacheMaxStaleness = qMax(0, milliseconds);
+}
+
+int SearchEngine::cacheMaxStaleness() const
+{
+    return m_cacheMaxStaleness;
+}
+
+void SearchEngine::clearResultCache()
+{
+    QMutexLocker locker(&m_resultCacheMutex);
+    m_resultCache.clear();
+}
+
+bool SearchEngine::isLastSearchComplete() const
+{
+    return m_lastSearchComplete.loadAcquire();
+}
+
 int SearchEngine::getLastSearchTime() const
 {
     return m_lastSearchTime;
@@ -491,15 +1778,27 @@ QString SearchEngine::getSearchStatistics() const
     return QString("Last search: %1ms, Results: %2").arg(m_lastSearchTime).arg(m_resultCount);
 }
 
-void SearchEngine::onSearchFinished()
+void SearchEngine::onSearchFinished(quint64 jobId)
 {
-    m_isSearching.storeRelease(0);
-    m_lastSearchTime = m_elapsedTimer->elapsed();
+    // Cancelled jobs were already dropped from the list
+    std::shared_ptr<SearchJob> job = m_jobs.take(jobId);
+    if (!job || job->priority != InteractivePriority) {
+        return;
+    }
+    m_lastSearchTime = job->timer.elapsed();
+    m_resultCount = job->resultCount;
+    m_lastSearchComplete.storeRelease(job->complete ? 1 : 0);
 }
 
 void SearchEngine::onIndexingFinished()
 {
-    m_indexBuilt = true;
+    if (m_indexCancelled.loadAcquire()) {
+        return;
+    }
+    {
+        QMutexLocker locker(&m_indexMutex);
+        m_indexBuilt = true;
+    }
     emit indexingCompleted();
 }
 
@@ -508,87 +1807,134 @@ void SearchEngine::onSearchWorkerFinished()
     // Handle search worker completion
 }
 
-// Stub implementations for advanced features
-void SearchEngine::searchByName(const QString &pattern, const QString &basePath)
+// Advanced search methods: criteria presets over search()
+quint64 SearchEngine::searchByName(const QString &pattern, const QString &basePath)
 {
     SearchCriteria criteria;
     criteria.query = pattern;
     criteria.type = FileNameSearch;
+    criteria.scope = basePath.isEmpty() ? CurrentDirectory : CustomPath;
     criteria.customPath = basePath;
-    search(criteria);
+    return search(criteria);
 }
 
-void SearchEngine::searchByContent(const QString &text, const QString &basePath)
+quint64 SearchEngine::searchByContent(const QString &text, const QString &basePath)
 {
     SearchCriteria criteria;
     criteria.query = text;
     criteria.type = ContentSearch;
+    criteria.scope = basePath.isEmpty() ? CurrentDirectory : CustomPath;
+    criteria.customPath = basePath;
+    return search(criteria);
+}
+
+quint64 SearchEngine::searchByContent(const QStringList &terms, const QString &basePath)
+{
+    SearchCriteria criteria;
+    criteria.terms = terms;
+    criteria.type = ContentSearch;
+    criteria.scope = basePath.isEmpty() ? CurrentDirectory : CustomPath;
     criteria.customPath = basePath;
-    search(criteria);
+    return search(criteria);
 }
 
-void SearchEngine::searchByMetadata(const QHash<QString, QVariant> &metadata, const QString &basePath)
+quint64 SearchEngine::searchByMetadata(const QHash<QString, QVariant> &metadata, const QString &basePath)
 {
-    Q_UNUSED(metadata)
-    Q_UNUSED(basePath)
-    // TODO: Implement metadata search
+    SearchCriteria criteria;
+    criteria.metadata = metadata;
+    criteria.type = MetadataSearch;
+    criteria.scope = basePath.isEmpty() ? CurrentDirectory : CustomPath;
+    criteria.customPath = basePath;
+    return search(criteria);
 }
 
-void SearchEngine::searchByRegex(const QRegularExpression &regex, const QString &basePath)
+quint64 SearchEngine::searchByRegex(const QRegularExpression &regex, const QString &basePath)
 {
     SearchCriteria criteria;
     criteria.query = regex.pattern();
     criteria.type = RegexSearch;
     criteria.useRegex = true;
+    criteria.scope = basePath.isEmpty() ? CurrentDirectory : CustomPath;
     criteria.customPath = basePath;
-    search(criteria);
+    return search(criteria);
 }
 
-void SearchEngine::fuzzySearch(const QString &query, const QString &basePath)
+quint64 SearchEngine::fuzzySearch(const QString &query, const QString &basePath)
 {
     SearchCriteria criteria;
     criteria.query = query;
     criteria.type = FuzzySearch;
     criteria.fuzzyMatching = true;
+    criteria.scope = basePath.isEmpty() ? CurrentDirectory : CustomPath;
     criteria.customPath = basePath;
-    search(criteria);
+    return search(criteria);
 }
 
-void SearchEngine::searchByDateRange(const QDateTime &from, const QDateTime &to, const QString &basePath)
+quint64 SearchEngine::searchByDateRange(const QDateTime &from, const QDateTime &to, const QString &basePath)
 {
     SearchCriteria criteria;
     criteria.type = DateSearch;
     criteria.useDateFilter = true;
     criteria.dateFrom = from;
     criteria.dateTo = to;
+    criteria.scope = basePath.isEmpty() ? CurrentDirectory : CustomPath;
     criteria.customPath = basePath;
-    search(criteria);
+    return search(criteria);
 }
 
-void SearchEngine::searchBySizeRange(qint64 minSize, qint64 maxSize, const QString &basePath)
+quint64 SearchEngine::searchBySizeRange(qint64 minSize, qint64 maxSize, const QString &basePath)
 {
     SearchCriteria criteria;
     criteria.type = SizeSearch;
     criteria.useSizeFilter = true;
     criteria.minSize = minSize;
     criteria.maxSize = maxSize;
+    criteria.scope = basePath.isEmpty() ? CurrentDirectory : CustomPath;
     criteria.customPath = basePath;
-    search(criteria);
+    return search(criteria);
 }
 
-void SearchEngine::searchByType(const QStringList &mimeTypes, const QString &basePath)
+quint64 SearchEngine::searchByType(const QStringList &mimeTypes, const QString &basePath)
 {
     SearchCriteria criteria;
     criteria.type = TypeSearch;
     criteria.fileTypes = mimeTypes;
+    criteria.scope = basePath.isEmpty() ? CurrentDirectory : CustomPath;
     criteria.customPath = basePath;
-    search(criteria);
+    return search(criteria);
 }
 
 void SearchEngine::saveSearch(const SearchCriteria &criteria)
 {
-    Q_UNUSED(criteria)
-    // TODO: Implement search history saving
+    const QString query = criteria.query.trimmed();
+    if (query.isEmpty()) {
+        return;
+    }
+    
+    auto forget = [this](const SearchCriteria &old) {
+        auto count = m_queryCounts.find(old.query.trimmed());
+        if (count != m_queryCounts.end() && --count.value() == 0) {
+            m_queryCounts.erase(count);
+        }
+    };
+    
+    // Search-as-you-type runs a search per keystroke; a query that extends
+    // or trims the previous one replaces it instead of piling up prefixes
+    if (!m_searchHistory.isEmpty()) {
+        const SearchCriteria &last = m_searchHistory.first();
+        const QString previous = last.query.trimmed();
+        if (last.type == criteria.type
+            && (query.startsWith(previous, Qt::CaseInsensitive) || previous.startsWith(query, Qt::CaseInsensitive))) {
+            forget(last);
+            m_searchHistory.removeFirst();
+        }
+    }
+    
+    m_searchHistory.prepend(criteria);
+    ++m_queryCounts[query];
+    while (m_searchHistory.size() > MAX_SEARCH_HISTORY) {
+        forget(m_searchHistory.takeLast());
+    }
 }
 
 QList<SearchEngine::SearchCriteria> SearchEngine::getSearchHistory() const
@@ -598,44 +1944,330 @@ QList<SearchEngine::SearchCriteria> SearchEngine::getSearchHistory() const
 
 QStringList SearchEngine::getSearchSuggestions(const QString &partial) const
 {
-    Q_UNUSED(partial)
-    return QStringList();
+    QStringList suggestions;
+    if (partial.trimmed().isEmpty()) {
+        return suggestions;
+    }
+    
+    QList<SuggestionTrie::Suggestion> candidates;
+    {
+        QMutexLocker locker(&m_suggestionMutex);
+        candidates = m_suggestions->complete(partial, MAX_SUGGESTIONS);
+    }
+    
+    // Recent queries may not be in the trie yet; they are few enough to
+    // check directly. The heavier weight wins for text in both.
+    for (auto it = m_queryCounts.constBegin(); it != m_queryCounts.constEnd(); ++it) {
+        if (it.key().startsWith(partial, Qt::CaseInsensitive)) {
+            candidates.append({it.key(), it.value() * QUERY_WEIGHT});
+        }
+    }
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     [](const SuggestionTrie::Suggestion &a, const SuggestionTrie::Suggestion &b) {
+        return a.weight > b.weight;
+    });
+    
+    QSet<QString> seen;
+    for (const SuggestionTrie::Suggestion &candidate : candidates) {
+        const QString key = candidate.text.toCaseFolded();
+        if (seen.contains(key)) {
+            continue;
+        }
+        seen.insert(key);
+        suggestions.append(candidate.text);
+        if (suggestions.size() == MAX_SUGGESTIONS) {
+            break;
+        }
+    }
+    return suggestions;
 }
 
 void SearchEngine::clearSearchHistory()
 {
     m_searchHistory.clear();
+    m_queryCounts.clear();
+}
+
+void SearchEngine::rebuildSuggestions()
+{
+    if (m_suggestionBuild.isRunning()) {
+        return;
+    }
+    
+    FileIndexer *indexer = m_fileIndexer;
+    const QHash<QString, quint32> queryCounts = m_queryCounts;
+    m_suggestionBuild = QtConcurrent::run([this, indexer, queryCounts]() {
+        QHash<QString, quint32> weights;
+        if (indexer) {
+            weights = indexer->fileNameCounts();
+        }
+        for (auto it = queryCounts.constBegin(); it != queryCounts.constEnd(); ++it) {
+            weights[it.key()] += it.value() * QUERY_WEIGHT;
+        }
+        
+        // Served from the mapped file when it could be written, from memory
+        // otherwise
+        const QByteArray data = SuggestionTrie::build(weights);
+        std::unique_ptr<SuggestionTrie> trie(new SuggestionTrie);
+        const QString fileName = suggestionsFile();
+        if (!SuggestionTrie::save(fileName, data) || !trie->open(fileName)) {
+            trie->load(data);
+        }
+        
+        QMutexLocker locker(&m_suggestionMutex);
+        m_suggestions.swap(trie);
+    });
 }
 
 void SearchEngine::buildIndex(const QString &basePath)
 {
-    Q_UNUSED(basePath)
-    // TODO: Implement index building
+    if (m_indexWatcher.isRunning()) {
+        return;
+    }
+    
+    const QString root = QDir::cleanPath(basePath.isEmpty()
+        ? QStandardPaths::writableLocation(QStandardPaths::HomeLocation) : basePath);
+    m_indexCancelled.storeRelease(0);
+    m_indexWatcher.setFuture(QtConcurrent::run([this, root]() {
+        buildContentIndex(root);
+    }));
 }
 
 void SearchEngine::updateIndex(const QString &path)
 {
-    Q_UNUSED(path)
-    // TODO: Implement index updating
+    // Runs like a background search; unchanged files cost one stat
+    const QString changed = QDir::cleanPath(path);
+    m_searchPool.start([this, changed]() {
+        if (m_fileIndexer && m_fileIndexer->isIndexComplete()) {
+            m_fileIndexer->refreshPath(changed);
+        }
+        refreshContent(changed);
+    }, BackgroundPriority);
 }
 
 void SearchEngine::removeFromIndex(const QString &path)
 {
-    Q_UNUSED(path)
-    // TODO: Implement index removal
+    const QString removed = QDir::cleanPath(path);
+    
+    QMutexLocker locker(&m_indexMutex);
+    m_contentIndex->remove(removed);
+    m_contentIndex->removeUnder(removed);
+    m_contentIndex->removeUnder(ArchiveReader::virtualPath(removed, QString()));
 }
 
 void SearchEngine::clearIndex()
 {
     m_fileIndex.clear();
-    m_contentIndex.clear();
     m_metadataIndex.clear();
+    
+    QMutexLocker locker(&m_indexMutex);
+    m_contentIndex->clear();
     m_indexBuilt = false;
 }
 
+void SearchEngine::buildContentIndex(const QString &basePath)
+{
+    // The file index's list when it covers exactly this tree, a walk of our
+    // own otherwise. Both leave out hidden entries.
+    QStringList files;
+    if (m_fileIndexer && m_fileIndexer->isIndexComplete() && QDir::cleanPath(m_fileIndexer->basePath()) == basePath) {
+        files = m_fileIndexer->getIndexedPaths();
+        
+        // Archive members are indexed along with their archive
+        files.erase(std::remove_if(files.begin(), files.end(), [](const QString &path) {
+            return ArchiveReader::isVirtualPath(path);
+        }), files.end());
+    } else {
+        QDirIterator iterator(basePath, QDir::Files, QDirIterator::Subdirectories);
+        while (iterator.hasNext() && !m_indexCancelled.loadAcquire()) {
+            files.append(iterator.next());
+        }
+    }
+    
+    // What the index held before this build; change events may add to it
+    // while the build runs
+    QStringList indexedBefore;
+    {
+        QMutexLocker locker(&m_indexMutex);
+        if (m_contentIndex->basePath() != basePath) {
+            m_contentIndex->clear();
+            m_contentIndex->setBasePath(basePath);
+            m_indexBuilt = false;
+        }
+        indexedBefore = m_contentIndex->paths();
+    }
+    
+    // Checkpoints keep a long first build from starting over after a quit;
+    // the saved index is only searched once a build has confirmed it
+    QElapsedTimer sinceCheckpoint;
+    sinceCheckpoint.start();
+    int lastProgress = -1;
+    for (int i = 0; i < files.size(); ++i) {
+        if (m_indexCancelled.loadAcquire()) {
+            saveContentIndex();
+            return;
+        }
+        indexContentFile(files.at(i));
+        
+        const int progress = static_cast<int>((i + 1) * 100LL / files.size());
+        if (progress != lastProgress) {
+            lastProgress = progress;
+            emit indexingProgress(progress);
+        }
+        if (sinceCheckpoint.hasExpired(INDEX_CHECKPOINT_INTERVAL_MS)) {
+            saveContentIndex();
+            sinceCheckpoint.restart();
+        }
+    }
+    
+    // Files that were indexed before and are gone now; members go with
+    // their archive. Only the earlier entries are swept, and only if their
+    // file is really missing: the listing predates anything refreshContent()
+    // added meanwhile.
+    const QSet<QString> present(files.begin(), files.end());
+    QStringList gone;
+    for (const QString &path : indexedBefore) {
+        const QString file = ArchiveReader::archivePath(path);
+        if (!present.contains(file) && !QFileInfo::exists(file)) {
+            gone.append(path);
+        }
+    }
+    {
+        QMutexLocker locker(&m_indexMutex);
+        for (const QString &path : gone) {
+            m_contentIndex->remove(path);
+        }
+    }
+    saveContentIndex();
+}
+
+void SearchEngine::saveContentIndex()
+{
+    // Saved from a copy, which shares the index's data, so searches
+    // aren't held up by the write
+    ContentIndex snapshot;
+    {
+        QMutexLocker locker(&m_indexMutex);
+        snapshot = *m_contentIndex;
+    }
+    QDir().mkpath(QFileInfo(contentIndexFile()).absolutePath());
+    snapshot.save(contentIndexFile());
+}
+
+void SearchEngine::refreshContent(const QString &path)
+{
+    {
+        QMutexLocker locker(&m_indexMutex);
+        const QString root = m_contentIndex->basePath();
+        if (root.isEmpty() || !dependsOn(root, true, path)) {
+            return;
+        }
+    }
+    
+    const QFileInfo info(path);
+    if (info.isHidden()) {
+        return;
+    }
+    if (info.isFile()) {
+        indexContentFile(path);
+        return;
+    }
+    if (!info.isDir()) {
+        removeFromIndex(path);
+        return;
+    }
+    
+    // The directory's own files; subdirectories report their own changes
+    const QString prefix = path.endsWith('/') ? path : path + '/';
+    QSet<QString> present;
+    for (const QFileInfo &child : QDir(path).entryInfoList(QDir::Files)) {
+        present.insert(child.filePath());
+        indexContentFile(child.filePath());
+    }
+    
+    QMutexLocker locker(&m_indexMutex);
+    for (const QString &indexed : m_contentIndex->paths()) {
+        if (indexed.startsWith(prefix) && indexed.indexOf('/', prefix.size()) < 0 && !present.contains(indexed)) {
+            m_contentIndex->remove(indexed);
+        }
+    }
+}
+
+void SearchEngine::indexContentFile(const QString &path)
+{
+    const QFileInfo info(path);
+    quint64 previousHash = 0;
+    {
+        QMutexLocker locker(&m_indexMutex);
+        if (m_contentIndex->isCurrent(path, info.size(), info.lastModified().toMSecsSinceEpoch())) {
+            return;
+        }
+        previousHash = m_contentIndex->contentHash(path);
+    }
+    
+    // Read and tokenized without the lock, so searches keep running. Office
+    // documents are indexed by their text, under the file's own size and
+    // mtime so isCurrent() holds until the file changes.
+    ContentIndex::Document document;
+    QString text;
+    bool complete = true;
+    if (DocumentText::isDocument(path) && DocumentText::extract(path, text, m_documentLimits, &complete)) {
+        document = m_contentIndex->prepare(path, text.toUtf8(), info.lastModified().toMSecsSinceEpoch(), previousHash);
+        document.size = info.size();
+        // Text cut off by the limits may hold any word
+        document.oversized = document.oversized || !complete;
+    } else {
+        document = m_contentIndex->prepare(path, previousHash);
+    }
+    const bool archive = ArchiveReader::isArchive(path);
+    {
+        QMutexLocker locker(&m_indexMutex);
+        m_contentIndex->add(document);
+        
+        // A changed archive's members are read again, if at all
+        if (archive) {
+            m_contentIndex->removeUnder(ArchiveReader::virtualPath(path, QString()));
+        }
+    }
+    
+    if (archive && m_indexArchiveContent.loadAcquire()) {
+        indexArchiveContent(path);
+    }
+}
+
+void SearchEngine::indexArchiveContent(const QString &path)
+{
+    ArchiveReader::forEachMember(path, [&](const ArchiveReader::Member &member,
+                                           const ArchiveReader::ContentReader &content) {
+        if (m_indexCancelled.loadAcquire()) {
+            return false;
+        }
+        QByteArray data;
+        if (member.directory || !content(data)) {
+            return true;
+        }
+        
+        const qint64 modified = member.modified.isValid() ? member.modified.toMSecsSinceEpoch() : 0;
+        const ContentIndex::Document document = m_contentIndex->prepare(member.path, data, modified);
+        QMutexLocker locker(&m_indexMutex);
+        m_contentIndex->add(document);
+        return true;
+    }, m_archiveLimits);
+}
+
 bool SearchEngine::isIndexBuilt() const
 {
     return m_indexBuilt;
 }
 
+void SearchEngine::setArchiveContentIndexing(bool enabled)
+{
+    m_indexArchiveContent.storeRelease(enabled ? 1 : 0);
+}
+
+bool SearchEngine::archiveContentIndexing() const
+{
+    return m_indexArchiveContent.loadAcquire();
+}
+
 #include "SearchEngine.moc" 
\ No newline at end of file
@@ -14,10 +14,22 @@
 #include <QTimer>
 #include <QElapsedTimer>
 #include <QHash>
+#include <QVariant>
 #include <QSet>
+#include <QPair>
 #include <QAtomicInt>
 #include <QQueue>
+#include <QThreadPool>
 #include <memory>
+#include <functional>
+
+#include "ArchiveReader.h"
+#include "DocumentText.h"
+
+class ContentMatcher;
+class FileIndexer;
+class SuggestionTrie;
+class ContentIndex;
 
 class SearchEngine : public QObject
 {
@@ -44,8 +56,19 @@ public:
         CustomPath
     };
 
+    // Interactive searches replace each other: starting one cancels the
+    // previous interactive job and drops whatever it still reports.
+    // Background searches (saved searches, watchers) run alongside them and
+    // only start once no interactive job is waiting for a thread.
+    enum SearchPriority {
+        BackgroundPriority,
+        InteractivePriority
+    };
+
     struct SearchCriteria {
         QString query;
+        QStringList terms;          // Content search for files containing any of these
+        QHash<QString, QVariant> metadata;  // MetadataSearch requirements, see ExtendedAttributes::matches()
         SearchType type;
         SearchScope scope;
         QString customPath;
@@ -66,6 +89,7 @@ public:
         bool followSymlinks;
         bool searchHiddenFiles;
         bool searchSystemFiles;
+        bool searchArchives;        // Also match zip and tar members, by virtual path (see ArchiveReader)
         bool fuzzyMatching;
         
         // Filter options
@@ -90,6 +114,7 @@ public:
             followSymlinks(false),
             searchHiddenFiles(false),
             searchSystemFiles(false),
+            searchArchives(false),
             fuzzyMatching(false),
             useSizeFilter(false),
             useDateFilter(false),
@@ -100,40 +125,53 @@ public:
         {}
     };
 
+    // Compact result record. Only what the search itself produces is stored;
+    // everything else is derived from the path when a row is displayed.
     struct SearchResult {
+        struct MatchSpan {
+            int start;
+            int length;
+        };
+        
         QString filePath;
-        QString fileName;
-        QString directory;
-        QFileInfo fileInfo;
-        QString mimeType;
         double relevanceScore;
-        QStringList matchedLines;
-        QList<int> matchPositions;
-        QString preview;
-        QDateTime lastModified;
         qint64 fileSize;
+        QDateTime lastModified;
+        QList<MatchSpan> nameMatches;            // Spans of the query in fileName()
+        QStringList matchedLines;
+        QHash<QString, QList<int>> termMatches; // Term -> matching line numbers
         
         SearchResult() : relevanceScore(0.0), fileSize(0) {}
+        
+        QString fileName() const;
+        QString directory() const;
+        QFileInfo fileInfo() const;
+        QString mimeType() const;   // May read the file to sniff its content
     };
 
     explicit SearchEngine(QObject *parent = nullptr);
     ~SearchEngine();
 
-    // Main search interface
-    void search(const QString &query, const QString &basePath = QString());
-    void search(const SearchCriteria &criteria);
-    void cancelSearch();
+    // Main search interface. Every search is a job; its id tags all signals
+    // the search emits.
+    quint64 search(const QString &query, const QString &basePath = QString());
+    quint64 search(const SearchCriteria &criteria, SearchPriority priority = InteractivePriority);
+    void cancelSearch();                // Interactive jobs
+    void cancelJob(quint64 jobId);
     bool isSearching() const;
+    bool isJobRunning(quint64 jobId) const;
     
-    // Advanced search methods
-    void searchByName(const QString &pattern, const QString &basePath);
-    void searchByContent(const QString &text, const QString &basePath);
-    void searchByMetadata(const QHash<QString, QVariant> &metadata, const QString &basePath);
-    void searchByRegex(const QRegularExpression &regex, const QString &basePath);
-    void fuzzySearch(const QString &query, const QString &basePath);
-    void searchByDateRange(const QDateTime &from, const QDateTime &to, const QString &basePath);
-    void searchBySizeRange(qint64 minSize, qint64 maxSize, const QString &basePath);
-    void searchByType(const QStringList &mimeTypes, const QString &basePath);
+    // Advanced search methods; like search(), they return the job's id.
+    // An empty basePath searches the current directory.
+    quint64 searchByName(const QString &pattern, const QString &basePath);
+    quint64 searchByContent(const QString &text, const QString &basePath);
+    quint64 searchByContent(const QStringList &terms, const QString &basePath);
+    quint64 searchByMetadata(const QHash<QString, QVariant> &metadata, const QString &basePath);
+    quint64 searchByRegex(const QRegularExpression &regex, const QString &basePath);
+    quint64 fuzzySearch(const QString &query, const QString &basePath);
+    quint64 searchByDateRange(const QDateTime &from, const QDateTime &to, const QString &basePath);
+    quint64 searchBySizeRange(qint64 minSize, qint64 maxSize, const QString &basePath);
+    quint64 searchByType(const QStringList &mimeTypes, const QString &basePath);
     
     // Search history and suggestions
     void saveSearch(const SearchCriteria &criteria);
@@ -154,30 +192,68 @@ public:
     void setThreadCount(int threadCount);
     int threadCount() const;
     
+    // Result cache. With a staleness bound, results invalidated by a change
+    // event are still served for up to that many milliseconds; 0 drops them
+    // as soon as the change is reported. Entries expire after
+    // RESULT_CACHE_TTL_MS either way.
+    void setCacheMaxStaleness(int milliseconds);
+    int cacheMaxStaleness() const;
+    void clearResultCache();
+    
     // Index management
+    // Searches whose filters the file index can evaluate (ext:, size:, ...)
+    // take their candidates from it instead of walking the tree
+    void setFileIndexer(FileIndexer *indexer);
+    
+    // Builds the full-text index of the text files under basePath in the
+    // background; indexingCompleted() follows. Content searches below it
+    // then only read the files the index names. Rebuilding re-reads only
+    // files whose size or mtime changed.
     void buildIndex(const QString &basePath);
-    void updateIndex(const QString &path);
+    void updateIndex(const QString &path);      // A file, or the files directly in a directory
     void removeFromIndex(const QString &path);
     void clearIndex();
     bool isIndexBuilt() const;
     
+    // Text members of archives go into the full-text index as well, under
+    // their virtual paths, when their archive is next indexed. Off by
+    // default.
+    void setArchiveContentIndexing(bool enabled);
+    bool archiveContentIndexing() const;
+    
     // Performance monitoring
+    bool isLastSearchComplete() const;
     int getLastSearchTime() const;
     int getResultCount() const;
     QString getSearchStatistics() const;
 
 signals:
-    void searchStarted(const QString &query);
-    void searchCompleted(const QList<SearchResult> &results);
-    void searchCancelled();
-    void searchProgress(int percentage);
-    void searchError(const QString &error);
+    // The job id comes last, so slots that serve a single search can leave
+    // it out
+    void searchStarted(const QString &query, quint64 jobId);
+    void searchCompleted(const QList<SearchResult> &results, quint64 jobId);
+    void searchCancelled(quint64 jobId);
+    void searchProgress(int percentage, quint64 jobId);
+    void searchError(const QString &error, quint64 jobId);
+    // Emitted before searchCompleted when the timeout cut the walk short
+    void searchIncomplete(const QString &reason, quint64 jobId);
     void indexingProgress(int percentage);
     void indexingCompleted();
-    void resultFound(const SearchResult &result);
+    // Results as they are found, in chunks of at most RESULT_BATCH_SIZE and
+    // at most RESULT_BATCH_INTERVAL_MS apart. searchCompleted still delivers
+    // the final ranked list.
+    void resultsFound(const QList<SearchResult> &results, quint64 jobId);
+
+public slots:
+    // Drops cached results and refinement state that depend on path
+    void invalidatePath(const QString &path);
+    
+    // Rebuilds the completion trie from the indexed file names and the
+    // search history, in the background
+    void rebuildSuggestions();
 
 private slots:
-    void onSearchFinished();
+    void onSearchFinished(quint64 jobId);
     void onIndexingFinished();
     void onSearchWorkerFinished();
 
@@ -188,28 +264,92 @@ private:
     class FuzzyMatcher;
     class ContentSearcher;
     class MetadataSearcher;
+    struct SearchContext;
+    struct DirectoryEntry;
     
-    void performSearch(const SearchCriteria &criteria);
-    void searchInDirectory(const QString &path, const SearchCriteria &criteria, QList<SearchResult> &results);
+    // A directory the walk has yet to list; depth counts from the search root
+    struct PendingDirectory {
+        QString path;
+        int depth;
+    };
+    
+    struct SearchJob {
+        quint64 id;
+        quint64 generation;     // Interactive generation the job belongs to
+        SearchPriority priority;
+        SearchCriteria criteria;
+        QAtomicInt cancelled;
+        QElapsedTimer timer;
+        
+        // Written by the worker before it reports the job finished
+        int resultCount;
+        bool complete;
+    };
+    
+    void runJob(const std::shared_ptr<SearchJob> &job);
+    bool isStale(const SearchJob &job) const;
+    void post(quint64 jobId, std::function<void()> signal);
+    
+    void performSearch(SearchJob &job);
+    void buildContentIndex(const QString &basePath);
+    void saveContentIndex();
+    void refreshContent(const QString &path);
+    void indexContentFile(const QString &path);
+    void indexArchiveContent(const QString &path);
+    void searchInDirectory(const QString &path, SearchContext &context);
+    void searchInDirectories(QList<PendingDirectory> pending, SearchContext &context);
+    void searchCandidates(const QStringList &paths, SearchContext &context);
+    bool searchArchive(const QString &path, SearchContext &context, QSet<QString> *wanted = nullptr);
+    void searchEntry(DirectoryEntry &entry, SearchContext &context);
+    bool isRefinementOf(const SearchCriteria &criteria, const SearchCriteria &previous) const;
+    bool indexCandidates(const QString &searchPath, SearchContext &context, QStringList &paths);
+    bool contentCandidates(const QString &searchPath, const SearchContext &context, QStringList &paths);
+    bool nameCandidates(const QString &searchPath, const SearchContext &context, QStringList &paths);
+    bool buildSubtreeProbe(SearchContext &context) const;
+    bool subtreeMayMatch(const DirectoryEntry &directory, const SearchContext &context) const;
+    void addChangedDirectories(const QString &searchPath, SearchContext &context, QList<PendingDirectory> &pending) const;
+    
+    // Result cache
+    QString cacheKey(const SearchCriteria &criteria, const QString &searchPath) const;
+    bool cachedResults(const QString &key, QList<SearchResult> &results);
+    void storeResults(const QString &key, const SearchCriteria &criteria, const QString &searchPath,
+                      const QList<SearchResult> &results, quint64 epoch);
+    static bool dependsOn(const QString &root, bool recursive, const QString &path);
+    static bool affects(const QString &path, const QString &root, bool recursive);
     void searchInFile(const QString &filePath, const SearchCriteria &criteria, QList<SearchResult> &results);
+    void queueResult(const SearchResult &result, SearchContext &context);
+    void flushResults(SearchContext &context);
     
     // Specific search implementations
-    bool matchesFileName(const QString &fileName, const SearchCriteria &criteria);
-    bool matchesContent(const QString &filePath, const SearchCriteria &criteria, QStringList &matchedLines);
-    bool matchesMetadata(const QFileInfo &fileInfo, const SearchCriteria &criteria);
-    bool matchesFilters(const QFileInfo &fileInfo, const SearchCriteria &criteria);
+    bool matchesFileName(const QString &fileName, const SearchContext &context, SearchResult &result);
+    bool matchesIdentifier(const QString &fileName, const SearchContext &context);
+    bool matchesContent(const DirectoryEntry &entry, const SearchContext &context, SearchResult &result);
+    bool matchesArchiveMember(const DirectoryEntry &entry, const SearchContext &context, SearchResult &result);
+    bool matchesDocument(const DirectoryEntry &entry, const SearchContext &context, SearchResult &result);
+    bool matchesText(const QByteArray &data, const SearchContext &context, SearchResult &result);
+    bool matchesMetadata(const QString &filePath, const SearchCriteria &criteria);
     
     // Fuzzy matching
     double calculateFuzzyScore(const QString &query, const QString &target);
-    bool fuzzyMatch(const QString &query, const QString &target, double threshold = 0.6);
+    bool fuzzyMatch(const QString &query, const QString &target, double threshold = 0.0);
     
     // Content analysis
+    struct FileIdentity {
+        quint64 device;
+        quint64 inode;
+        qint64 modifiedNsecs;
+        qint64 size;
+    };
+    
     bool isBinaryFile(const QString &filePath);
+    bool fileIdentity(const QString &filePath, FileIdentity &identity) const;
+    int cachedBinaryVerdict(const FileIdentity &identity);
+    void storeBinaryVerdict(const FileIdentity &identity, bool binary);
     QString extractTextContent(const QString &filePath);
     QStringList extractMetadata(const QString &filePath);
     
     // Scoring and ranking
-    double calculateRelevanceScore(const SearchResult &result, const SearchCriteria &criteria);
+    double calculateRelevanceScore(const SearchResult &result, const SearchContext &context);
     void rankResults(QList<SearchResult> &results, const SearchCriteria &criteria);
     
     // Index management
@@ -228,12 +368,16 @@ private:
     
     QThread *m_searchThread;
     QThread *m_indexThread;
-    QFutureWatcher<void> m_searchWatcher;
     QFutureWatcher<void> m_indexWatcher;
     
-    // Search state
-    QAtomicInt m_isSearching;
-    QAtomicInt m_searchCancelled;
+    // Search state. Jobs are owned here, on the engine's thread; a worker
+    // keeps its job alive until it returns. A job that is no longer listed,
+    // or belongs to an older interactive generation, is stale.
+    QThreadPool m_searchPool;
+    QHash<quint64, std::shared_ptr<SearchJob>> m_jobs;
+    quint64 m_nextJobId;
+    QAtomicInteger<quint64> m_generation;
+    QAtomicInt m_lastSearchComplete;
     QMutex m_searchMutex;
     QWaitCondition m_searchCondition;
     
@@ -245,21 +389,71 @@ private:
     
     // Index data
     QHash<QString, QFileInfo> m_fileIndex;
-    QHash<QString, QStringList> m_contentIndex;
+    std::unique_ptr<ContentIndex> m_contentIndex;  // Full-text index, see buildIndex()
     QHash<QString, QHash<QString, QVariant>> m_metadataIndex;
-    QMutex m_indexMutex;
+    QMutex m_indexMutex;            // Guards m_contentIndex and m_indexBuilt
     bool m_indexBuilt;
+    QAtomicInt m_indexCancelled;
+    static const int INDEX_CHECKPOINT_INTERVAL_MS = 60000;    // Saves during a build
+    QAtomicInt m_indexArchiveContent;
+    ArchiveReader::Limits m_archiveLimits;
+    DocumentText::Limits m_documentLimits;
+    FileIndexer *m_fileIndexer;
     
     // Search history
     QList<SearchCriteria> m_searchHistory;
-    QStringList m_searchSuggestions;
+    QHash<QString, quint32> m_queryCounts;     // Occurrences in m_searchHistory
     static const int MAX_SEARCH_HISTORY = 100;
     
+    // Completions, mapped from the cache directory and swapped for a new
+    // trie when a rebuild finishes
+    std::unique_ptr<SuggestionTrie> m_suggestions;
+    QFuture<void> m_suggestionBuild;
+    mutable QMutex m_suggestionMutex;
+    static const int MAX_SUGGESTIONS = 10;
+    static const quint32 QUERY_WEIGHT = 16;    // A past query counts as this many file names
+    
+    // Matches of the last search, refined in place when the next query
+    // narrows it (search-as-you-type). A search the next keystroke cancelled
+    // leaves its matches so far and the directories it hadn't walked yet.
+    struct CandidateSet {
+        SearchCriteria criteria;
+        QString searchPath;
+        QStringList paths;
+        QList<PendingDirectory> unwalked;
+    };
+    CandidateSet m_lastCandidates;
+    bool m_hasLastCandidates;
+    QMutex m_candidateMutex;
+    static const int MAX_REFINEMENT_CANDIDATES = 100000;
+    
+    // Recent result sets keyed by normalized criteria, least recently used
+    // evicted first
+    struct CachedSearch {
+        QList<SearchResult> results;
+        QString searchPath;
+        bool recursive;
+        quint64 lastUsed;
+        qint64 storedAt;        // msecs since epoch
+        qint64 invalidatedAt;   // msecs since epoch, 0 while still valid
+    };
+    QHash<QString, CachedSearch> m_resultCache;
+    quint64 m_cacheClock;
+    quint64 m_cacheEpoch;       // Bumped by every invalidatePath()
+    int m_cacheMaxStaleness;
+    QMutex m_resultCacheMutex;
+    static const int MAX_CACHED_SEARCHES = 32;
+    // Changes below the watched directories go unreported, so nothing is
+    // served from the cache for longer than this
+    static const qint64 RESULT_CACHE_TTL_MS = 10000;
+    
     // Performance monitoring
     QTimer *m_searchTimer;
     QElapsedTimer *m_elapsedTimer;
     int m_lastSearchTime;
     int m_resultCount;
+    static const int RESULT_BATCH_SIZE = 256;
+    static const int RESULT_BATCH_INTERVAL_MS = 16;
     
     // MIME database
     QMimeDatabase m_mimeDatabase;
@@ -269,4 +463,16 @@ private:
     
     // Stop words for content search
     QSet<QString> m_stopWords;
+    
+    // Binary/text verdicts keyed by (device, inode), validated by mtime in
+    // nanoseconds and size, so a rewrite within the same second is noticed
+    struct BinaryVerdict {
+        qint64 modifiedNsecs;
+        qint64 size;
+        bool binary;
+    };
+    QHash<QPair<quint64, quint64>, BinaryVerdict> m_binaryVerdicts;
+    QMutex m_binaryVerdictMutex;
+    static const int MAX_BINARY_VERDICTS = 200000;
+    static const int SNIFF_BUFFER_SIZE = 8192;
 }; 
\ No newline at end of file
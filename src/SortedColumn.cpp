@@ -0,0 +1,121 @@
+#include "SortedColumn.h"
+#include <algorithm>
+
+SortedColumn::SortedColumn()
+{
+}
+
+void SortedColumn::insert(qint64 key, quint32 id)
+{
+    const Entry entry{key, id};
+
+    // Re-inserting something removed since the last merge just cancels out
+    if (m_pendingRemovals.remove(entry)) {
+        return;
+    }
+    m_pendingInserts.insert(entry);
+}
+
+void SortedColumn::remove(qint64 key, quint32 id)
+{
+    const Entry entry{key, id};
+
+    if (m_pendingInserts.remove(entry)) {
+        return;
+    }
+    m_pendingRemovals.insert(entry);
+}
+
+void SortedColumn::clear()
+{
+    m_entries.clear();
+    m_fences.clear();
+    m_pendingInserts.clear();
+    m_pendingRemovals.clear();
+}
+
+int SortedColumn::size() const
+{
+    return m_entries.size() + m_pendingInserts.size() - m_pendingRemovals.size();
+}
+
+QVector<quint32> SortedColumn::range(qint64 low, qint64 high) const
+{
+    QVector<quint32> ids;
+    if (low > high) {
+        return ids;
+    }
+
+    merge();
+    const int begin = lowerBound(low);
+    const int end = upperBound(high);
+    ids.reserve(qMax(0, end - begin));
+    for (int i = begin; i < end; ++i) {
+        ids.append(m_entries.at(i).id);
+    }
+    return ids;
+}
+
+int SortedColumn::count(qint64 low, qint64 high) const
+{
+    if (low > high) {
+        return 0;
+    }
+
+    merge();
+    return qMax(0, upperBound(high) - lowerBound(low));
+}
+
+void SortedColumn::merge() const
+{
+    if (m_pendingInserts.isEmpty() && m_pendingRemovals.isEmpty()) {
+        return;
+    }
+
+    if (!m_pendingRemovals.isEmpty()) {
+        const auto removed = [this](const Entry &entry) {
+            return m_pendingRemovals.contains(entry);
+        };
+        m_entries.erase(std::remove_if(m_entries.begin(), m_entries.end(), removed), m_entries.end());
+        m_pendingRemovals.clear();
+    }
+
+    if (!m_pendingInserts.isEmpty()) {
+        const int middle = m_entries.size();
+        m_entries.reserve(middle + m_pendingInserts.size());
+        for (const Entry &entry : m_pendingInserts) {
+            m_entries.append(entry);
+        }
+        std::sort(m_entries.begin() + middle, m_entries.end());
+        std::inplace_merge(m_entries.begin(), m_entries.begin() + middle, m_entries.end());
+        m_pendingInserts.clear();
+    }
+
+    m_fences.clear();
+    m_fences.reserve(m_entries.size() / FENCE_STRIDE + 1);
+    for (int i = 0; i < m_entries.size(); i += FENCE_STRIDE) {
+        m_fences.append(m_entries.at(i).key);
+    }
+}
+
+int SortedColumn::lowerBound(qint64 key) const
+{
+    // The first fence >= key bounds the answer from above; the block before
+    // it is the only one left to search
+    const int fence = std::lower_bound(m_fences.constBegin(), m_fences.constEnd(), key) - m_fences.constBegin();
+    const int begin = qMax(0, fence - 1) * FENCE_STRIDE;
+    const int end = qMin(m_entries.size(), fence * FENCE_STRIDE + 1);
+    return std::lower_bound(m_entries.constBegin() + begin, m_entries.constBegin() + end, key,
+                            [](const Entry &entry, qint64 value) { return entry.key < value; })
+        - m_entries.constBegin();
+}
+
+int SortedColumn::upperBound(qint64 key) const
+{
+    const int fence = std::upper_bound(m_fences.constBegin(), m_fences.constEnd(), key) - m_fences.constBegin();
+    const int begin = qMax(0, fence - 1) * FENCE_STRIDE;
+    const int end = qMin(m_entries.size(), fence * FENCE_STRIDE + 1);
+    return std::upper_bound(m_entries.constBegin() + begin, m_entries.constBegin() + end, key,
+                            [](qint64 value, const Entry &entry) { return value < entry.key; })
+        - m_entries.constBegin();
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <QHashFunctions>
+#include <QSet>
+#include <QVector>
+
+// Secondary index of (key, id) pairs kept sorted by key, for range queries
+// such as "larger than 1 GB" or "modified in the last hour". Writes land in
+// small unordered buffers that are merged in before the next read. A sparse
+// summary holding every FENCE_STRIDE-th key narrows each lookup to one block
+// before the binary search, so a range scan touches little more than the
+// entries it returns.
+//
+// Not thread safe; the owner serializes access.
+class SortedColumn
+{
+public:
+    SortedColumn();
+
+    void insert(qint64 key, quint32 id);
+    void remove(qint64 key, quint32 id);
+    void clear();
+
+    int size() const;
+
+    // Ids with low <= key <= high, in key order
+    QVector<quint32> range(qint64 low, qint64 high) const;
+    int count(qint64 low, qint64 high) const;
+
+private:
+    struct Entry {
+        qint64 key;
+        quint32 id;
+
+        bool operator<(const Entry &other) const
+        {
+            return key != other.key ? key < other.key : id < other.id;
+        }
+        bool operator==(const Entry &other) const
+        {
+            return key == other.key && id == other.id;
+        }
+        friend size_t qHash(const Entry &entry, size_t seed = 0)
+        {
+            return qHashMulti(seed, entry.key, entry.id);
+        }
+    };
+
+    void merge() const;
+    int lowerBound(qint64 key) const;
+    int upperBound(qint64 key) const;
+
+    static const int FENCE_STRIDE = 64;
+
+    mutable QVector<Entry> m_entries;
+    mutable QVector<qint64> m_fences;   // m_entries[i * FENCE_STRIDE].key
+    // Hashed, so a write cancelling a pending one is found in constant time
+    mutable QSet<Entry> m_pendingInserts;
+    mutable QSet<Entry> m_pendingRemovals;
+};
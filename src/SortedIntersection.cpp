@@ -0,0 +1,154 @@
+#include "SortedIntersection.h"
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+template<typename T>
+int mergeScalar(const T *a, int sizeA, const T *b, int sizeB, T *out)
+{
+    int i = 0;
+    int j = 0;
+    int count = 0;
+    while (i < sizeA && j < sizeB) {
+        if (a[i] < b[j]) {
+            ++i;
+        } else if (b[j] < a[i]) {
+            ++j;
+        } else {
+            out[count++] = a[i];
+            ++i;
+            ++j;
+        }
+    }
+    return count;
+}
+
+// Every id of small is searched for in large, doubling the step from the
+// last hit before the binary search
+template<typename T>
+int gallop(const T *small, int sizeSmall, const T *large, int sizeLarge, T *out)
+{
+    int count = 0;
+    int low = 0;
+    for (int i = 0; i < sizeSmall && low < sizeLarge; ++i) {
+        const T value = small[i];
+        int step = 1;
+        int high = low;
+        while (high < sizeLarge && large[high] < value) {
+            low = high + 1;
+            high += step;
+            step *= 2;
+        }
+        const T *found = std::lower_bound(large + low, large + qMin(high + 1, sizeLarge), value);
+        low = int(found - large);
+        if (low < sizeLarge && large[low] == value) {
+            out[count++] = value;
+            ++low;
+        }
+    }
+    return count;
+}
+
+#ifdef __SSE2__
+
+// The lanes of a equal to any lane of b. b is rotated one lane at a time,
+// so every pair of lanes is compared once.
+template<int LaneBytes>
+__m128i anyEqual(__m128i a, __m128i b)
+{
+    __m128i equal = LaneBytes == 4 ? _mm_cmpeq_epi32(a, b) : _mm_cmpeq_epi16(a, b);
+    for (int rotation = 1; rotation < 16 / LaneBytes; ++rotation) {
+        b = _mm_or_si128(_mm_srli_si128(b, LaneBytes), _mm_slli_si128(b, 16 - LaneBytes));
+        equal = _mm_or_si128(equal, LaneBytes == 4 ? _mm_cmpeq_epi32(a, b) : _mm_cmpeq_epi16(a, b));
+    }
+    return equal;
+}
+
+template<typename T>
+int mergeBlocks(const T *a, int sizeA, const T *b, int sizeB, T *out)
+{
+    const int lanes = 16 / int(sizeof(T));
+    int i = 0;
+    int j = 0;
+    int count = 0;
+    while (i + lanes <= sizeA && j + lanes <= sizeB) {
+        const __m128i blockA = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+        const __m128i blockB = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + j));
+        unsigned mask = unsigned(_mm_movemask_epi8(anyEqual<int(sizeof(T))>(blockA, blockB)));
+        while (mask) {
+            const int byte = qCountTrailingZeroBits(mask);
+            out[count++] = a[i + byte / int(sizeof(T))];
+            mask &= ~((1u << (byte + int(sizeof(T)))) - 1);
+        }
+
+        // The block with the smaller maximum can't match anything further
+        const T lastA = a[i + lanes - 1];
+        const T lastB = b[j + lanes - 1];
+        if (lastA <= lastB) {
+            i += lanes;
+        }
+        if (lastB <= lastA) {
+            j += lanes;
+        }
+    }
+    return count + mergeScalar(a + i, sizeA - i, b + j, sizeB - j, out + count);
+}
+
+#else
+
+template<typename T>
+int mergeBlocks(const T *a, int sizeA, const T *b, int sizeB, T *out)
+{
+    return mergeScalar(a, sizeA, b, sizeB, out);
+}
+
+#endif
+
+template<typename T>
+int intersectArrays(const T *a, int sizeA, const T *b, int sizeB, T *out)
+{
+    if (sizeA == 0 || sizeB == 0 || a[sizeA - 1] < b[0] || b[sizeB - 1] < a[0]) {
+        return 0;
+    }
+    if (qint64(sizeA) * SortedIntersection::GALLOP_RATIO < sizeB) {
+        return gallop(a, sizeA, b, sizeB, out);
+    }
+    if (qint64(sizeB) * SortedIntersection::GALLOP_RATIO < sizeA) {
+        return gallop(b, sizeB, a, sizeA, out);
+    }
+    return mergeBlocks(a, sizeA, b, sizeB, out);
+}
+
+template<typename T>
+QVector<T> intersectVectors(const QVector<T> &a, const QVector<T> &b)
+{
+    QVector<T> result(qMin(a.size(), b.size()));
+    result.resize(intersectArrays(a.constData(), int(a.size()), b.constData(), int(b.size()), result.data()));
+    return result;
+}
+
+}
+
+QVector<quint32> SortedIntersection::intersect(const QVector<quint32> &a, const QVector<quint32> &b)
+{
+    return intersectVectors(a, b);
+}
+
+QVector<quint16> SortedIntersection::intersect(const QVector<quint16> &a, const QVector<quint16> &b)
+{
+    return intersectVectors(a, b);
+}
+
+int SortedIntersection::intersect(const quint32 *a, int sizeA, const quint32 *b, int sizeB, quint32 *out)
+{
+    return intersectArrays(a, sizeA, b, sizeB, out);
+}
+
+int SortedIntersection::intersect(const quint16 *a, int sizeA, const quint16 *b, int sizeB, quint16 *out)
+{
+    return intersectArrays(a, sizeA, b, sizeB, out);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <QVector>
+#include <QtGlobal>
+
+// Intersection of strictly ascending id arrays, as used for postings and
+// Roaring array containers. Picks the strategy from the sizes:
+//
+//  - galloping (exponential search of the larger array) when one side is
+//    GALLOP_RATIO times larger, so the cost follows the smaller side;
+//  - otherwise a block merge that compares a whole SSE2 register of each
+//    side at once, with a scalar merge for the tail and for CPUs without
+//    SSE2.
+class SortedIntersection
+{
+public:
+    static QVector<quint32> intersect(const QVector<quint32> &a, const QVector<quint32> &b);
+    static QVector<quint16> intersect(const QVector<quint16> &a, const QVector<quint16> &b);
+
+    // Writes the common ids to out, which must hold min(sizeA, sizeB)
+    // values, and returns how many there are
+    static int intersect(const quint32 *a, int sizeA, const quint32 *b, int sizeB, quint32 *out);
+    static int intersect(const quint16 *a, int sizeA, const quint16 *b, int sizeB, quint16 *out);
+
+    static const int GALLOP_RATIO = 32;
+};
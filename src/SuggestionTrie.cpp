@@ -0,0 +1,351 @@
+#include "SuggestionTrie.h"
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QDir>
+#include <algorithm>
+#include <cstring>
+#include <queue>
+#include <vector>
+
+namespace {
+
+const char MAGIC[4] = {'S', 'G', 'T', '1'};
+const quint32 BYTE_ORDER_MARK = 0x01020304;
+
+struct Key {
+    QString key;            // Case folded
+    QString text;           // Heaviest spelling
+    quint32 textWeight;
+    quint32 weight;
+};
+
+quint32 saturatingAdd(quint32 a, quint32 b)
+{
+    return a > 0xffffffffu - b ? 0xffffffffu : a + b;
+}
+
+}
+
+SuggestionTrie::SuggestionTrie()
+    : m_nodes(nullptr)
+    , m_nodeCount(0)
+    , m_pool(nullptr)
+    , m_poolLength(0)
+    , m_keyCount(0)
+{
+}
+
+QByteArray SuggestionTrie::build(const QHash<QString, quint32> &weights)
+{
+    QHash<QString, Key> byKey;
+    for (auto it = weights.constBegin(); it != weights.constEnd(); ++it) {
+        if (it.key().isEmpty() || it.key().size() > MAX_KEY_LENGTH || it.value() == 0) {
+            continue;
+        }
+        const QString folded = it.key().toCaseFolded();
+        Key &key = byKey[folded];
+        if (key.key.isEmpty()) {
+            key.key = folded;
+            key.textWeight = 0;
+            key.weight = 0;
+        }
+        key.weight = saturatingAdd(key.weight, it.value());
+        if (it.value() > key.textWeight) {
+            key.text = it.key();
+            key.textWeight = it.value();
+        }
+    }
+
+    std::vector<Key> keys;
+    keys.reserve(byKey.size());
+    for (const Key &key : byKey) {
+        keys.push_back(key);
+    }
+    std::sort(keys.begin(), keys.end(), [](const Key &a, const Key &b) {
+        return a.key < b.key;
+    });
+
+    // Keys go into the pool once; labels point into them, and the display
+    // text is only added when it differs from the key
+    QString pool;
+    std::vector<quint32> keyOffsets(keys.size());
+    std::vector<quint32> textOffsets(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        keyOffsets[i] = pool.size();
+        pool += keys[i].key;
+        if (keys[i].text == keys[i].key) {
+            textOffsets[i] = keyOffsets[i];
+        } else {
+            textOffsets[i] = pool.size();
+            pool += keys[i].text;
+        }
+    }
+
+    // Breadth first, so that the children of a node are laid out together
+    // and always after it
+    struct Pending {
+        quint32 node;
+        size_t begin;
+        size_t end;
+        int depth;
+    };
+    std::vector<Node> nodes(1);
+    std::memset(&nodes[0], 0, sizeof(Node));
+    std::queue<Pending> pending;
+    pending.push({0, 0, keys.size(), 0});
+
+    while (!pending.empty()) {
+        const Pending current = pending.front();
+        pending.pop();
+
+        size_t begin = current.begin;
+        if (begin < current.end && keys[begin].key.size() == current.depth) {
+            // Sorted order puts the key that ends here first
+            Node &node = nodes[current.node];
+            node.weight = keys[begin].weight;
+            node.textOffset = textOffsets[begin];
+            node.textLength = quint16(keys[begin].text.size());
+            ++begin;
+        }
+
+        const quint32 firstChild = quint32(nodes.size());
+        quint32 childCount = 0;
+        for (size_t i = begin; i < current.end;) {
+            const QChar unit = keys[i].key.at(current.depth);
+            size_t j = i + 1;
+            while (j < current.end && keys[j].key.at(current.depth) == unit) {
+                ++j;
+            }
+
+            // The first and last key of a sorted group share the group's
+            // longest common prefix
+            const QString &first = keys[i].key;
+            const QString &last = keys[j - 1].key;
+            int common = current.depth + 1;
+            while (common < first.size() && common < last.size() && first.at(common) == last.at(common)) {
+                ++common;
+            }
+
+            Node child;
+            std::memset(&child, 0, sizeof(Node));
+            child.labelOffset = keyOffsets[i] + current.depth;
+            child.labelLength = quint16(common - current.depth);
+            nodes.push_back(child);
+            pending.push({quint32(nodes.size() - 1), i, j, common});
+            ++childCount;
+            i = j;
+        }
+        nodes[current.node].firstChild = childCount > 0 ? firstChild : 0;
+        nodes[current.node].childCount = childCount;
+    }
+
+    for (size_t i = nodes.size(); i-- > 0;) {
+        Node &node = nodes[i];
+        node.maxWeight = node.weight;
+        for (quint32 child = node.firstChild; child < node.firstChild + node.childCount; ++child) {
+            node.maxWeight = qMax(node.maxWeight, nodes[child].maxWeight);
+        }
+    }
+
+    Header header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.nodeCount = quint32(nodes.size());
+    header.poolLength = quint32(pool.size());
+
+    QByteArray data;
+    data.reserve(sizeof(Header) + nodes.size() * sizeof(Node) + pool.size() * sizeof(char16_t));
+    data.append(reinterpret_cast<const char *>(&header), sizeof(Header));
+    data.append(reinterpret_cast<const char *>(nodes.data()), qsizetype(nodes.size() * sizeof(Node)));
+    data.append(reinterpret_cast<const char *>(pool.utf16()), qsizetype(pool.size() * sizeof(char16_t)));
+    return data;
+}
+
+bool SuggestionTrie::save(const QString &fileName, const QByteArray &data)
+{
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+
+    // Written aside and renamed, so a trie mapped from the old file stays valid
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(data);
+    return file.commit();
+}
+
+bool SuggestionTrie::load(const QByteArray &data)
+{
+    close();
+    m_buffer = data;
+    if (!attach(reinterpret_cast<const uchar *>(m_buffer.constData()), m_buffer.size())) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool SuggestionTrie::open(const QString &fileName)
+{
+    close();
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const uchar *data = m_file.map(0, m_file.size());
+    if (!data || !attach(data, m_file.size())) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void SuggestionTrie::close()
+{
+    m_nodes = nullptr;
+    m_nodeCount = 0;
+    m_pool = nullptr;
+    m_poolLength = 0;
+    m_keyCount = 0;
+    m_buffer.clear();
+    if (m_file.isOpen()) {
+        m_file.close();     // Also unmaps
+    }
+}
+
+bool SuggestionTrie::isEmpty() const
+{
+    return m_keyCount == 0;
+}
+
+int SuggestionTrie::size() const
+{
+    return m_keyCount;
+}
+
+QList<SuggestionTrie::Suggestion> SuggestionTrie::complete(const QString &prefix, int count) const
+{
+    QList<Suggestion> suggestions;
+    if (!m_nodes || count <= 0) {
+        return suggestions;
+    }
+
+    // Descend to the node at or just below the end of the prefix
+    const QString key = prefix.toCaseFolded();
+    const char16_t *units = reinterpret_cast<const char16_t *>(key.utf16());
+    quint32 node = 0;
+    int matched = 0;
+    while (matched < key.size()) {
+        const int child = findChild(m_nodes[node], units[matched]);
+        if (child < 0) {
+            return suggestions;
+        }
+        const Node &edge = m_nodes[child];
+        const int length = qMin(int(edge.labelLength), int(key.size()) - matched);
+        if (std::memcmp(m_pool + edge.labelOffset, units + matched, length * sizeof(char16_t)) != 0) {
+            return suggestions;
+        }
+        matched += length;
+        node = quint32(child);
+    }
+
+    // Best first: a subtree is opened only when its largest weight can still
+    // make the list. Keys themselves are queued as leaves with their weight.
+    struct Candidate {
+        quint32 weight;
+        quint32 node;
+        bool key;
+
+        bool operator<(const Candidate &other) const
+        {
+            if (weight != other.weight) {
+                return weight < other.weight;
+            }
+            return node > other.node;   // Shorter keys first among equals
+        }
+    };
+    std::priority_queue<Candidate> queue;
+    queue.push({m_nodes[node].maxWeight, node, false});
+
+    while (!queue.empty() && suggestions.size() < count) {
+        const Candidate candidate = queue.top();
+        queue.pop();
+        const Node &current = m_nodes[candidate.node];
+        if (candidate.key) {
+            suggestions.append({text(current.textOffset, current.textLength), current.weight});
+            continue;
+        }
+        if (current.weight > 0) {
+            queue.push({current.weight, candidate.node, true});
+        }
+        for (quint32 child = current.firstChild; child < current.firstChild + current.childCount; ++child) {
+            queue.push({m_nodes[child].maxWeight, child, false});
+        }
+    }
+    return suggestions;
+}
+
+bool SuggestionTrie::attach(const uchar *data, qint64 size)
+{
+    if (size < qint64(sizeof(Header))) {
+        return false;
+    }
+
+    Header header;
+    std::memcpy(&header, data, sizeof(Header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.byteOrder != BYTE_ORDER_MARK
+        || header.nodeCount == 0
+        || size != qint64(sizeof(Header)) + qint64(header.nodeCount) * qint64(sizeof(Node))
+                   + qint64(header.poolLength) * qint64(sizeof(char16_t))) {
+        return false;
+    }
+
+    const Node *nodes = reinterpret_cast<const Node *>(data + sizeof(Header));
+
+    // Checked once, so lookups can trust every offset
+    int keys = 0;
+    for (quint32 i = 0; i < header.nodeCount; ++i) {
+        const Node &node = nodes[i];
+        if (quint64(node.labelOffset) + node.labelLength > header.poolLength
+            || quint64(node.textOffset) + node.textLength > header.poolLength
+            || (i > 0 && node.labelLength == 0)
+            || (node.childCount > 0 && (node.firstChild <= i
+                                        || quint64(node.firstChild) + node.childCount > header.nodeCount))) {
+            return false;
+        }
+        if (node.weight > 0) {
+            ++keys;
+        }
+    }
+
+    m_nodes = nodes;
+    m_nodeCount = header.nodeCount;
+    m_pool = reinterpret_cast<const char16_t *>(data + sizeof(Header) + header.nodeCount * sizeof(Node));
+    m_poolLength = header.poolLength;
+    m_keyCount = keys;
+    return true;
+}
+
+int SuggestionTrie::findChild(const Node &node, char16_t unit) const
+{
+    int low = int(node.firstChild);
+    int high = int(node.firstChild + node.childCount) - 1;
+    while (low <= high) {
+        const int middle = (low + high) / 2;
+        const char16_t current = m_pool[m_nodes[middle].labelOffset];
+        if (current < unit) {
+            low = middle + 1;
+        } else if (current > unit) {
+            high = middle - 1;
+        } else {
+            return middle;
+        }
+    }
+    return -1;
+}
+
+QString SuggestionTrie::text(quint32 offset, int length) const
+{
+    return QString(reinterpret_cast<const QChar *>(m_pool + offset), length);
+}
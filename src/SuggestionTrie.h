@@ -0,0 +1,74 @@
+#pragma once
+
+#include <QString>
+#include <QList>
+#include <QHash>
+#include <QByteArray>
+#include <QFile>
+
+// Weighted completion trie for the search field. Keys are case-folded and
+// stored path-compressed: every edge carries a run of characters and every
+// node the largest weight below it, so the best completions of a prefix are
+// found best-first without visiting the rest of the subtree.
+//
+// The trie is one flat, pointer-free block (header, node array, UTF-16
+// string pool) that is read in place, either from memory or mapped from the
+// file written by save(), so it needs no parsing at startup.
+class SuggestionTrie
+{
+public:
+    struct Suggestion {
+        QString text;
+        quint32 weight;
+    };
+
+    SuggestionTrie();
+
+    // Builds the block for text -> weight. Texts equal up to case share one
+    // key; its weight is the sum and the heaviest spelling is shown.
+    static QByteArray build(const QHash<QString, quint32> &weights);
+    static bool save(const QString &fileName, const QByteArray &data);
+
+    bool load(const QByteArray &data);
+    bool open(const QString &fileName);
+    void close();
+
+    bool isEmpty() const;
+    int size() const;
+
+    // At most count completions of prefix, heaviest first
+    QList<Suggestion> complete(const QString &prefix, int count) const;
+
+private:
+    struct Header {
+        char magic[4];
+        quint32 byteOrder;
+        quint32 nodeCount;
+        quint32 poolLength;
+    };
+
+    struct Node {
+        quint32 labelOffset;    // Edge label from the parent, in the pool
+        quint16 labelLength;
+        quint16 textLength;
+        quint32 firstChild;     // Children are contiguous and sorted by first label unit
+        quint32 childCount;
+        quint32 weight;         // Non-zero if a key ends here
+        quint32 maxWeight;      // Largest weight in this subtree
+        quint32 textOffset;     // Display text of the key ending here
+    };
+
+    bool attach(const uchar *data, qint64 size);
+    int findChild(const Node &node, char16_t unit) const;
+    QString text(quint32 offset, int length) const;
+
+    static const int MAX_KEY_LENGTH = 1024;
+
+    QFile m_file;
+    QByteArray m_buffer;
+    const Node *m_nodes;
+    quint32 m_nodeCount;
+    const char16_t *m_pool;
+    quint32 m_poolLength;
+    int m_keyCount;
+};
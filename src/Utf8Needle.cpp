@@ -0,0 +1,149 @@
+#include "Utf8Needle.h"
+#include <QHash>
+#include <cstring>
+
+namespace {
+
+// Case folding -> the other code points that fold to it. Built once from
+// the Unicode tables Qt ships; few code points fold to anything else.
+const QHash<char32_t, QVector<char32_t>> &foldClasses()
+{
+    static const QHash<char32_t, QVector<char32_t>> classes = [] {
+        QHash<char32_t, QVector<char32_t>> classes;
+        for (char32_t c = 0; c <= 0x10FFFF; ++c) {
+            if (c >= 0xD800 && c <= 0xDFFF) {
+                continue;
+            }
+            const char32_t folded = QChar::toCaseFolded(c);
+            if (folded != c) {
+                classes[folded].append(c);
+            }
+        }
+        return classes;
+    }();
+    return classes;
+}
+
+QByteArray toUtf8(char32_t c)
+{
+    return QString::fromUcs4(&c, 1).toUtf8();
+}
+
+}
+
+Utf8Needle::Utf8Needle()
+    : m_caseSensitive(true)
+    , m_exactLength(0)
+{
+    memset(m_firstBytes, 0, sizeof(m_firstBytes));
+}
+
+Utf8Needle::Utf8Needle(const QString &text, Qt::CaseSensitivity caseSensitivity)
+    : m_caseSensitive(caseSensitivity == Qt::CaseSensitive)
+{
+    memset(m_firstBytes, 0, sizeof(m_firstBytes));
+
+    const QByteArray exact = text.toUtf8();
+    m_exactLength = exact.size();
+    if (m_caseSensitive) {
+        m_exact.setPattern(exact);
+        return;
+    }
+
+    const QHash<char32_t, QVector<char32_t>> &classes = foldClasses();
+    for (char32_t c : text.toUcs4()) {
+        const char32_t folded = QChar::toCaseFolded(c);
+        QVector<QByteArray> alternatives;
+        alternatives.append(toUtf8(folded));
+        for (char32_t other : classes.value(folded)) {
+            alternatives.append(toUtf8(other));
+        }
+        m_alternatives.append(alternatives);
+    }
+    if (!m_alternatives.isEmpty()) {
+        for (const QByteArray &alternative : m_alternatives.first()) {
+            m_firstBytes[uchar(alternative.at(0))] = true;
+        }
+    }
+}
+
+bool Utf8Needle::isEmpty() const
+{
+    return m_exactLength == 0;
+}
+
+qsizetype Utf8Needle::indexIn(const char *data, qsizetype size, qsizetype from) const
+{
+    if (from > size) {
+        return -1;
+    }
+    if (m_exactLength == 0) {
+        return from;
+    }
+    if (m_caseSensitive) {
+        return m_exact.indexIn(data, size, from);
+    }
+
+    // Code points don't overlap in UTF-8, so only the bytes that begin one
+    // of the first character's forms need a closer look
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+    for (qsizetype i = from; i < size; ++i) {
+        if (m_firstBytes[bytes[i]] && matchAt(data, size, i) >= 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+QList<QByteArray> Utf8Needle::caseForms(const QString &text, int maxForms)
+{
+    const QHash<char32_t, QVector<char32_t>> &classes = foldClasses();
+    QList<QByteArray> forms{QByteArray()};
+    for (char32_t c : text.toUcs4()) {
+        const char32_t folded = QChar::toCaseFolded(c);
+        QList<QByteArray> alternatives{toUtf8(folded)};
+        for (char32_t other : classes.value(folded)) {
+            const QByteArray alternative = toUtf8(other);
+            if (!alternatives.contains(alternative.toLower())) {
+                alternatives.append(alternative);
+            }
+        }
+
+        if (forms.size() * alternatives.size() > maxForms) {
+            QList<QByteArray> own{text.toUtf8()};
+            const QByteArray caseFolded = text.toCaseFolded().toUtf8();
+            if (caseFolded.toLower() != own.first().toLower()) {
+                own.append(caseFolded);
+            }
+            return own;
+        }
+        QList<QByteArray> longer;
+        for (const QByteArray &form : forms) {
+            for (const QByteArray &alternative : alternatives) {
+                longer.append(form + alternative);
+            }
+        }
+        forms = longer;
+    }
+    return forms;
+}
+
+qsizetype Utf8Needle::matchAt(const char *data, qsizetype size, qsizetype offset) const
+{
+    // At most one form of a character can match, as UTF-8 is prefix free
+    for (const QVector<QByteArray> &alternatives : m_alternatives) {
+        bool matched = false;
+        for (const QByteArray &alternative : alternatives) {
+            const qsizetype length = alternative.size();
+            if (length <= size - offset && memcmp(data + offset, alternative.constData(), size_t(length)) == 0) {
+                offset += length;
+                matched = true;
+                break;
+            }
+        }
+        if (!matched) {
+            return -1;
+        }
+    }
+    return offset;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayMatcher>
+#include <QList>
+#include <QString>
+#include <QVector>
+
+// A string searched for in UTF-8 bytes without decoding them. Ignoring
+// case, each of its characters stands for every character with the same
+// case folding, as UTF-8: k for k, K and the Kelvin sign, σ for σ, ς and Σ.
+// Hits are thus the ones QString::indexOf() finds in the decoded text,
+// as long as the bytes are valid UTF-8.
+class Utf8Needle
+{
+public:
+    Utf8Needle();
+    Utf8Needle(const QString &text, Qt::CaseSensitivity caseSensitivity);
+
+    bool isEmpty() const;
+
+    // Offset of the first hit at or after from; -1 if there is none
+    qsizetype indexIn(const char *data, qsizetype size, qsizetype from = 0) const;
+
+    // Every UTF-8 form of text that ignoring case matches, as alternatives
+    // for matchers that can't fold beyond ASCII themselves. Forms that
+    // differ only in ASCII case are left out. Past maxForms, text's own and
+    // case-folded forms are all there is.
+    static QList<QByteArray> caseForms(const QString &text, int maxForms);
+
+private:
+    qsizetype matchAt(const char *data, qsizetype size, qsizetype offset) const;
+
+    bool m_caseSensitive;
+    QByteArrayMatcher m_exact;
+    qsizetype m_exactLength;
+
+    QVector<QVector<QByteArray>> m_alternatives;    // Per character, ignoring case
+    bool m_firstBytes[256];                         // Bytes a hit can start with
+};
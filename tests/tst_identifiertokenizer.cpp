@@ -0,0 +1,64 @@
+#include "IdentifierTokenizer.h"
+#include <QtTest>
+
+class TestIdentifierTokenizer : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void splitsAcronyms();
+    void growingQueryCanGainMatches();
+    void extendsRun_data();
+    void extendsRun();
+};
+
+void TestIdentifierTokenizer::splitsAcronyms()
+{
+    QCOMPARE(IdentifierTokenizer::subwords(u"XMLP"), QStringList({"xmlp"}));
+    QCOMPARE(IdentifierTokenizer::subwords(u"XMLPa"), QStringList({"xml", "pa"}));
+    QCOMPARE(IdentifierTokenizer::subwords(u"HTTPServer2"), QStringList({"http", "server", "2"}));
+}
+
+// Typing XMLP, then XMLPa: the longer query matches a name the shorter
+// one doesn't, so its results are no refinement of the shorter one's
+void TestIdentifierTokenizer::growingQueryCanGainMatches()
+{
+    const QString name = "xml_parser.cpp";
+    const QStringList words = IdentifierTokenizer::words(name);
+    const QStringList subwords = IdentifierTokenizer::subwords(name);
+
+    QVERIFY(!IdentifierTokenizer::containsRun(words, IdentifierTokenizer::words(u"XMLP")));
+    QVERIFY(!IdentifierTokenizer::containsRun(subwords, IdentifierTokenizer::subwords(u"XMLP")));
+    QVERIFY(IdentifierTokenizer::containsRun(subwords, IdentifierTokenizer::subwords(u"XMLPa")));
+
+    QVERIFY(!IdentifierTokenizer::extendsRun(IdentifierTokenizer::subwords(u"XMLPa"),
+                                             IdentifierTokenizer::subwords(u"XMLP")));
+}
+
+void TestIdentifierTokenizer::extendsRun_data()
+{
+    QTest::addColumn<QString>("previous");
+    QTest::addColumn<QString>("query");
+    QTest::addColumn<bool>("extends");
+
+    QTest::newRow("last subword grows") << "searc" << "search" << true;
+    QTest::newRow("subword added") << "search" << "searchE" << true;
+    QTest::newRow("later subword grows") << "searchEn" << "searchEngine" << true;
+    QTest::newRow("acronym splits") << "XMLP" << "XMLPa" << false;
+    QTest::newRow("acronym splits again") << "HTTPS" << "HTTPSe" << false;
+    QTest::newRow("grows at the front") << "ngine" << "sEngine" << false;
+}
+
+void TestIdentifierTokenizer::extendsRun()
+{
+    QFETCH(QString, previous);
+    QFETCH(QString, query);
+    QFETCH(bool, extends);
+
+    QCOMPARE(IdentifierTokenizer::extendsRun(IdentifierTokenizer::subwords(query),
+                                             IdentifierTokenizer::subwords(previous)), extends);
+}
+
+QTEST_APPLESS_MAIN(TestIdentifierTokenizer)
+
+#include "tst_identifiertokenizer.moc"